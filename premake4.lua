@@ -28,8 +28,8 @@ one at http://mozilla.org/MPL/2.0/.
 
 BUILD INSTRUCTIONS
 
-Dagon requires the following dependencies: FreeType, GLEW, Lua 5.1, Ogg, OpenAL,
-Theora, Vorbis, SDL2.
+Dagon requires the following dependencies: FreeType, GLEW, libktx, Lua 5.1, Ogg,
+OpenAL, Theora, Vorbis, SDL2.
 
 Linux:
 
@@ -40,6 +40,9 @@ Linux:
   SDL2 was not available in some default repos as of this writing and had to be
   built from scratch.
 
+  libktx is usually not packaged and must be built from the Khronos KTX
+  sources: https://github.com/KhronosGroup/KTX
+
 Mac OS X:
 
   Libraries are included in the extlibs folder. You may also use Homebrew to
@@ -52,8 +55,144 @@ Windows:
 
   Libraries for Visual Studio are included in the extlibs folder.
 
+Optional image decoders:
+
+  JPEG, PNG and WebP images may be decoded with libjpeg-turbo, libspng and
+  libwebp instead of the bundled stb_image, which is always kept for other
+  formats. Enable them with --with-turbojpeg, --with-spng and --with-webp
+  (WebP requires libwebp, since stb_image can't read it).
+
+Benchmarks:
+
+  bench_textures loads synthetic and given images through the texture manager
+  and prints timings as JSON. It never shows its window, so on machines without
+  a GPU it may run with Mesa through the offscreen driver of SDL (EGL):
+
+    bench_textures -offscreen -o results.json [image1 ... imageN]
+
 ]]--
 
+-- Options
+newoption {
+  trigger = "with-turbojpeg",
+  description = "Decode JPEG images with libjpeg-turbo"
+}
+
+newoption {
+  trigger = "with-spng",
+  description = "Decode PNG images with libspng"
+}
+
+newoption {
+  trigger = "with-webp",
+  description = "Decode WebP images with libwebp"
+}
+
+-- Includes and links of the engine, shared by every project built from its
+-- sources
+function configure_engine()
+  -- Libraries required for Unix-based systems
+  libs_unix = { "freetype", "GLEW", "GL", "GLU", "ktx", "ogg", "openal",
+		  "vorbis", "vorbisfile", "theoradec", "SDL2", "m", "stdc++" }
+  
+  -- Optional image decoders, stb_image handles everything else
+  libs_decoders = {}
+  if _OPTIONS["with-turbojpeg"] then
+    defines { "DAGON_TURBOJPEG" }
+    table.insert(libs_decoders, "turbojpeg")
+  end
+  if _OPTIONS["with-spng"] then
+    defines { "DAGON_SPNG" }
+    table.insert(libs_decoders, "spng")
+  end
+  if _OPTIONS["with-webp"] then
+    defines { "DAGON_WEBP" }
+    table.insert(libs_decoders, "webp")
+  end
+  for i = 1, #libs_decoders do
+    table.insert(libs_unix, libs_decoders[i])
+  end
+
+  -- Search for libraries on Linux systems
+  if os.get() == "linux" then
+    -- Attempt to look for Lua library with most commonly used names
+    local lua_lib_names = { "lua-5.1", "lua5.1", "lua" }
+    local lua_lib = { name = nil, dir = nil }
+    for i = 1, #lua_lib_names do
+      lua_lib.name = lua_lib_names[i]
+      lua_lib.dir = os.findlib(lua_lib.name)
+      if(lua_lib.dir ~= nil) then
+        break
+      end
+    end
+    table.insert(libs_unix, lua_lib.name)
+
+    -- Confirm that all the required libraries are present
+    for i = 1, #libs_unix do
+      local lib = libs_unix[i]
+      if os.findlib(lib) == nil then
+        print ("WARNING: Library " .. lib .. " not found")
+      end
+    end
+  end
+
+  -- Final configuration, includes and links according to the host system
+  configuration "linux"
+    includedirs { "/usr/include", "/usr/include/lua5.1",
+                  "/usr/include/freetype2", "/usr/local/include",
+                  "/usr/local/include/lua5.1",
+                  "/usr/local/include/freetype2" }
+    libdirs { "/usr/lib", "/usr/local/lib" }
+    links { libs_unix, "dl" }
+    linkoptions { "-pthread" }
+
+  configuration "bsd"
+    includedirs { "/usr/include",
+                  "/usr/local/include/freetype2",
+                  "/usr/local/include" }
+    libdirs { "/usr/lib", "/usr/local/lib" }
+    buildoptions { "`pkg-config --cflags lua-5.1`" }
+    linkoptions { "`pkg-config --libs lua-5.1`" }
+    links { libs_unix }
+    linkoptions { "-pthread" }
+
+  configuration "macosx"
+    includedirs { "/usr/include", "/usr/include/lua5.1", 
+                  "/usr/include/freetype2", "/usr/local/include",
+                  "/usr/local/include/lua5.1",
+                  "/usr/local/include/freetype2",
+                  "extlibs/headers",
+                  "extlibs/headers/libfreetype/osx",
+                  "extlibs/headers/libfreetype/osx/freetype2",
+                  "extlibs/headers/libsdl2/osx" }
+    libdirs { "/usr/lib", "/usr/local/lib", 
+              "extlibs/libs-osx/Frameworks", "extlibs/libs-osx/lib" }
+    links { "freetype", "GLEW", "lua", "ogg", "SDL2", 
+            "vorbis", "vorbisfile", "theoradec", "ktx" }
+    links { libs_decoders }
+    links { "AudioToolbox.framework", "AudioUnit.framework",
+            "Carbon.framework", "Cocoa.framework", "CoreAudio.framework",
+            "CoreFoundation.framework", "ForceFeedback.framework", 
+            "IOKit.framework", "OpenAL.framework", "OpenGL.framework" }
+            
+  configuration "windows"
+    includedirs { "extlibs/headers",
+                  "extlibs/headers/libfreetype/windows",
+                  "extlibs/headers/libfreetype/windows/freetype",
+                  "extlibs/headers/libsdl2/windows" }
+    links { "freetype", "glew32s", "libogg_static", 
+            "libtheora_static", "libvorbis_static", 
+            "libvorbisfile_static", "lua", "OpenAL32",
+            "SDL2", "SDL2main", "opengl32", "glu32",
+            "Imm32", "version", "winmm", "libktx" }
+    links { libs_decoders }
+    if os.is64bit then
+      libdirs { "extlibs/libs-msvc/x64" }
+    else
+      libdirs { "extlibs/libs-msvc/x86" }
+    end
+end
+
 -- Base solution
 solution "Dagon"
   configurations { "debug", "release" }
@@ -80,7 +219,8 @@ solution "Dagon"
     targetname "dagon"
     -- GLEW_STATIC only applies to Windows, but there's no harm done if defined
     -- on other systems.
-    defines { "GLEW_STATIC", "OV_EXCLUDE_STATIC_CALLBACKS", "KTX_OPENGL" }
+    defines { "GLEW_STATIC", "OV_EXCLUDE_STATIC_CALLBACKS", "KTX_OPENGL",
+              "STBI_SIMD" }
     location "build"
     objdir "build/objs"
     buildoptions { "-Wall" }
@@ -92,83 +232,60 @@ solution "Dagon"
     language "C++"
     files { "src/**.h", "src/**.c", "src/**.cpp" }
     
-    -- Libraries required for Unix-based systems
-    libs_unix = { "freetype", "GLEW", "GL", "GLU", "ogg", "openal", "vorbis",
-		  "vorbisfile", "theoradec", "SDL2", "m", "stdc++" }
-  
-    -- Search for libraries on Linux systems
-    if os.get() == "linux" then
-      -- Attempt to look for Lua library with most commonly used names
-      local lua_lib_names = { "lua-5.1", "lua5.1", "lua" }
-      local lua_lib = { name = nil, dir = nil }
-      for i = 1, #lua_lib_names do
-        lua_lib.name = lua_lib_names[i]
-        lua_lib.dir = os.findlib(lua_lib.name)
-        if(lua_lib.dir ~= nil) then
-          break
-        end
-      end
-      table.insert(libs_unix, lua_lib.name)
-
-      -- Confirm that all the required libraries are present
-      for i = 1, #libs_unix do
-        local lib = libs_unix[i]
-        if os.findlib(lib) == nil then
-          print ("WARNING: Library " .. lib .. " not found")
-        end
-      end
-    end
+    configure_engine()
+
+  -- Offline tool that packs cube faces into version 2 TEX bundles
+  project "TexPack"
+    targetname "dagon-texpack"
+    defines { "GLEW_STATIC" }
+    location "build"
+    objdir "build/objs/texpack"
+    buildoptions { "-Wall" }
+    kind "ConsoleApp"
+    language "C++"
+    files { "tools/texpack.cpp", "src/Compression.h", "src/Compression.cpp",
+            "src/stb_image.h", "src/stb_image.c" }
+    includedirs { "src" }
+
+    configuration "linux or bsd"
+      includedirs { "/usr/include", "/usr/local/include" }
+      links { "m" }
+
+    configuration "macosx or windows"
+      includedirs { "extlibs/headers" }
+
+  -- Benchmark of image decoding with and without the SIMD kernels
+  project "BenchDecode"
+    targetname "bench_decode"
+    defines { "STBI_SIMD" }
+    location "build"
+    objdir "build/objs/benchdecode"
+    buildoptions { "-Wall" }
+    kind "ConsoleApp"
+    language "C++"
+    files { "tools/benchdecode.cpp", "src/DecodeKernels.h", "src/DecodeKernels.cpp",
+            "src/stb_image.h", "src/stb_image.c" }
+    includedirs { "src" }
+
+    configuration "linux or bsd"
+      links { "m" }
+
+  -- Benchmark of the texture loading paths, using a hidden window so that it
+  -- also runs on machines without a GPU (see tools/benchtextures.cpp)
+  project "BenchTextures"
+    targetname "bench_textures"
+    defines { "GLEW_STATIC", "OV_EXCLUDE_STATIC_CALLBACKS", "KTX_OPENGL",
+              "STBI_SIMD" }
+    location "build"
+    objdir "build/objs/benchtextures"
+    buildoptions { "-Wall" }
+    kind "ConsoleApp"
+    language "C++"
+    files { "tools/benchtextures.cpp", "src/**.h", "src/**.c", "src/**.cpp" }
+    excludes { "src/main.cpp" }
+    includedirs { "src" }
+
+    configure_engine()
 
-    -- Final configuration, includes and links according to the host system
-    configuration "linux"
-      includedirs { "/usr/include", "/usr/include/lua5.1",
-                    "/usr/include/freetype2", "/usr/local/include",
-                    "/usr/local/include/lua5.1",
-                    "/usr/local/include/freetype2" }
-      libdirs { "/usr/lib", "/usr/local/lib" }
-      links { libs_unix, "dl" }
-      linkoptions { "-pthread" }
-
-    configuration "bsd"
-      includedirs { "/usr/include",
-                    "/usr/local/include/freetype2",
-                    "/usr/local/include" }
-      libdirs { "/usr/lib", "/usr/local/lib" }
-      buildoptions { "`pkg-config --cflags lua-5.1`" }
-      linkoptions { "`pkg-config --libs lua-5.1`" }
-      links { libs_unix }
-      linkoptions { "-pthread" }
-  
-    configuration "macosx"
-      includedirs { "/usr/include", "/usr/include/lua5.1", 
-                    "/usr/include/freetype2", "/usr/local/include",
-                    "/usr/local/include/lua5.1",
-                    "/usr/local/include/freetype2",
-                    "extlibs/headers",
-                    "extlibs/headers/libfreetype/osx",
-                    "extlibs/headers/libfreetype/osx/freetype2",
-                    "extlibs/headers/libsdl2/osx" }
-      libdirs { "/usr/lib", "/usr/local/lib", 
-                "extlibs/libs-osx/Frameworks", "extlibs/libs-osx/lib" }
-      links { "freetype", "GLEW", "lua", "ogg", "SDL2", 
-              "vorbis", "vorbisfile", "theoradec", "ktx" }
-      links { "AudioToolbox.framework", "AudioUnit.framework",
-              "Carbon.framework", "Cocoa.framework", "CoreAudio.framework",
-              "CoreFoundation.framework", "ForceFeedback.framework", 
-              "IOKit.framework", "OpenAL.framework", "OpenGL.framework" }
-              
     configuration "windows"
-      includedirs { "extlibs/headers",
-                    "extlibs/headers/libfreetype/windows",
-                    "extlibs/headers/libfreetype/windows/freetype",
-                    "extlibs/headers/libsdl2/windows" }
-      links { "freetype", "glew32s", "libogg_static", 
-              "libtheora_static", "libvorbis_static", 
-              "libvorbisfile_static", "lua", "OpenAL32",
-              "SDL2", "SDL2main", "opengl32", "glu32",
-              "Imm32", "version", "winmm", "libktx" }
-      if os.is64bit then
-        libdirs { "extlibs/libs-msvc/x64" }
-      else
-        libdirs { "extlibs/libs-msvc/x86" }
-      end
+      links { "psapi" }
@@ -0,0 +1,208 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "Atlas.h"
+#include "ImageDecoder.h"
+#include "MappedFile.h"
+#include "Texture.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Implementation - Constructor
+////////////////////////////////////////////////////////////
+
+Atlas::Atlas() {
+  _rowHeight = 0;
+  _x = 0;
+  _y = 0;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+Atlas::~Atlas() {
+  this->unload();
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Gets
+////////////////////////////////////////////////////////////
+
+int Atlas::numOfPages() {
+  return static_cast<int>(_arrayOfPages.size());
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - State changes
+////////////////////////////////////////////////////////////
+
+bool Atlas::insert(const std::string& fileName, AtlasRegion* region) {
+  std::map<std::string, AtlasEntry>::iterator it = _mapOfRegions.find(fileName);
+  if (it != _mapOfRegions.end()) {
+    it->second.retainCount++;
+    *region = it->second.region;
+    return true;
+  }
+  
+  // Check the size before decoding anything
+  MappedFile file;
+  int width, height;
+  if (!file.open(fileName) || !ImageInfo(file.data(), file.size(), &width, &height) ||
+      width > kAtlasMaxSize || height > kAtlasMaxSize)
+    return false;
+  
+  DecodedImage image;
+  if (!DecodeImage(file.data(), file.size(), kImageRGBA, &image))
+    return false;
+  
+  GLubyte* bitmap = image.data;
+  
+  // Edges are repeated once around the bitmap, so that filtering never
+  // reads from its neighbours
+  int paddedWidth = width + 2;
+  int paddedHeight = height + 2;
+  if (!_allocate(paddedWidth, paddedHeight)) {
+    free(bitmap);
+    return false;
+  }
+  
+  std::vector<GLubyte> padded(paddedWidth * paddedHeight * 4);
+  for (int y = 0; y < paddedHeight; y++) {
+    int sourceY = std::min(std::max(y - 1, 0), height - 1);
+    for (int x = 0; x < paddedWidth; x++) {
+      int sourceX = std::min(std::max(x - 1, 0), width - 1);
+      memcpy(&padded[(y * paddedWidth + x) * 4],
+             &bitmap[(sourceY * width + sourceX) * 4], 4);
+    }
+  }
+  free(bitmap);
+  
+  Texture* page = _arrayOfPages.back();
+  page->bind();
+  glTexSubImage2D(GL_TEXTURE_2D, 0, _x, _y, paddedWidth, paddedHeight,
+                  GL_RGBA, GL_UNSIGNED_BYTE, &padded[0]);
+  
+  float minU = static_cast<float>(_x + 1) / kAtlasPageSize;
+  float minV = static_cast<float>(_y + 1) / kAtlasPageSize;
+  float maxU = static_cast<float>(_x + 1 + width) / kAtlasPageSize;
+  float maxV = static_cast<float>(_y + 1 + height) / kAtlasPageSize;
+  
+  AtlasRegion newRegion;
+  newRegion.texture = page;
+  newRegion.arrayOfTexCoords[0] = minU;
+  newRegion.arrayOfTexCoords[1] = minV;
+  newRegion.arrayOfTexCoords[2] = maxU;
+  newRegion.arrayOfTexCoords[3] = minV;
+  newRegion.arrayOfTexCoords[4] = maxU;
+  newRegion.arrayOfTexCoords[5] = maxV;
+  newRegion.arrayOfTexCoords[6] = minU;
+  newRegion.arrayOfTexCoords[7] = maxV;
+  newRegion.width = width;
+  newRegion.height = height;
+  
+  _x += paddedWidth;
+  _arrayOfPageUsage.back()++;
+  
+  AtlasEntry entry;
+  entry.region = newRegion;
+  entry.retainCount = 1;
+  _mapOfRegions[fileName] = entry;
+  *region = newRegion;
+  
+  return true;
+}
+
+void Atlas::release(const std::string& fileName) {
+  std::map<std::string, AtlasEntry>::iterator it = _mapOfRegions.find(fileName);
+  if (it == _mapOfRegions.end() || --it->second.retainCount > 0)
+    return;
+  
+  Texture* page = it->second.region.texture;
+  _mapOfRegions.erase(it);
+  
+  size_t index = std::find(_arrayOfPages.begin(), _arrayOfPages.end(), page) -
+                 _arrayOfPages.begin();
+  if (index == _arrayOfPages.size() || --_arrayOfPageUsage[index] > 0)
+    return;
+  
+  // The page being filled is simply started over, others are deleted
+  if (index + 1 == _arrayOfPages.size()) {
+    _rowHeight = 0;
+    _x = 0;
+    _y = 0;
+  } else {
+    delete page;
+    _arrayOfPages.erase(_arrayOfPages.begin() + index);
+    _arrayOfPageUsage.erase(_arrayOfPageUsage.begin() + index);
+  }
+}
+
+void Atlas::unload() {
+  std::vector<Texture*>::iterator it = _arrayOfPages.begin();
+  while (it != _arrayOfPages.end()) {
+    delete *it;
+    ++it;
+  }
+  
+  _arrayOfPages.clear();
+  _arrayOfPageUsage.clear();
+  _mapOfRegions.clear();
+  _rowHeight = 0;
+  _x = 0;
+  _y = 0;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+// Moves the cursor to where the bitmap fits, opening a new row or page
+// if needed. Space left in previous pages isn't reused until they're
+// emptied.
+bool Atlas::_allocate(int width, int height) {
+  if (width > kAtlasPageSize || height > kAtlasPageSize)
+    return false;
+  
+  if (!_arrayOfPages.empty() && _x + width > kAtlasPageSize) {
+    _x = 0;
+    _y += _rowHeight;
+    _rowHeight = 0;
+  }
+  
+  if (_arrayOfPages.empty() || _y + height > kAtlasPageSize) {
+    // Blank RGBA page
+    Texture* page = new Texture(kAtlasPageSize, kAtlasPageSize, 32);
+    _arrayOfPages.push_back(page);
+    _arrayOfPageUsage.push_back(0);
+    _x = 0;
+    _y = 0;
+    _rowHeight = 0;
+  }
+  
+  if (height > _rowHeight)
+    _rowHeight = height;
+  
+  return true;
+}
+  
+}
@@ -0,0 +1,93 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_ATLAS_H_
+#define DAGON_ATLAS_H_
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Platform.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Size of each page of the atlas, and of the largest bitmap packed in it
+#define kAtlasPageSize 1024
+#define kAtlasMaxSize 256
+
+class Texture;
+
+typedef struct {
+  Texture* texture;
+  float arrayOfTexCoords[8]; // Same order as the vertices of slides
+  int width;
+  int height;
+} AtlasRegion;
+
+////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////
+
+// Small interface bitmaps (images, buttons and cursors) packed in rows
+// into a few shared textures, so that overlays are drawn with few binds.
+// A file is only packed once no matter how many times it's requested,
+// and kept until released as many times. Pages are reclaimed once all
+// their bitmaps are released.
+
+class Atlas {
+ public:
+  Atlas();
+  ~Atlas();
+  
+  // Gets
+  int numOfPages();
+  
+  // State changes
+  
+  // Returns false if the file is too large or can't be decoded here, in
+  // which case it should be loaded as a texture of its own
+  bool insert(const std::string& fileName, AtlasRegion* region);
+  void release(const std::string& fileName);
+  void unload();
+  
+ private:
+  typedef struct {
+    AtlasRegion region;
+    int retainCount;
+  } AtlasEntry;
+  
+  std::map<std::string, AtlasEntry> _mapOfRegions;
+  std::vector<Texture*> _arrayOfPages;
+  std::vector<int> _arrayOfPageUsage; // Bitmaps held in each page
+  int _rowHeight;
+  int _x;
+  int _y;
+  
+  bool _allocate(int width, int height);
+  
+  Atlas(const Atlas&);
+  void operator=(const Atlas&);
+};
+  
+}
+
+#endif // DAGON_ATLAS_H_
@@ -15,17 +15,27 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
-#include <fstream>
 #include <cassert>
+#include <cmath>
 #include <cstring>
 #include <sstream>
 
+#include <SDL2/SDL_timer.h>
+
 #include "Audio.h"
+#include "AudioManager.h"
 #include "Language.h"
 #include "Log.h"
 
 namespace dagon {
 
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+static SDL_atomic_t NumOfAllocations;
+static SDL_atomic_t NumOfRefills;
+
 ////////////////////////////////////////////////////////////
 // Implementation - Constructor
 ////////////////////////////////////////////////////////////
@@ -34,12 +44,35 @@ Audio::Audio() :
 config(Config::instance()),
 log(Log::instance())
 {
+  _alPitch = 1.0f;
+  _alPosition[0] = 0.0f;
+  _alPosition[1] = 0.0f;
+  _alPosition[2] = 0.0f;
+  _alSample = 0;
+  _alSource = 0;
+  _buffer = NULL;
+  _bufferSize = 0;
+  _channels = 0;
+  _decodedTime = 0.0;
+  _duration = 0.0;
   _doesAutoplay = true;
   _isLoaded = false;
   _isLoopable = false;
   _isMatched = false;
+  _isSample = false;
   _isVarying = false;
+  _numOfIdleBuffers = 0;
+  _numOfQueuedBuffers = 0;
+  _playedTime = 0.0;
+  _queuedEndTime = 0.0;
+  _priority = kAudioPriorityNormal;
+  SDL_AtomicSet(&_requestedState, kAudioNoRequest);
+  _rate = 0;
   _state = kAudioInitial;
+  _virtualCursor = 0.0;
+  _virtualSince = 0;
+  SDL_AtomicSet(&_decodedSize, 0);
+  SDL_AtomicSet(&_streamStatus, kAudioStreamOK);
   _oggCallbacks.read_func = _oggRead;
   _oggCallbacks.seek_func = _oggSeek;
   _oggCallbacks.close_func = _oggClose;
@@ -55,7 +88,9 @@ log(Log::instance())
 ////////////////////////////////////////////////////////////
 
 Audio::~Audio() {
-  // TODO: Unload if required
+  // The manager must forget us before our voice, stream and buffers go
+  AudioManager::instance().unregisterAudio(this);
+  this->unload();
   SDL_DestroyMutex(_mutex);
 }
 
@@ -83,30 +118,90 @@ bool Audio::isLoopable() {
 }
 
 bool Audio::isPlaying() {
-  bool value = false;
-  if (SDL_LockMutex(_mutex) == 0) {
-    value = (_state == kAudioPlaying);
-    SDL_UnlockMutex(_mutex);
-  } else {
-    log.error(kModAudio, "%s", kString18002);
-  }
-  return value;
+  return (this->state() == kAudioPlaying);
 }
   
 bool Audio::isVarying() {
   return _isVarying;
 }
 
+bool Audio::isVirtual() {
+  return (_alSource == 0);
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Gets
 ////////////////////////////////////////////////////////////
 
+float Audio::audibility() {
+  if (config.mute || this->fadeLevel() < 0.0f)
+    return 0.0f;
+  
+  // Same attenuation as the default distance model of OpenAL, where
+  // sources closer than the reference distance of one are heard in full.
+  // Audios that aren't placed sit with the listener.
+  float distance = sqrtf(_alPosition[0] * _alPosition[0] +
+                         _alPosition[1] * _alPosition[1] +
+                         _alPosition[2] * _alPosition[2]);
+  float attenuation = (distance > 1.0f) ? 1.0f / distance : 1.0f;
+  return this->fadeLevel() * attenuation;
+}
+
 double Audio::cursor() {
-  return ov_time_tell(&_oggStream);
+  double time = 0.0;
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (!_alSource) {
+      time = _virtualTime();
+    } else {
+      // The offset counts samples from the first buffer still queued
+      ALint offset = 0;
+      alGetSourcei(_alSource, AL_SAMPLE_OFFSET, &offset);
+      double played = (_rate > 0) ? static_cast<double>(offset) / _rate : 0.0;
+      if (_isSample)
+        time = played;
+      else if (_numOfQueuedBuffers > 0) {
+        // A source that ran dry has played everything, and its offset is
+        // back to zero until the audio thread unqueues the buffers
+        ALint alState = AL_INITIAL, processed = 0;
+        alGetSourcei(_alSource, AL_SOURCE_STATE, &alState);
+        alGetSourcei(_alSource, AL_BUFFERS_PROCESSED, &processed);
+        if (alState == AL_STOPPED && processed >= _numOfQueuedBuffers)
+          time = _queuedEndTime;
+        else
+          time = _queuedTimes[0] + played;
+      }
+      else time = _playedTime;
+      
+      // Buffers may run past the end of loops
+      if (_duration > 0.0 && time >= _duration)
+        time = _isLoopable ? fmod(time, _duration) : _duration;
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  return time;
+}
+
+double Audio::duration() {
+  return _duration;
+}
+
+int Audio::numOfAllocations() {
+  return SDL_AtomicGet(&NumOfAllocations);
+}
+
+int Audio::numOfRefills() {
+  return SDL_AtomicGet(&NumOfRefills);
+}
+
+int Audio::priority() {
+  return _priority;
 }
 
 int Audio::state() {
-  return _state;
+  int state = SDL_AtomicGet(&_requestedState);
+  return (state != kAudioNoRequest) ? state : _state;
 }
 
 ////////////////////////////////////////////////////////////
@@ -122,47 +217,18 @@ void Audio::setLoopable(bool loopable) {
 }
 
 void Audio::setPosition(unsigned int face, Point origin) {
-  if (SDL_LockMutex(_mutex) == 0) {  
-    if (_isLoaded) {
-      float x = origin.x / kDefTexSize;
-      float y = origin.y / kDefTexSize;
-  
-      switch (face) {
-        case kNorth: {
-          alSource3f(_alSource, AL_POSITION, x, y, -1.0f);
-          break;
-        }
-        case kEast: {
-          alSource3f(_alSource, AL_POSITION, 1.0f, y, x);
-          break;
-        }
-        case kSouth: {
-          alSource3f(_alSource, AL_POSITION, -x, y, 1.0f);
-          break;
-        }
-        case kWest: {
-          alSource3f(_alSource, AL_POSITION, -1.0f, y, -x);
-          break;
-        }
-        case kUp: {
-          alSource3f(_alSource, AL_POSITION, 0.0f, 1.0f, 0.0f);
-          break;
-        }
-        case kDown: {
-          alSource3f(_alSource, AL_POSITION, 0.0f, -1.0f, 0.0f);
-          break;
-        }
-        default: {
-          assert(false);
-        }
-      }
-  
-      _verifyError("position");
-	}
-    SDL_UnlockMutex(_mutex);
-  } else {
-    log.error(kModAudio, "%s", kString18002);
-  }
+  AudioCommand command;
+  command.type = kAudioCommandPosition;
+  command.state = kAudioNoRequest;
+  command.target = this;
+  command.face = face;
+  command.origin = origin;
+  command.next = NULL;
+  AudioManager::instance().post(command);
+}
+
+void Audio::setPriority(int priority) {
+  _priority = priority;
 }
 
 void Audio::setResource(std::string fileName) {
@@ -177,27 +243,102 @@ void Audio::setVarying(bool varying) {
 // Implementation - State changes
 ////////////////////////////////////////////////////////////
 
+void Audio::apply(const AudioCommand& command) {
+  switch (command.type) {
+    case kAudioCommandPause: {
+      _pause();
+      break;
+    }
+    case kAudioCommandPlay: {
+      _play();
+      break;
+    }
+    case kAudioCommandPosition: {
+      _setPosition(command.face, command.origin);
+      break;
+    }
+    case kAudioCommandStop: {
+      _stop();
+      break;
+    }
+    default: {
+      assert(false);
+    }
+  }
+  
+  // Unless something else was posted since, state() is accurate again
+  SDL_AtomicCAS(&_requestedState, command.state, kAudioNoRequest);
+}
+
+// Asynchronous method
+void Audio::decode() {
+  if (SDL_AtomicGet(&_decodedSize) > 0 || SDL_AtomicGet(&_streamStatus) != kAudioStreamOK)
+    return;
+  
+  double time = ov_time_tell(&_oggStream);
+  int size = 0;
+  int status = kAudioStreamOK;
+  bool hasRewound = false;
+  while (size < _bufferSize) {
+    int section;
+    long result = ov_read(&_oggStream, _buffer + size, _bufferSize - size,
+                          0, 2, 1, &section);
+    if (result > 0) {
+      size += static_cast<int>(result);
+      hasRewound = false;
+    } else if (result == 0) {
+      // EOF. Loops carry on into the same buffer, unless the stream is empty.
+      if (_isLoopable && !hasRewound) {
+        ov_raw_seek(&_oggStream, 0);
+        hasRewound = true;
+      } else {
+        status = kAudioStreamEOF;
+        break;
+      }
+    } else if (result == OV_HOLE) {
+      // May return OV_HOLE after we rewind the stream, so we just re-loop.
+      continue;
+    } else {
+      // Error, we won't attempt to stream anymore until rewound
+      log.error(kModAudio, "%s: %s", kString16007, _resource.name.c_str());
+      status = kAudioStreamError;
+      break;
+    }
+  }
+  
+  // What was decoded won't be read again until the audio loops
+  _resource.file.release(0, _resource.dataRead);
+  
+  // The size goes first, so that whoever sees the end of the stream also
+  // sees the last buffer
+  _decodedTime = time;
+  SDL_AtomicSet(&_decodedSize, size);
+  SDL_AtomicSet(&_streamStatus, status);
+}
+
 void Audio::load() {
   if (SDL_LockMutex(_mutex) == 0) {
     if (!_isLoaded) {
       std::string fileToLoad = _randomizeFile(_resource.name);
-      std::ifstream file(config.path(kPathResources,
-                                     fileToLoad, kObjectAudio).c_str(),
-                         std::ifstream::binary | std::ifstream::ate);
-      if (file.good()) {
-        _resource.dataSize = file.tellg();
-        _resource.data = new char[_resource.dataSize];
-        file.seekg(file.beg);
-        file.read(_resource.data, _resource.dataSize);
+      std::string path = config.path(kPathResources, fileToLoad, kObjectAudio);
+      ALuint sample = AudioManager::instance().acquireSample(path);
+      if (!sample) {
+        if (!_resource.file.open(path)) {
+          log.error(kModAudio, "%s: %s", kString16008, fileToLoad.c_str());
+          SDL_UnlockMutex(_mutex);
+          return;
+        }
+        
+        _resource.dataSize = _resource.file.size();
         _resource.dataRead = 0;
         
         if (ov_open_callbacks(this, &_oggStream, NULL, 0, _oggCallbacks) < 0) {
           log.error(kModAudio, "%s", kString16010);
+          _resource.file.close();
+          SDL_UnlockMutex(_mutex);
+          return;
         }
         
-        // We no longer require the file handle
-        file.close();
-        
         // Get file info
         vorbis_info* info = ov_info(&_oggStream, -1);
         _channels = info->channels;
@@ -213,31 +354,42 @@ void Audio::load() {
           log.error(kModAudio, "%s: %s", kString16009, fileToLoad.c_str());
         }
         
-        alGenBuffers(config.numOfAudioBuffers, _alBuffers);
-        alGenSources(1, &_alSource);
-        alSource3f(_alSource, AL_POSITION, 0.0f, 0.0f, 0.0f);
-        alSource3f(_alSource, AL_VELOCITY, 0.0f, 0.0f, 0.0f);
-        alSource3f(_alSource, AL_DIRECTION, 0.0f, 0.0f, 0.0f);
-        
-		int buffersRead = 0;
-        for (buffersRead = 0; buffersRead < config.numOfAudioBuffers; buffersRead++) {
-          if (_fillBuffer(&_alBuffers[buffersRead]) == kAudioStreamEOF) {
-            break;
-          }
-        }
-        alSourceQueueBuffers(_alSource, buffersRead, _alBuffers);
-        _verifyError("prebuffer");
-        if (config.mute || this->fadeLevel() < 0.0) {
-          alSourcef(_alSource, AL_GAIN, 0.0f);
-        } else {
-          alSourcef(_alSource, AL_GAIN, this->fadeLevel());
-        }
-        
-        _isLoaded = true;
-        _verifyError("load");
+        // Short clips are decoded once and then played from memory, as long
+        // as the cache has room for them
+        ogg_int64_t numOfSamples = ov_pcm_total(&_oggStream, -1);
+        std::size_t size = static_cast<std::size_t>(numOfSamples) * _channels * 2;
+        if (numOfSamples > 0 && size <= static_cast<std::size_t>(config.audioSampleSize) &&
+            AudioManager::instance().makeRoomForSample(size))
+          sample = _decodeSample(path, size);
+      }
+      
+      if (sample) {
+        ALint size = 0, channels = 0, bits = 0, frequency = 0;
+        alGetBufferi(sample, AL_SIZE, &size);
+        alGetBufferi(sample, AL_CHANNELS, &channels);
+        alGetBufferi(sample, AL_BITS, &bits);
+        alGetBufferi(sample, AL_FREQUENCY, &frequency);
+        _duration = (channels && bits && frequency) ?
+                    static_cast<double>(size) / (channels * (bits / 8) * frequency) : 0.0;
+        _alSample = sample;
+        _isSample = true;
+        _rate = frequency;
       } else {
-        log.error(kModAudio, "%s: %s", kString16008, fileToLoad.c_str());
+        _duration = ov_time_total(&_oggStream, -1);
+        
+        // Prevent audio cuts if file size too small
+        _bufferSize = config.audioBuffer;
+        if (static_cast<int>(_resource.dataSize) < _bufferSize)
+          _bufferSize = static_cast<int>(_resource.dataSize);
+        _buffer = new char[_bufferSize];
+        SDL_AtomicAdd(&NumOfAllocations, 1);
       }
+      
+      // We're virtual until the manager gives us a voice
+      _virtualCursor = 0.0;
+      _virtualSince = SDL_GetTicks();
+      _isLoaded = true;
+      _verifyError("load");
     }
     SDL_UnlockMutex(_mutex);
   } else {
@@ -251,65 +403,38 @@ void Audio::match(Audio* audioToMatch) {
 }
 
 void Audio::play() {
-  if (SDL_LockMutex(_mutex) == 0) {
-    if (_isLoaded && (_state != kAudioPlaying)) {
-      if (_isMatched)
-        ov_time_seek(&_oggStream, _matchedAudio->cursor());
-      
-      if (_isVarying) {
-        float p = ((rand() % 20) + 90) / 100.0f;
-        alSourcef(_alSource, AL_PITCH, p);
-      }
-      alSourcePlay(_alSource);
-      _state = kAudioPlaying;
-      _verifyError("play");
-    }
-    SDL_UnlockMutex(_mutex);
-  } else {
-    log.error(kModAudio, "%s", kString18002);
-  }
+  _post(kAudioCommandPlay, _isLoaded ? kAudioPlaying : kAudioNoRequest);
 }
 
 void Audio::pause() {
-  if (SDL_LockMutex(_mutex) == 0) {
-    if (_state == kAudioPlaying) {
-      alSourceStop(_alSource);
-      _state = kAudioPaused;
-      _verifyError("pause");
-    }
-    SDL_UnlockMutex(_mutex);
-  } else {
-    log.error(kModAudio, "%s", kString18002);
-  }
+  _post(kAudioCommandPause, (this->state() == kAudioPlaying) ? kAudioPaused : kAudioNoRequest);
 }
 
 void Audio::stop() {
-  if (SDL_LockMutex(_mutex) == 0) {
-    if ((_state == kAudioPlaying) || (_state == kAudioPaused)) {
-      alSourceStop(_alSource);
-      ov_raw_seek(&_oggStream, 0);
-      _state = kAudioStopped;
-      _verifyError("stop");
-    }
-    SDL_UnlockMutex(_mutex);
-  } else {
-    log.error(kModAudio, "%s", kString18002);
-  }
+  int state = this->state();
+  _post(kAudioCommandStop, (state == kAudioPlaying || state == kAudioPaused) ?
+        kAudioStopped : kAudioNoRequest);
 }
 
 void Audio::unload() {
   if (SDL_LockMutex(_mutex) == 0) {
     if (_isLoaded) {
-      if (_state == kAudioPlaying) {
-        alSourceStop(_alSource);
-        ov_raw_seek(&_oggStream, 0);
+      _releaseVoice();
+      if (_state == kAudioPlaying)
         _state = kAudioStopped;
+      
+      // Cached clips belong to the manager
+      if (_isSample) {
+        AudioManager::instance().releaseSample(_alSample);
+        _alSample = 0;
+        _isSample = false;
+      } else {
+        AudioManager::instance().cancelDecode(this);
+        ov_clear(&_oggStream);
+        _resource.file.close();
+        delete[] _buffer;
+        _buffer = NULL;
       }
-      _emptyBuffers();
-      alDeleteSources(1, &_alSource);
-      alDeleteBuffers(config.numOfAudioBuffers, _alBuffers);
-      ov_clear(&_oggStream);
-      delete[] _resource.data;
       _isLoaded = false;
       _verifyError("unload");
     }
@@ -319,17 +444,39 @@ void Audio::unload() {
   }
 }
 
-void Audio::update() {
+int Audio::update() {
+  int delay = -1;
   if (SDL_LockMutex(_mutex) == 0) {
     if (_state == kAudioPlaying) {
-      int processed;
-      alGetSourcei(_alSource, AL_BUFFERS_PROCESSED, &processed);
-      while (processed--) {
-        ALuint buffer;
+      if (!_alSource) {
+        // Virtual audios only keep time
+        if (!_isLoopable && _duration > 0.0 && _virtualTime() >= _duration) {
+          _virtualCursor = 0.0;
+          _state = kAudioStopped;
+        }
+      } else if (_isSample) {
+        // Cached clips play out on their own, we only notice when they end
+        ALint alState;
+        alGetSourcei(_alSource, AL_SOURCE_STATE, &alState);
+        if (alState == AL_STOPPED)
+          _state = kAudioStopped;
+      } else {
+        _queueBuffers();
         
-        alSourceUnqueueBuffers(_alSource, 1, &buffer);
-        _fillBuffer(&buffer);
-        alSourceQueueBuffers(_alSource, 1, &buffer);
+        // Sources stop by themselves when they run out of buffers, either
+        // because decoders fell behind or because the stream ended
+        ALint alState, queued;
+        alGetSourcei(_alSource, AL_SOURCE_STATE, &alState);
+        alGetSourcei(_alSource, AL_BUFFERS_QUEUED, &queued);
+        if (alState != AL_PLAYING) {
+          if (queued > 0) {
+            alSourcePlay(_alSource);
+          } else if (SDL_AtomicGet(&_streamStatus) != kAudioStreamOK &&
+                     SDL_AtomicGet(&_decodedSize) == 0) {
+            _seek(0.0);
+            _state = kAudioStopped;
+          }
+        }
       }
       
       // Run fade operations
@@ -337,17 +484,94 @@ void Audio::update() {
       
       // FIXME: Not very elegant as we're doing this check every time
       if (config.mute) {
-        alSourcef(_alSource, AL_GAIN, 0.0f);
+        if (_alSource)
+          alSourcef(_alSource, AL_GAIN, 0.0f);
       } else {
         // Finally check the current volume. If it's zero, let the manager know
         // that we're done with this audio.
         if (this->fadeLevel() > 0.0) {
-          alSourcef(_alSource, AL_GAIN, this->fadeLevel());
+          if (_alSource)
+            alSourcef(_alSource, AL_GAIN, this->fadeLevel());
         } else {
-          alSourceStop(_alSource);
+          if (_alSource)
+            alSourcePause(_alSource);
+          else
+            _virtualCursor = _virtualTime();
           _state = kAudioPaused;
         }
       }
+      
+      if (_state == kAudioPlaying) {
+        if (this->isFading()) {
+          delay = kAudioFadeInterval;
+        } else if (_alSource && !_isSample) {
+          // Buffers are all the same size, so the offset into the queue
+          // tells how much is left of the one playing
+          ALint offset = 0;
+          alGetSourcei(_alSource, AL_SAMPLE_OFFSET, &offset);
+          int samplesPerBuffer = _bufferSize / (_channels * 2);
+          if (samplesPerBuffer > 0 && _rate > 0) {
+            int samplesLeft = samplesPerBuffer - (offset % samplesPerBuffer);
+            delay = static_cast<int>((static_cast<long>(samplesLeft) * 1000) / _rate);
+          }
+          else delay = kAudioFadeInterval;
+        }
+      }
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  return delay;
+}
+
+bool Audio::realize() {
+  bool isReal = false;
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_isLoaded && !_alSource) {
+      AudioManager& audioManager = AudioManager::instance();
+      _alSource = audioManager.acquireSource();
+      if (_alSource) {
+        double time = _virtualTime();
+        alSourcefv(_alSource, AL_POSITION, _alPosition);
+        alSourcef(_alSource, AL_PITCH, _alPitch);
+        alSourcef(_alSource, AL_GAIN, config.mute ? 0.0f : this->fadeLevel());
+        
+        if (_isSample) {
+          alSourcei(_alSource, AL_BUFFER, _alSample);
+          alSourcei(_alSource, AL_LOOPING, _isLoopable ? AL_TRUE : AL_FALSE);
+          alSourcef(_alSource, AL_SEC_OFFSET, static_cast<ALfloat>(time));
+        } else {
+          // Buffers are queued as they're decoded, and update() starts
+          // playing once there are any
+          audioManager.acquireBuffers(config.numOfAudioBuffers, _alBuffers);
+          for (int i = 0; i < config.numOfAudioBuffers; i++)
+            _alIdleBuffers[i] = _alBuffers[i];
+          _numOfIdleBuffers = config.numOfAudioBuffers;
+          _seek(time);
+          _queueBuffers();
+          _verifyError("prebuffer");
+        }
+        
+        if (_state == kAudioPlaying)
+          alSourcePlay(_alSource);
+        _verifyError("realize");
+      }
+    }
+    isReal = (_alSource != 0);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  return isReal;
+}
+
+void Audio::virtualize() {
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_alSource) {
+      _virtualCursor = this->cursor();
+      _virtualSince = SDL_GetTicks();
+      _releaseVoice();
     }
     SDL_UnlockMutex(_mutex);
   } else {
@@ -359,68 +583,134 @@ void Audio::update() {
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
-int Audio::_fillBuffer(ALuint* buffer) {
-  // This is a failsafe; if this is true, we won't attempt to stream anymore
-  static bool _hasStreamingError = false;
+// Decodes the whole stream and hands it to the manager, closing the
+// stream if it took it. Otherwise the stream is rewound for streaming.
+ALuint Audio::_decodeSample(const std::string& fileName, std::size_t size) {
+  char* data = static_cast<char*>(malloc(size));
+  if (!data)
+    return 0;
+  SDL_AtomicAdd(&NumOfAllocations, 1);
+  
+  std::size_t decoded = 0;
+  while (decoded < size) {
+    int section;
+    long result = ov_read(&_oggStream, data + decoded, static_cast<int>(size - decoded),
+                          0, 2, 1, &section);
+    if (result > 0)
+      decoded += static_cast<std::size_t>(result);
+    else if (result != OV_HOLE)
+      break;
+  }
+  
+  ALuint sample = 0;
+  if (decoded > 0)
+    sample = AudioManager::instance().cacheSample(fileName, _alFormat, data,
+                                                  static_cast<ALsizei>(decoded), _rate);
+  free(data);
   
-  if (!_hasStreamingError) {
-    // Prevent audio cuts if file size too small
-    int bufferSize = config.audioBuffer;
-    if (static_cast<int>(_resource.dataSize) < bufferSize) {
-      //log.trace(kModAudio, "Buffer size: %d, file size: %d", bufferSize, _resource.dataSize);
-      bufferSize = static_cast<int>(_resource.dataSize);
+  if (sample) {
+    ov_clear(&_oggStream);
+    _resource.file.close();
+  }
+  else ov_raw_seek(&_oggStream, 0);
+  
+  return sample;
+}
+
+void Audio::_pause() {
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_state == kAudioPlaying) {
+      if (_alSource)
+        alSourcePause(_alSource);
+      else
+        _virtualCursor = _virtualTime();
+      _state = kAudioPaused;
+      _verifyError("pause");
     }
-    
-    char* data;
-    data = new char[bufferSize];
-    int size = 0;
-    while (size < bufferSize) {
-      int section;
-      long result = ov_read(&_oggStream, data + size, bufferSize - size,
-                            0, 2, 1, &section);
-      if (result > 0) {
-        size += static_cast<int>(result);
-      } else if (result == 0) {
-        // EOF
-        if (_isLoopable) {
-          ov_raw_seek(&_oggStream, 0);
-        } else {
-          alSourceStop(_alSource);
-          ov_raw_seek(&_oggStream, 0);
-          _state = kAudioStopped;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+void Audio::_play() {
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_isLoaded && (_state != kAudioPlaying)) {
+      if (_isVarying)
+        _alPitch = ((rand() % 20) + 90) / 100.0f;
+      
+      if (_alSource) {
+        if (_isMatched) {
+          double time = _matchedAudio->cursor();
+          if (_isSample) {
+            alSourcef(_alSource, AL_SEC_OFFSET, static_cast<ALfloat>(time));
+          } else {
+            // Whatever was queued is dropped, so we're heard right there
+            alSourceStop(_alSource);
+            _unqueueBuffers();
+            _seek(time);
+            _queueBuffers();
+          }
         }
-        return kAudioStreamEOF;
-      } else if (result == OV_HOLE) {
-        // May return OV_HOLE after we rewind the stream, so we just re-loop.
-        continue;
-      } else if (result < 0) {
-        // Error
-        log.error(kModAudio, "%s: %s", kString16007, _resource.name.c_str());
-        _hasStreamingError = true;
-        return kAudioStreamError;
+        
+        alSourcef(_alSource, AL_PITCH, _alPitch);
+        alSourcePlay(_alSource);
+      } else {
+        if (_isMatched)
+          _virtualCursor = _matchedAudio->cursor();
+        _virtualSince = SDL_GetTicks();
       }
+      _state = kAudioPlaying;
+      _verifyError("play");
     }
-    alBufferData(*buffer, _alFormat, data, size, _rate);
-    delete[] data;
-    return kAudioStreamOK;
+    SDL_UnlockMutex(_mutex);
   } else {
-    return kAudioGenericError;
+    log.error(kModAudio, "%s", kString18002);
   }
 }
 
-void Audio::_emptyBuffers() {
-  ALint alState;
-  alGetSourcei(_alSource, AL_SOURCE_STATE, &alState);
+// Commands run in the order they were posted, while state() already
+// reflects them
+void Audio::_post(int type, int state) {
+  AudioCommand command;
+  command.type = type;
+  command.state = state;
+  command.target = this;
+  command.face = 0;
+  command.next = NULL;
+  if (state != kAudioNoRequest)
+    SDL_AtomicSet(&_requestedState, state);
+  AudioManager::instance().post(command);
+}
+
+// Fills the buffers that were played with whatever was decoded, and asks
+// for more
+void Audio::_queueBuffers() {
+  _unqueueBuffers();
   
-  if (alState != AL_PLAYING) {
-    int queued;
-    alGetSourcei(_alSource, AL_BUFFERS_PROCESSED, &queued);
-    
-    while (queued--) {
-      ALuint buffer;
-      alSourceUnqueueBuffers(_alSource, 1, &buffer);
-      _verifyError("unqueue");
+  while (true) {
+    int size = SDL_AtomicGet(&_decodedSize);
+    if (!size) {
+      if (SDL_AtomicGet(&_streamStatus) != kAudioStreamOK)
+        break;
+      
+      // Without decoder threads this decodes right away
+      AudioManager::instance().queueDecode(this);
+      size = SDL_AtomicGet(&_decodedSize);
     }
+    
+    if (!size || !_numOfIdleBuffers)
+      break;
+    
+    // OpenAL keeps its own copy, so the buffer can be decoded into again
+    _numOfIdleBuffers--;
+    ALuint buffer = _alIdleBuffers[_numOfIdleBuffers];
+    alBufferData(buffer, _alFormat, _buffer, size, _rate);
+    alSourceQueueBuffers(_alSource, 1, &buffer);
+    _queuedTimes[_numOfQueuedBuffers++] = _decodedTime;
+    _queuedEndTime = _decodedTime + static_cast<double>(size) / (_channels * 2) / _rate;
+    SDL_AtomicSet(&_decodedSize, 0);
+    SDL_AtomicAdd(&NumOfRefills, 1);
   }
 }
 
@@ -440,6 +730,131 @@ std::string Audio::_randomizeFile(const std::string &fileName) {
   }
 }
 
+// Hands our voice back to the manager, along with its buffers
+void Audio::_releaseVoice() {
+  if (_alSource) {
+    AudioManager& audioManager = AudioManager::instance();
+    audioManager.releaseSource(_alSource);
+    if (!_isSample)
+      audioManager.releaseBuffers(config.numOfAudioBuffers, _alBuffers);
+    _alSource = 0;
+    _numOfIdleBuffers = 0;
+    _numOfQueuedBuffers = 0;
+  }
+}
+
+// Moves the stream, dropping whatever was decoded ahead
+void Audio::_seek(double time) {
+  AudioManager::instance().cancelDecode(this);
+  if (time > 0.0)
+    ov_time_seek(&_oggStream, time);
+  else
+    ov_raw_seek(&_oggStream, 0);
+  
+  _playedTime = time;
+  SDL_AtomicSet(&_decodedSize, 0);
+  SDL_AtomicSet(&_streamStatus, kAudioStreamOK);
+}
+
+void Audio::_setPosition(unsigned int face, Point origin) {
+  if (SDL_LockMutex(_mutex) == 0) {  
+    if (_isLoaded) {
+      float x = origin.x / kDefTexSize;
+      float y = origin.y / kDefTexSize;
+  
+      switch (face) {
+        case kNorth: {
+          _setPosition(x, y, -1.0f);
+          break;
+        }
+        case kEast: {
+          _setPosition(1.0f, y, x);
+          break;
+        }
+        case kSouth: {
+          _setPosition(-x, y, 1.0f);
+          break;
+        }
+        case kWest: {
+          _setPosition(-1.0f, y, -x);
+          break;
+        }
+        case kUp: {
+          _setPosition(0.0f, 1.0f, 0.0f);
+          break;
+        }
+        case kDown: {
+          _setPosition(0.0f, -1.0f, 0.0f);
+          break;
+        }
+        default: {
+          assert(false);
+        }
+      }
+  
+      _verifyError("position");
+	}
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+void Audio::_setPosition(ALfloat x, ALfloat y, ALfloat z) {
+  _alPosition[0] = x;
+  _alPosition[1] = y;
+  _alPosition[2] = z;
+  if (_alSource)
+    alSourcefv(_alSource, AL_POSITION, _alPosition);
+}
+
+void Audio::_stop() {
+  if (SDL_LockMutex(_mutex) == 0) {
+    if ((_state == kAudioPlaying) || (_state == kAudioPaused)) {
+      if (_alSource)
+        alSourceStop(_alSource);
+      if (!_isSample) {
+        // What was left in the queue would be heard again otherwise
+        if (_alSource)
+          _unqueueBuffers();
+        _seek(0.0);
+        if (_alSource)
+          _queueBuffers();
+      }
+      _virtualCursor = 0.0;
+      _state = kAudioStopped;
+      _verifyError("stop");
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+// Takes back the buffers that were played, keeping track of where they
+// ended
+void Audio::_unqueueBuffers() {
+  int processed = 0;
+  alGetSourcei(_alSource, AL_BUFFERS_PROCESSED, &processed);
+  if (processed > _numOfQueuedBuffers)
+    processed = _numOfQueuedBuffers;
+  if (processed <= 0)
+    return;
+  
+  alSourceUnqueueBuffers(_alSource, processed, &_alIdleBuffers[_numOfIdleBuffers]);
+  
+  ALint size = 0;
+  alGetBufferi(_alIdleBuffers[_numOfIdleBuffers + processed - 1], AL_SIZE, &size);
+  if (_channels > 0 && _rate > 0)
+    _playedTime = _queuedTimes[processed - 1] +
+                  static_cast<double>(size) / (_channels * 2) / _rate;
+  
+  for (int i = processed; i < _numOfQueuedBuffers; i++)
+    _queuedTimes[i - processed] = _queuedTimes[i];
+  _numOfQueuedBuffers -= processed;
+  _numOfIdleBuffers += processed;
+}
+
 ALboolean Audio::_verifyError(const std::string &operation) {
   ALint error = alGetError();
   
@@ -451,6 +866,17 @@ ALboolean Audio::_verifyError(const std::string &operation) {
   return AL_TRUE;
 }
 
+// Where playback would be by now had we been heard all along
+double Audio::_virtualTime() {
+  double time = _virtualCursor;
+  if (_state == kAudioPlaying)
+    time += (SDL_GetTicks() - _virtualSince) / 1000.0;
+  
+  if (_duration > 0.0 && time >= _duration)
+    time = _isLoopable ? fmod(time, _duration) : _duration;
+  return time;
+}
+
 // And now... The Vorbisfile callbacks
 
 std::size_t Audio::_oggRead(void* ptr, std::size_t size, std::size_t nmemb,
@@ -461,7 +887,9 @@ std::size_t Audio::_oggRead(void* ptr, std::size_t size, std::size_t nmemb,
   if ((audio->_resource.dataRead + nSize) > audio->_resource.dataSize)
     nSize = audio->_resource.dataSize - audio->_resource.dataRead;
   
-  std::memcpy(ptr, audio->_resource.data + audio->_resource.dataRead, nSize);
+  // Vorbisfile copies into its own buffers anyway, so we read straight
+  // from the mapping
+  std::memcpy(ptr, audio->_resource.file.data() + audio->_resource.dataRead, nSize);
   audio->_resource.dataRead += nSize;
   return nSize;
 }
@@ -479,7 +907,7 @@ int Audio::_oggSeek(void* datasource, ogg_int64_t offset, int whence) {
       break;
     }
     case SEEK_END: {
-      audio->_resource.dataRead = audio->_resource.dataSize - offset;
+      audio->_resource.dataRead = audio->_resource.dataSize + offset;
       break;
     }
     default: {
@@ -34,9 +34,11 @@
 #include <ogg/ogg.h>
 #include <vorbis/codec.h>
 #include <vorbis/vorbisfile.h>
+#include <SDL2/SDL_atomic.h>
 #include <SDL2/SDL_mutex.h>
 
 #include "Defines.h"
+#include "MappedFile.h"
 #include "Object.h"
 #include "Geometry.h"
 
@@ -46,6 +48,7 @@ namespace dagon {
 // Forward declarations
 ////////////////////////////////////////////////////////////
 
+class Audio;
 class Config;
 class Log;
 
@@ -53,6 +56,14 @@ class Log;
 // Definitions
 ////////////////////////////////////////////////////////////
 
+enum AudioCommands {
+  kAudioCommandPause,
+  kAudioCommandPlay,
+  kAudioCommandPosition,
+  kAudioCommandRequest,
+  kAudioCommandStop
+};
+
 enum AudioBufferState {
   kAudioStreamEOF = -1,
   kAudioStreamError = -2,
@@ -60,6 +71,14 @@ enum AudioBufferState {
   kAudioStreamOK = 1
 };
 
+// Audios with higher priorities keep their voices when there aren't
+// enough for everyone
+enum AudioPriorities {
+  kAudioPriorityLow = -1,
+  kAudioPriorityNormal = 0,
+  kAudioPriorityHigh = 1
+};
+
 enum AudioStates {
   kAudioInitial,
   kAudioPlaying,
@@ -67,14 +86,33 @@ enum AudioStates {
   kAudioStopped
 };
 
+#define kAudioNoRequest -1
+
+// Fades advance one step per update, so they're updated at the pace
+// they were tuned for
+#define kAudioFadeInterval 1
+
+// Files stay mapped while loaded, so that only the pages being decoded
+// take memory
 struct Resource {
   int index;
   std::string name;
-  char* data;
+  MappedFile file;
   std::size_t dataRead;
   std::size_t dataSize;
 };
 
+// Posted by other threads and run by the audio thread, so that they never
+// wait for it
+struct AudioCommand {
+  int type;
+  int state; // Requested by the command, if any
+  Audio* target;
+  unsigned int face;
+  Point origin;
+  AudioCommand* next;
+};
+
 ////////////////////////////////////////////////////////////
 // Interface
 ////////////////////////////////////////////////////////////
@@ -90,26 +128,59 @@ class Audio : public Object {
   bool isLoopable();
   bool isPlaying();
   bool isVarying();
+  bool isVirtual(); // Keeps time without a voice, so nothing is heard
   
   // Gets
-  double cursor(); // For match function
-  int state();
+  float audibility(); // How loud it is heard, after fades and distance
+  
+  // Where playback is, in seconds, down to the sample being heard rather
+  // than what was decoded ahead. Used to match audios and sync videos.
+  double cursor();
+  
+  double duration(); // In seconds, zero if unknown
+  int priority();
+  int state(); // Includes changes posted but not run yet
+  
+  // Decode buffers are allocated once per load, so that refills done by
+  // the audio thread never allocate. These counters tell if they do.
+  static int numOfAllocations();
+  static int numOfRefills();
   
   // Sets
   void setAutoplay(bool autoplay);
   void setLoopable(bool loopable);
   void setPosition(unsigned int face, Point origin);
+  void setPriority(int priority);
   void setResource(std::string fileName);
   void setVarying(bool varying);
   
   // State changes
+  
+  // Runs a command posted by play(), pause(), stop() or setPosition().
+  // Audio thread only, unless the manager isn't running.
+  void apply(const AudioCommand& command);
+  
+  // Decodes the next buffer of the stream ahead of time. Called by the
+  // decoder threads of the manager, which never run it while anyone else
+  // uses the stream.
+  void decode();
+  
   void load();
   void match(Audio* audioToMatch);
   void play();
   void pause();
   void stop();
   void unload();
-  void update();
+  
+  // Voices are handed out by the manager from its pool. realize() picks
+  // up where a virtual audio would be by now, and fails if the pool is
+  // empty.
+  bool realize();
+  void virtualize();
+  
+  // Refills the buffers that were played and returns the milliseconds
+  // until the next one is played, or -1 if nothing is playing
+  int update();
   
  private:
   Config& config;
@@ -125,23 +196,62 @@ class Audio : public Object {
   bool _isLoaded;
   bool _isLoopable;
   bool _isMatched;
+  bool _isSample; // Plays a clip cached by the manager instead of streaming
   bool _isVarying;
+  int _priority;
+  SDL_atomic_t _requestedState;
   int _state;
   
+  // Virtual audios keep time from the moment they lost their voice
+  double _duration;
+  double _virtualCursor;
+  Uint32 _virtualSince;
+  
   ALuint _alBuffers[kMaxAudioBuffers];
 	ALenum _alFormat;
-  ALuint _alSource;
+  
+  // Played buffers wait among the idle ones until there's something
+  // decoded to fill them with. Decoders publish the size of what they
+  // decoded, and the stream status, only once they're done with it.
+  ALuint _alIdleBuffers[kMaxAudioBuffers];
+  int _numOfIdleBuffers;
+  char* _buffer;
+  int _bufferSize;
+  double _decodedTime;
+  SDL_atomic_t _decodedSize;
+  SDL_atomic_t _streamStatus;
+  ALfloat _alPitch;
+  ALfloat _alPosition[3];
+  ALuint _alSample;
+  ALuint _alSource; // Zero while virtual
   int _channels;
   ALsizei _rate;
   
+  // Stream times of the buffers queued to the source, oldest first,
+  // where the last one queued ends and where the last one played ended
+  double _queuedTimes[kMaxAudioBuffers];
+  double _queuedEndTime;
+  int _numOfQueuedBuffers;
+  double _playedTime;
+  
   ov_callbacks _oggCallbacks;
   OggVorbis_File _oggStream;
   
   // Private methods
-  int _fillBuffer(ALuint* buffer);
-  void _emptyBuffers();
+  ALuint _decodeSample(const std::string& fileName, std::size_t size);
+  void _pause();
+  void _play();
+  void _post(int type, int state);
+  void _queueBuffers();
+  void _unqueueBuffers();
   std::string _randomizeFile(const std::string &fileName);
+  void _releaseVoice();
+  void _seek(double time);
+  void _setPosition(unsigned int face, Point origin);
+  void _setPosition(ALfloat x, ALfloat y, ALfloat z);
+  void _stop();
   ALboolean _verifyError(const std::string &operation);
+  double _virtualTime();
   
   // Callbacks for Vorbisfile library
   static std::size_t _oggRead(void* ptr, std::size_t size,
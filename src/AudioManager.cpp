@@ -15,6 +15,8 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <algorithm>
+
 #include <SDL2/SDL_timer.h>
 
 #include "AudioManager.h"
@@ -23,6 +25,17 @@
 
 namespace dagon {
 
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Orders audios by how much they deserve a voice
+static bool CompareVoices(Audio* first, Audio* second) {
+  if (first->priority() != second->priority())
+    return first->priority() > second->priority();
+  return first->audibility() > second->audibility();
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Constructor
 ////////////////////////////////////////////////////////////
@@ -31,10 +44,21 @@ AudioManager::AudioManager()  :
 config(Config::instance()),
 log(Log::instance())
 {
+  _commands = NULL;
+  _delay = kAudioIdleDelay;
   _isInitialized = false;
   _isRunning = false;
+  _isSignaled = false;
+  _samplesSize = 0;
+  _sampleSerial = 0;
+  _thread = NULL;
+  _condition = SDL_CreateCond();
+  _conditionMutex = SDL_CreateMutex();
+  _decodeCondition = SDL_CreateCond();
+  _decodeMutex = SDL_CreateMutex();
   _mutex = SDL_CreateMutex();
-  if (!_mutex)
+  _poolMutex = SDL_CreateMutex();
+  if (!_mutex || !_conditionMutex || !_decodeMutex || !_poolMutex)
     log.error(kModAudio, "%s", kString18001);
 }
 
@@ -43,13 +67,102 @@ log(Log::instance())
 ////////////////////////////////////////////////////////////
 
 AudioManager::~AudioManager() {
+  SDL_DestroyCond(_condition);
+  SDL_DestroyMutex(_conditionMutex);
+  SDL_DestroyCond(_decodeCondition);
+  SDL_DestroyMutex(_decodeMutex);
   SDL_DestroyMutex(_mutex);
+  SDL_DestroyMutex(_poolMutex);
 }
 
 ////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////
 
+void AudioManager::acquireBuffers(int count, ALuint* buffers) {
+  if (SDL_LockMutex(_poolMutex) == 0) {
+    for (int i = 0; i < count; i++) {
+      if (_arrayOfFreeBuffers.empty()) {
+        alGenBuffers(1, &buffers[i]);
+        _arrayOfBuffers.push_back(buffers[i]);
+      } else {
+        buffers[i] = _arrayOfFreeBuffers.back();
+        _arrayOfFreeBuffers.pop_back();
+      }
+    }
+    SDL_UnlockMutex(_poolMutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+ALuint AudioManager::acquireSample(const std::string& fileName) {
+  std::map<std::string, AudioSample>::iterator it = _mapOfSamples.find(fileName);
+  if (it == _mapOfSamples.end())
+    return 0;
+  
+  it->second.retainCount++;
+  it->second.lastUsed = ++_sampleSerial;
+  return it->second.buffer;
+}
+
+ALuint AudioManager::acquireSource() {
+  ALuint source = 0;
+  if (SDL_LockMutex(_poolMutex) == 0) {
+    if (!_arrayOfFreeSources.empty()) {
+      source = _arrayOfFreeSources.back();
+      _arrayOfFreeSources.pop_back();
+    }
+    SDL_UnlockMutex(_poolMutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  return source;
+}
+
+void AudioManager::cancelDecode(Audio* target) {
+  if (_arrayOfDecoders.empty())
+    return;
+  
+  if (SDL_LockMutex(_decodeMutex) == 0) {
+    std::deque<Audio*>::iterator it = std::find(_arrayOfPendingDecodes.begin(),
+                                                _arrayOfPendingDecodes.end(), target);
+    if (it != _arrayOfPendingDecodes.end())
+      _arrayOfPendingDecodes.erase(it);
+    
+    // Wait until any decoder thread is done with it
+    while (std::find(_arrayOfDecodingAudios.begin(), _arrayOfDecodingAudios.end(),
+                     target) != _arrayOfDecodingAudios.end())
+      SDL_CondWait(_decodeCondition, _decodeMutex);
+    SDL_UnlockMutex(_decodeMutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+ALuint AudioManager::cacheSample(const std::string& fileName, ALenum format,
+                                 const char* data, ALsizei size, ALsizei rate) {
+  if (!this->makeRoomForSample(static_cast<size_t>(size)))
+    return 0;
+  
+  ALuint buffer;
+  alGenBuffers(1, &buffer);
+  alBufferData(buffer, format, data, size, rate);
+  if (alGetError() != AL_NO_ERROR) {
+    alDeleteBuffers(1, &buffer);
+    return 0;
+  }
+  
+  AudioSample sample;
+  sample.buffer = buffer;
+  sample.size = static_cast<size_t>(size);
+  sample.retainCount = 1;
+  sample.lastUsed = ++_sampleSerial;
+  _mapOfSamples[fileName] = sample;
+  _samplesSize += sample.size;
+  return buffer;
+}
+
 void AudioManager::clear() {
   if (_isInitialized) {
     if (!_arrayOfActiveAudios.empty()) {
@@ -114,6 +227,9 @@ void AudioManager::flush() {
           log.error(kModAudio, "%s", kString18002);
         }
       }
+      
+      // Audios may have started fading out
+      this->wake();
     }
   }
 }
@@ -210,6 +326,20 @@ void AudioManager::init() {
   log.info(kModAudio, "%s: %s", kString16002, alGetString(AL_VERSION));
   log.info(kModAudio, "%s: %s", kString16003, vorbis_version_string());
   
+  // Devices may support fewer voices, so we take as many as we can
+  for (int i = 0; i < kMaxNumberOfAudios; i++) {
+    ALuint source;
+    alGenSources(1, &source);
+    if (alGetError() != AL_NO_ERROR)
+      break;
+    
+    alSource3f(source, AL_VELOCITY, 0.0f, 0.0f, 0.0f);
+    alSource3f(source, AL_DIRECTION, 0.0f, 0.0f, 0.0f);
+    _arrayOfSources.push_back(source);
+  }
+  _arrayOfFreeSources = _arrayOfSources;
+  log.info(kModAudio, "%s: %d", kString16011, static_cast<int>(_arrayOfSources.size()));
+  
   _isInitialized = true;
   _isRunning = true;
   
@@ -217,34 +347,100 @@ void AudioManager::init() {
   if (!_thread) {
     log.error(kModAudio, "%s:%s", kString18003, SDL_GetError());
   }
+  
+  // Streams are decoded by a pool of decoder threads. If none are
+  // configured the audio thread decodes them itself.
+  for (int i = 0; i < config.numOfAudioDecoders; i++) {
+    SDL_Thread* thread = SDL_CreateThread(_runDecoder, "AudioDecoder", (void*)NULL);
+    if (thread) {
+      _arrayOfDecoders.push_back(thread);
+    } else {
+      log.error(kModAudio, "%s:%s", kString18003, SDL_GetError());
+    }
+  }
+}
+
+void AudioManager::post(const AudioCommand& command) {
+  if (!_isRunning) {
+    AudioCommand copy = command;
+    _apply(&copy);
+    return;
+  }
+  
+  AudioCommand* newCommand = new AudioCommand(command);
+  void* top;
+  do {
+    top = SDL_AtomicGetPtr(&_commands);
+    newCommand->next = static_cast<AudioCommand*>(top);
+  } while (!SDL_AtomicCASPtr(&_commands, top, newCommand));
+  
+  this->wake();
+}
+
+void AudioManager::queueDecode(Audio* target) {
+  if (_arrayOfDecoders.empty()) {
+    target->decode();
+    return;
+  }
+  
+  if (SDL_LockMutex(_decodeMutex) == 0) {
+    // Audios being decoded right now are queued again once done, if needed
+    if (std::find(_arrayOfPendingDecodes.begin(), _arrayOfPendingDecodes.end(),
+                  target) == _arrayOfPendingDecodes.end() &&
+        std::find(_arrayOfDecodingAudios.begin(), _arrayOfDecodingAudios.end(),
+                  target) == _arrayOfDecodingAudios.end()) {
+      _arrayOfPendingDecodes.push_back(target);
+      SDL_CondBroadcast(_decodeCondition);
+    }
+    SDL_UnlockMutex(_decodeMutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
 }
 
 void AudioManager::registerAudio(Audio* target) {
   _arrayOfAudios.push_back(target);
 }
 
-void AudioManager::requestAudio(Audio* target) {
-  if (_arrayOfActiveAudios.size() >= kMaxNumberOfAudios) 
-	  return;
+void AudioManager::releaseBuffers(int count, const ALuint* buffers) {
+  if (SDL_LockMutex(_poolMutex) == 0) {
+    _arrayOfFreeBuffers.insert(_arrayOfFreeBuffers.end(), buffers, buffers + count);
+    SDL_UnlockMutex(_poolMutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+void AudioManager::releaseSource(ALuint source) {
+  // Leave the voice as if it was new, detaching its buffers
+  alSourceStop(source);
+  alSourcei(source, AL_BUFFER, 0);
+  alSourcei(source, AL_LOOPING, AL_FALSE);
+  alSourcef(source, AL_PITCH, 1.0f);
   
+  if (SDL_LockMutex(_poolMutex) == 0) {
+    _arrayOfFreeSources.push_back(source);
+    SDL_UnlockMutex(_poolMutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+// Audios past the number of voices are still accepted and play virtually
+void AudioManager::requestAudio(Audio* target) {
   if (!target->isLoaded()) {
     target->load();
   }
   target->retain();
-
-  bool isActive = false;
-  isActive = std::find(_arrayOfActiveAudios.begin(), _arrayOfActiveAudios.end(),
-                       target) != _arrayOfActiveAudios.end();
-  // If the audio is not active, then it's added to
-  // that vector
-  if (!isActive) {
-    if (SDL_LockMutex(_mutex) == 0) {
-      _arrayOfActiveAudios.push_back(target);
-      SDL_UnlockMutex(_mutex);
-    } else {
-      log.error(kModAudio, "%s", kString18002);
-    }
-  }
+  
+  // The audio thread adds it to the active audios, unless it's already there
+  AudioCommand command;
+  command.type = kAudioCommandRequest;
+  command.state = kAudioNoRequest;
+  command.target = target;
+  command.face = 0;
+  command.next = NULL;
+  this->post(command);
   
   // FIXME: Not very elegant. Must implement a state condition for
   // each audio object. Perhaps use AL_STATE even.
@@ -253,6 +449,49 @@ void AudioManager::requestAudio(Audio* target) {
   }
 }
 
+bool AudioManager::makeRoomForSample(size_t size) {
+  if (!_isInitialized)
+    return false;
+  
+  // Unloads the least recently used clips that nobody holds until the new
+  // one fits, like the texture cache does
+  size_t limit = kAudioSampleCacheLimit;
+  while (_samplesSize + size > limit) {
+    std::map<std::string, AudioSample>::iterator victim = _mapOfSamples.end();
+    std::map<std::string, AudioSample>::iterator it = _mapOfSamples.begin();
+    
+    while (it != _mapOfSamples.end()) {
+      if (!it->second.retainCount &&
+          (victim == _mapOfSamples.end() ||
+           it->second.lastUsed < victim->second.lastUsed))
+        victim = it;
+      ++it;
+    }
+    
+    // Everything left is playing or about to
+    if (victim == _mapOfSamples.end())
+      return false;
+    
+    alDeleteBuffers(1, &victim->second.buffer);
+    _samplesSize -= victim->second.size;
+    _mapOfSamples.erase(victim);
+  }
+  
+  return true;
+}
+
+void AudioManager::releaseSample(ALuint buffer) {
+  std::map<std::string, AudioSample>::iterator it = _mapOfSamples.begin();
+  while (it != _mapOfSamples.end()) {
+    if (it->second.buffer == buffer) {
+      if (it->second.retainCount > 0)
+        it->second.retainCount--;
+      return;
+    }
+    ++it;
+  }
+}
+
 void AudioManager::setOrientation(float* orientation) {
   if (_isInitialized) {
     alListenerfv(AL_ORIENTATION, orientation);
@@ -266,10 +505,34 @@ void AudioManager::terminate() {
   // Each audio object should unregister itself if
   // destroyed
   _isRunning = false;
+  this->wake();
   
   int threadReturnValue;
   SDL_WaitThread(_thread, &threadReturnValue);
   
+  if (SDL_LockMutex(_decodeMutex) == 0) {
+    SDL_CondBroadcast(_decodeCondition);
+    SDL_UnlockMutex(_decodeMutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  
+  std::vector<SDL_Thread*>::iterator thread = _arrayOfDecoders.begin();
+  while (thread != _arrayOfDecoders.end()) {
+    SDL_WaitThread(*thread, &threadReturnValue);
+    ++thread;
+  }
+  _arrayOfDecoders.clear();
+  _arrayOfPendingDecodes.clear();
+  
+  // Commands posted since the last update are no longer needed
+  AudioCommand* command = static_cast<AudioCommand*>(SDL_AtomicSetPtr(&_commands, NULL));
+  while (command) {
+    AudioCommand* next = command->next;
+    delete command;
+    command = next;
+  }
+  
   if (!_arrayOfAudios.empty()) {
     if (SDL_LockMutex(_mutex) == 0) {
       std::vector<Audio*>::iterator it = _arrayOfAudios.begin();
@@ -286,41 +549,231 @@ void AudioManager::terminate() {
   
   // Now we shut down OpenAL completely
   if (_isInitialized) {
+    std::map<std::string, AudioSample>::iterator it = _mapOfSamples.begin();
+    while (it != _mapOfSamples.end()) {
+      alDeleteBuffers(1, &it->second.buffer);
+      ++it;
+    }
+    _mapOfSamples.clear();
+    _samplesSize = 0;
+    
+    // Audios gave back their voices when unloaded
+    if (!_arrayOfSources.empty())
+      alDeleteSources(static_cast<ALsizei>(_arrayOfSources.size()), &_arrayOfSources[0]);
+    if (!_arrayOfBuffers.empty())
+      alDeleteBuffers(static_cast<ALsizei>(_arrayOfBuffers.size()), &_arrayOfBuffers[0]);
+    _arrayOfSources.clear();
+    _arrayOfFreeSources.clear();
+    _arrayOfBuffers.clear();
+    _arrayOfFreeBuffers.clear();
+    
     alcMakeContextCurrent(NULL);
     alcDestroyContext(_alContext);
     alcCloseDevice(_alDevice);
   }
 }
 
+void AudioManager::unregisterAudio(Audio* target) {
+  // Holding the mutex keeps the audio thread from running commands
+  if (SDL_LockMutex(_mutex) == 0) {
+    _cancelCommands(target);
+    _arrayOfActiveAudios.erase(std::remove(_arrayOfActiveAudios.begin(),
+                                           _arrayOfActiveAudios.end(), target),
+                               _arrayOfActiveAudios.end());
+    _arrayOfAudios.erase(std::remove(_arrayOfAudios.begin(), _arrayOfAudios.end(), target),
+                         _arrayOfAudios.end());
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
 // Asynchronous method
 bool AudioManager::update() {
   if (_isRunning) {
-    if (!_arrayOfActiveAudios.empty()) {
-      if (SDL_LockMutex(_mutex) == 0) {
-        std::vector<Audio*>::iterator it = _arrayOfActiveAudios.begin();
-        while (it != _arrayOfActiveAudios.end()) {
-          (*it)->update();
-          ++it;
-        }
-        SDL_UnlockMutex(_mutex);
-      } else {
-        log.error(kModAudio, "%s", kString18002);
+    int delay = kAudioIdleDelay;
+    if (SDL_LockMutex(_mutex) == 0) {
+      _runCommands();
+      
+      std::vector<Audio*>::iterator it = _arrayOfActiveAudios.begin();
+      while (it != _arrayOfActiveAudios.end()) {
+        // Sleep until the first of the audios runs out of buffers
+        int next = (*it)->update();
+        if (next >= 0 && next < delay)
+          delay = next;
+        ++it;
       }
+      _assignVoices();
+      SDL_UnlockMutex(_mutex);
+    } else {
+      log.error(kModAudio, "%s", kString18002);
     }
+    _delay = delay;
     return true;
   }
   return false;
 }
 
+// Asynchronous method
+bool AudioManager::updateDecoder() {
+  Audio* target = NULL;
+  
+  if (SDL_LockMutex(_decodeMutex) == 0) {
+    while (_isRunning && _arrayOfPendingDecodes.empty())
+      SDL_CondWait(_decodeCondition, _decodeMutex);
+    
+    if (_isRunning) {
+      target = _arrayOfPendingDecodes.front();
+      _arrayOfPendingDecodes.pop_front();
+      _arrayOfDecodingAudios.push_back(target);
+    }
+    SDL_UnlockMutex(_decodeMutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+    SDL_Delay(1);
+  }
+  
+  if (target) {
+    target->decode();
+    
+    if (SDL_LockMutex(_decodeMutex) == 0) {
+      _arrayOfDecodingAudios.erase(std::find(_arrayOfDecodingAudios.begin(),
+                                             _arrayOfDecodingAudios.end(), target));
+      SDL_CondBroadcast(_decodeCondition);
+      SDL_UnlockMutex(_decodeMutex);
+    } else {
+      log.error(kModAudio, "%s", kString18002);
+    }
+    
+    // So that it's queued right away
+    this->wake();
+  }
+  
+  return _isRunning;
+}
+
+void AudioManager::wake() {
+  if (SDL_LockMutex(_conditionMutex) == 0) {
+    _isSignaled = true;
+    SDL_CondSignal(_condition);
+    SDL_UnlockMutex(_conditionMutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
+void AudioManager::_apply(AudioCommand* command) {
+  if (command->type == kAudioCommandRequest) {
+    if (std::find(_arrayOfActiveAudios.begin(), _arrayOfActiveAudios.end(),
+                  command->target) == _arrayOfActiveAudios.end())
+      _arrayOfActiveAudios.push_back(command->target);
+  }
+  else command->target->apply(*command);
+}
+
+// Gives voices to the audios that deserve them most, taking them from
+// those that can't be heard or must make room
+void AudioManager::_assignVoices() {
+  std::vector<Audio*> arrayOfAudible;
+  std::vector<Audio*>::iterator it = _arrayOfActiveAudios.begin();
+  while (it != _arrayOfActiveAudios.end()) {
+    if ((*it)->state() == kAudioPlaying && (*it)->audibility() > 0.0f)
+      arrayOfAudible.push_back(*it);
+    ++it;
+  }
+  
+  std::stable_sort(arrayOfAudible.begin(), arrayOfAudible.end(), CompareVoices);
+  if (arrayOfAudible.size() > _arrayOfSources.size())
+    arrayOfAudible.resize(_arrayOfSources.size());
+  
+  // Voices are freed first, so that they can be given out right away
+  it = _arrayOfActiveAudios.begin();
+  while (it != _arrayOfActiveAudios.end()) {
+    if (!(*it)->isVirtual() && (*it)->state() == kAudioPlaying &&
+        std::find(arrayOfAudible.begin(), arrayOfAudible.end(), *it) == arrayOfAudible.end())
+      (*it)->virtualize();
+    ++it;
+  }
+  
+  it = arrayOfAudible.begin();
+  while (it != arrayOfAudible.end()) {
+    if ((*it)->isVirtual() && !(*it)->realize()) {
+      // Paused and stopped audios hold on to their voices until needed
+      std::vector<Audio*>::iterator idle = _arrayOfActiveAudios.begin();
+      while (idle != _arrayOfActiveAudios.end()) {
+        if (!(*idle)->isVirtual() && (*idle)->state() != kAudioPlaying) {
+          (*idle)->virtualize();
+          break;
+        }
+        ++idle;
+      }
+      (*it)->realize();
+    }
+    ++it;
+  }
+}
+
+// Commands are only deleted by the audio thread while holding our mutex,
+// so with it held the stack can be walked safely. Others may push on top
+// meanwhile, but never for an audio that's being deleted.
+void AudioManager::_cancelCommands(Audio* target) {
+  AudioCommand* command = static_cast<AudioCommand*>(SDL_AtomicGetPtr(&_commands));
+  while (command) {
+    if (command->target == target)
+      command->target = NULL;
+    command = command->next;
+  }
+}
+
+// Commands were pushed on top of each other, so they're reversed to run
+// in the order they were posted. Cancelled ones are simply deleted.
+void AudioManager::_runCommands() {
+  AudioCommand* command = static_cast<AudioCommand*>(SDL_AtomicSetPtr(&_commands, NULL));
+  AudioCommand* first = NULL;
+  while (command) {
+    AudioCommand* next = command->next;
+    command->next = first;
+    first = command;
+    command = next;
+  }
+  
+  while (first) {
+    AudioCommand* next = first->next;
+    if (first->target)
+      _apply(first);
+    delete first;
+    first = next;
+  }
+}
+
+int AudioManager::_runDecoder(void *ptr) {
+  while (AudioManager::instance().updateDecoder()) {}
+  return 0;
+}
+
 int AudioManager::_runThread(void *ptr) {
-  while (AudioManager::instance().update()) {
-    SDL_Delay(1);
+  AudioManager& audioManager = AudioManager::instance();
+  while (audioManager.update()) {
+    audioManager._wait();
   }
   return 0;
 }
+
+// Sleeps until the next refill is due or we're woken, whichever comes
+// first. Wakes that came while we were updating aren't lost.
+void AudioManager::_wait() {
+  if (SDL_LockMutex(_conditionMutex) == 0) {
+    if (!_isSignaled && _isRunning)
+      SDL_CondWaitTimeout(_condition, _conditionMutex, static_cast<Uint32>(_delay));
+    _isSignaled = false;
+    SDL_UnlockMutex(_conditionMutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
   
 }
@@ -32,17 +32,37 @@
 #include <SDL2/SDL_mutex.h>
 #include <SDL2/SDL_thread.h>
 
+#include <deque>
+#include <map>
+#include <string>
+
 namespace dagon {
 
 ////////////////////////////////////////////////////////////
 // Definitions
 ////////////////////////////////////////////////////////////
 
+// Most voices we ask OpenAL for. Audios beyond them play virtually.
 #define kMaxNumberOfAudios 32
 
+// Longest the thread sleeps when no refill is due, so that changes we
+// weren't told about are still picked up
+#define kAudioIdleDelay 250
+
+// Total size of decoded clips we keep. Beyond it the least recently used
+// clips that nobody holds are evicted, or new ones are streamed.
+#define kAudioSampleCacheLimit (16 * 1024 * 1024)
+
 class Config;
 class Log;
 
+typedef struct {
+  ALuint buffer;
+  size_t size;
+  int retainCount; // Audios holding the clip
+  unsigned int lastUsed; // Serial of the last time it was taken
+} AudioSample;
+
 ////////////////////////////////////////////////////////////
 // Interface - Singleton class
 ////////////////////////////////////////////////////////////
@@ -53,15 +73,49 @@ class AudioManager {
   
   ALCdevice* _alDevice;
   ALCcontext* _alContext;
+  SDL_cond* _condition;
+  SDL_mutex* _conditionMutex; // Never held while taking another mutex
+  SDL_cond* _decodeCondition;
+  SDL_mutex* _decodeMutex; // Never held while taking another mutex
   SDL_mutex* _mutex;
+  SDL_mutex* _poolMutex; // Never held while taking another mutex
   SDL_Thread* _thread;
   
   std::vector<Audio*> _arrayOfAudios;
   std::vector<Audio*> _arrayOfActiveAudios;
   
+  // Stack of commands posted since the last update, newest first, pushed
+  // without locking. Only the audio thread takes them out, all at once,
+  // while holding our mutex.
+  void* _commands;
+  std::map<std::string, AudioSample> _mapOfSamples;
+  size_t _samplesSize;
+  unsigned int _sampleSerial;
+  
+  // Pool of voices and streaming buffers, which are never deleted until
+  // we terminate
+  std::vector<ALuint> _arrayOfBuffers;
+  std::vector<ALuint> _arrayOfFreeBuffers;
+  std::vector<ALuint> _arrayOfSources;
+  std::vector<ALuint> _arrayOfFreeSources;
+  
+  // Audios waiting for a decoder thread and audios being decoded right
+  // now, so that the audio thread only queues what was decoded
+  std::deque<Audio*> _arrayOfPendingDecodes;
+  std::vector<Audio*> _arrayOfDecodingAudios;
+  std::vector<SDL_Thread*> _arrayOfDecoders;
+  
+  int _delay;
   bool _isInitialized;
   bool _isRunning;
+  bool _isSignaled;
   
+  void _apply(AudioCommand* command);
+  void _assignVoices();
+  void _cancelCommands(Audio* target);
+  void _runCommands();
+  void _wait();
+  static int _runDecoder(void *ptr);
   static int _runThread(void *ptr);
   
   AudioManager();
@@ -75,6 +129,19 @@ public:
     return audioManager;
   }
   
+  // Taken by audios when they're given a voice and returned when they
+  // lose it. Safe to call from any thread.
+  void acquireBuffers(int count, ALuint* buffers);
+  ALuint acquireSource();
+  void releaseBuffers(int count, const ALuint* buffers);
+  void releaseSource(ALuint source);
+  
+  // Streams are decoded by a pool of decoder threads, or right away if
+  // there are none. Cancelling waits until the audio is no longer being
+  // decoded, so that its stream may be used safely.
+  void cancelDecode(Audio* target);
+  void queueDecode(Audio* target);
+  
   // These two methods have similar purposes: clear() notifies the manager
   // that the engine is about to load a new node, which prepares all
   // active audios for release. flush() effectively unloads every audio
@@ -83,11 +150,39 @@ public:
   void flush();
   
   void init();
+  
+  // Commands are run by the audio thread on its next update, so that no
+  // other thread waits for it to be done. Each command is allocated, and
+  // waking the thread briefly takes a mutex that it never holds for long.
+  // Safe to call from any thread.
+  void post(const AudioCommand& command);
+  
   void registerAudio(Audio* target);
+  
+  // Short clips are decoded whole into static buffers, so that replaying
+  // them needs no file or decoder. Clips are taken by acquireSample() or
+  // cacheSample() and given back by releaseSample(), and those nobody
+  // holds are kept until room is needed. makeRoomForSample() evicts them
+  // as needed and tells if a clip of the given size can be cached. Only
+  // called from the main thread, like requestAudio().
+  ALuint acquireSample(const std::string& fileName);
+  ALuint cacheSample(const std::string& fileName, ALenum format,
+                     const char* data, ALsizei size, ALsizei rate);
+  bool makeRoomForSample(size_t size);
+  void releaseSample(ALuint buffer);
+
   void requestAudio(Audio* target);
   void setOrientation(float* orientation);
   void terminate();
+  
+  // Forgets an audio that's being deleted, cancelling its pending commands
+  void unregisterAudio(Audio* target);
+  
   bool update();
+  bool updateDecoder();
+  
+  // Wakes the thread, so that changes to audios are applied right away
+  void wake();
 };
   
 }
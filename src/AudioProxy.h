@@ -54,6 +54,7 @@ public:
         if (strcmp(key, "loop") == 0) a->setLoopable(lua_toboolean(L, -1));
         if (strcmp(key, "volume") == 0) a->setDefaultFadeLevel((float)(lua_tonumber(L, -1) / 100));
         if (strcmp(key, "varying") == 0) a->setVarying(lua_toboolean(L, -1));
+        if (strcmp(key, "priority") == 0) a->setPriority((int)lua_tonumber(L, -1));
         
         lua_pop(L, 1);
       }
@@ -106,6 +107,13 @@ public:
     return 0;
   }
   
+  // Get the playback time in seconds
+  int time(lua_State *L) {
+    lua_pushnumber(L, a->cursor());
+    
+    return 1;
+  }
+  
   // Get the volume
   int volume(lua_State *L) {
     lua_pushnumber(L, a->fadeLevel() * 100);
@@ -133,6 +141,7 @@ Luna<AudioProxy>::RegType AudioProxy::methods[] = {
   method(AudioProxy, pause),
   method(AudioProxy, setVolume),
   method(AudioProxy, stop),
+  method(AudioProxy, time),
   method(AudioProxy, volume),
   {0,0}
 };
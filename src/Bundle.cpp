@@ -0,0 +1,375 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Bundle.h"
+#include "Compression.h"
+#include "Language.h"
+#include "Log.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+const char TEXIdent[] = "KS_TEX"; // We keep this one for backward compatibility
+const char TEXv2Ident[] = "KS_TEX2";
+
+// Version 2 fields are stored little-endian whatever the host, so the
+// header and the table are read one field at a time
+
+static const unsigned char* GetUInt32(const unsigned char* position, uint32_t* value) {
+  *value = 0;
+  for (int i = 0; i < 4; i++)
+    *value |= static_cast<uint32_t>(position[i]) << (i * 8);
+  return position + 4;
+}
+
+static const unsigned char* GetUInt64(const unsigned char* position, uint64_t* value) {
+  *value = 0;
+  for (int i = 0; i < 8; i++)
+    *value |= static_cast<uint64_t>(position[i]) << (i * 8);
+  return position + 8;
+}
+
+static void ReadHeader(const unsigned char* data, TEXv2Header* header) {
+  memset(header, 0, sizeof(TEXv2Header));
+  memcpy(header->ident, data, sizeof(header->ident));
+  
+  const unsigned char* position = data + sizeof(header->ident);
+  position = GetUInt32(position, &header->version);
+  position = GetUInt32(position, &header->width);
+  position = GetUInt32(position, &header->height);
+  position = GetUInt32(position, &header->numFaces);
+  position = GetUInt32(position, &header->numLevels);
+  position = GetUInt32(position, &header->internalFormat);
+  position = GetUInt32(position, &header->format);
+  position = GetUInt32(position, &header->compression);
+  position = GetUInt32(position, &header->flags);
+}
+
+static void ReadLevel(const unsigned char* data, TEXv2Level* entry) {
+  memset(entry, 0, sizeof(TEXv2Level));
+  
+  const unsigned char* position = data;
+  position = GetUInt64(position, &entry->offset);
+  position = GetUInt64(position, &entry->size);
+  position = GetUInt64(position, &entry->rawSize);
+  position = GetUInt32(position, &entry->width);
+  position = GetUInt32(position, &entry->height);
+  position = GetUInt32(position, &entry->checksum);
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Constructor
+////////////////////////////////////////////////////////////
+
+Bundle::Bundle() :
+log(Log::instance())
+{
+  _codec = kTEXCodecNone;
+  _format = GL_RGB;
+  _height = 0;
+  _isCompressed = false;
+  _numOfLevels = 0;
+  _retainCount = 0;
+  _version = 0;
+  _width = 0;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+Bundle::~Bundle() {
+  _file.close();
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Checks
+////////////////////////////////////////////////////////////
+
+bool Bundle::isCompressed() {
+  return _isCompressed;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Gets
+////////////////////////////////////////////////////////////
+
+int Bundle::codec() {
+  return _codec;
+}
+
+const GLubyte* Bundle::data(int face, int level) {
+  return _file.data() + _arrayOfFaces[face].arrayOfLevels[level].offset;
+}
+
+GLint Bundle::depth(int face) {
+  return _arrayOfFaces[face].depth;
+}
+
+GLint Bundle::format() {
+  return _format;
+}
+
+int Bundle::height() {
+  return _height;
+}
+
+GLint Bundle::internalFormat(int face) {
+  return _arrayOfFaces[face].internalFormat;
+}
+
+BundleLevel Bundle::level(int face, int index) {
+  return _arrayOfFaces[face].arrayOfLevels[index];
+}
+
+int Bundle::numOfFaces() {
+  return static_cast<int>(_arrayOfFaces.size());
+}
+
+int Bundle::numOfLevels() {
+  return _numOfLevels;
+}
+
+std::string Bundle::resource() {
+  return _resource;
+}
+
+unsigned int Bundle::retainCount() {
+  return _retainCount;
+}
+
+int Bundle::version() {
+  return _version;
+}
+
+int Bundle::width() {
+  return _width;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - State changes
+////////////////////////////////////////////////////////////
+
+GLubyte* Bundle::decode(int face, int level) {
+  const BundleLevel& source = _arrayOfFaces[face].arrayOfLevels[level];
+  
+  if (_codec != kTEXCodecLZ4) {
+    log.error(kModTexture, "%s: (%s) %d", kString10008, _resource.c_str(), _codec);
+    return NULL;
+  }
+  
+  GLubyte* bitmap = static_cast<GLubyte*>(malloc(source.rawSize));
+  if (bitmap) {
+    if (LZ4Decompress(_file.data() + source.offset, source.size,
+                      bitmap, source.rawSize) != source.rawSize) {
+      log.error(kModTexture, "%s: %s", kString10007, _resource.c_str());
+      free(bitmap);
+      bitmap = NULL;
+    }
+  }
+  
+  return bitmap;
+}
+
+bool Bundle::open(const std::string& fileName) {
+  _resource = fileName;
+  _arrayOfFaces.clear();
+  
+  if (!_file.open(fileName)) {
+    log.error(kModTexture, "%s: %s", kString10006, fileName.c_str());
+    return false;
+  }
+  
+  bool isValid;
+  if (_file.size() >= sizeof(TEXv2Header) &&
+      memcmp(TEXv2Ident, _file.data(), 8) == 0) {
+    isValid = _openVersion2();
+  }
+  else if (_file.size() >= 8 && memcmp(TEXIdent, _file.data(), 7) == 0) {
+    isValid = _openVersion1();
+  }
+  else isValid = false;
+  
+  if (!isValid) {
+    log.error(kModTexture, "%s: %s", kString10007, fileName.c_str());
+    _arrayOfFaces.clear();
+    _file.close();
+  }
+  
+  return isValid;
+}
+
+void Bundle::release() {
+  if (_retainCount > 0)
+    _retainCount--;
+}
+
+void Bundle::retain() {
+  _retainCount++;
+}
+
+void Bundle::touch(int face) {
+  const std::vector<BundleLevel>& arrayOfLevels = _arrayOfFaces[face].arrayOfLevels;
+  for (size_t i = 0; i < arrayOfLevels.size(); i++)
+    _file.touch(arrayOfLevels[i].offset, arrayOfLevels[i].size);
+}
+
+bool Bundle::verify(int face, int level) {
+  const BundleLevel& source = _arrayOfFaces[face].arrayOfLevels[level];
+  if (!source.hasChecksum)
+    return true;
+  
+  if (Checksum(_file.data() + source.offset, source.size) != source.checksum) {
+    log.error(kModTexture, "%s: %s", kString10009, _resource.c_str());
+    return false;
+  }
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+bool Bundle::_openVersion1() {
+  const unsigned char* data = _file.data();
+  size_t size = _file.size();
+  size_t offset = 8; // Skip identifier
+  
+  if (size < offset + sizeof(TEXMainHeader))
+    return false;
+  
+  // Read the main header
+  TEXMainHeader header;
+  memcpy(&header, data + offset, sizeof(header));
+  offset += sizeof(header);
+  
+  _version = 1;
+  _width = static_cast<int>(header.width);
+  _height = static_cast<int>(header.height);
+  _codec = kTEXCodecNone;
+  _format = GL_RGB; // Note that we only support RGB textures
+  _isCompressed = (header.compressionLevel != 0);
+  _numOfLevels = 1;
+  
+  // Index every face that follows
+  while (offset + sizeof(TEXSubHeader) <= size) {
+    TEXSubHeader subheader;
+    memcpy(&subheader, data + offset, sizeof(subheader));
+    offset += sizeof(subheader);
+    
+    if (subheader.size < 0 || offset + subheader.size > size) {
+      log.error(kModTexture, "%s: %s", kString10007, _resource.c_str());
+      break;
+    }
+    
+    BundleLevel level;
+    level.offset = offset;
+    level.size = static_cast<size_t>(subheader.size);
+    level.rawSize = level.size;
+    level.width = static_cast<GLint>(_width);
+    level.height = static_cast<GLint>(_height);
+    level.checksum = 0;
+    level.hasChecksum = false;
+    
+    BundleFace face;
+    face.depth = static_cast<GLint>(subheader.depth);
+    face.internalFormat = static_cast<GLint>(subheader.format);
+    face.arrayOfLevels.push_back(level);
+    _arrayOfFaces.push_back(face);
+    
+    offset += level.size;
+  }
+  
+  return true;
+}
+
+bool Bundle::_openVersion2() {
+  const unsigned char* data = _file.data();
+  size_t size = _file.size();
+  
+  TEXv2Header header;
+  ReadHeader(data, &header);
+  
+  if (header.version != 2 || !header.numFaces || !header.numLevels ||
+      header.numLevels > 32)
+    return false;
+  
+  uint64_t numOfEntries = static_cast<uint64_t>(header.numFaces) * header.numLevels;
+  if (numOfEntries > (size - sizeof(header)) / sizeof(TEXv2Level))
+    return false;
+  
+  _version = 2;
+  _width = static_cast<int>(header.width);
+  _height = static_cast<int>(header.height);
+  _codec = static_cast<int>(header.compression);
+  _format = static_cast<GLint>(header.format);
+  _isCompressed = ((header.flags & kTEXFlagCompressed) != 0);
+  _numOfLevels = static_cast<int>(header.numLevels);
+  
+  // Depth is only meaningful for uncompressed payloads
+  GLint depth = 0;
+  switch (_format) {
+    case GL_LUMINANCE: depth = 1; break;
+    case GL_LUMINANCE_ALPHA: depth = 2; break;
+    case GL_RGB: depth = 3; break;
+    case GL_RGBA: depth = 4; break;
+  }
+  
+  size_t offset = sizeof(header);
+  for (uint32_t i = 0; i < header.numFaces; i++) {
+    BundleFace face;
+    face.depth = depth;
+    face.internalFormat = static_cast<GLint>(header.internalFormat);
+    
+    for (uint32_t j = 0; j < header.numLevels; j++) {
+      TEXv2Level entry;
+      ReadLevel(data + offset, &entry);
+      offset += sizeof(entry);
+      
+      if (entry.offset > size || entry.size > size - entry.offset)
+        return false;
+      
+      // Uncompressed payloads must match and LZ4 can't expand more than this
+      if ((_codec == kTEXCodecNone && entry.rawSize != entry.size) ||
+          entry.rawSize > entry.size * 255 + 16)
+        return false;
+      
+      BundleLevel level;
+      level.offset = static_cast<size_t>(entry.offset);
+      level.size = static_cast<size_t>(entry.size);
+      level.rawSize = static_cast<size_t>(entry.rawSize);
+      level.width = static_cast<GLint>(entry.width);
+      level.height = static_cast<GLint>(entry.height);
+      level.checksum = entry.checksum;
+      level.hasChecksum = true;
+      face.arrayOfLevels.push_back(level);
+    }
+    
+    _arrayOfFaces.push_back(face);
+  }
+  
+  return true;
+}
+  
+}
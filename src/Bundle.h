@@ -0,0 +1,180 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_BUNDLE_H_
+#define DAGON_BUNDLE_H_
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "MappedFile.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Version 1 bundles, kept for backward compatibility
+
+typedef struct {
+  char name[80];
+  short width;
+  short height;
+  short compressionLevel; // 0: None, 1: GL only, 2: GL & zlib
+  short numTextures;
+} TEXMainHeader;
+
+typedef struct {
+  short cubePosition;
+  short depth;
+  int size;
+  int format;
+} TEXSubHeader;
+
+// Version 2 bundles use fixed-size little-endian fields. The header is
+// followed by a table with one entry per level of every face (all the
+// levels of the first face, then the second face, and so on), and
+// payloads may be placed anywhere after it.
+
+enum TEXCodecs {
+  kTEXCodecNone = 0,
+  kTEXCodecZlib, // Reserved
+  kTEXCodecLZ4
+};
+
+enum TEXFlags {
+  kTEXFlagCompressed = 0x01 // Payloads are already compressed for the GPU
+};
+
+typedef struct {
+  char ident[8];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t numFaces;
+  uint32_t numLevels;
+  uint32_t internalFormat;
+  uint32_t format;
+  uint32_t compression;
+  uint32_t flags;
+  uint32_t reserved[5];
+} TEXv2Header;
+
+typedef struct {
+  uint64_t offset;
+  uint64_t size; // Stored bytes
+  uint64_t rawSize; // Bytes once decoded
+  uint32_t width;
+  uint32_t height;
+  uint32_t checksum; // CRC-32 of the stored bytes
+  uint32_t reserved;
+} TEXv2Level;
+
+typedef struct {
+  size_t offset;
+  size_t size;
+  size_t rawSize;
+  GLint width;
+  GLint height;
+  unsigned int checksum;
+  bool hasChecksum;
+} BundleLevel;
+
+typedef struct {
+  GLint depth;
+  GLint internalFormat;
+  std::vector<BundleLevel> arrayOfLevels;
+} BundleFace;
+
+extern const char TEXIdent[];
+extern const char TEXv2Ident[];
+
+class Log;
+
+////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////
+
+// A TEX bundle mapped into memory. Its faces are indexed once when
+// opened, so that textures get pointers to their data without further
+// reads or copies. Bundles are shared through the texture manager.
+// Version 1 bundles are read as having a single level per face.
+
+class Bundle {
+ public:
+  Bundle();
+  ~Bundle();
+  
+  // Checks
+  bool isCompressed();
+  
+  // Gets
+  int codec();
+  const GLubyte* data(int face, int level);
+  GLint depth(int face);
+  GLint format();
+  int height();
+  GLint internalFormat(int face);
+  BundleLevel level(int face, int index);
+  int numOfFaces();
+  int numOfLevels();
+  std::string resource();
+  unsigned int retainCount();
+  int version();
+  int width();
+  
+  // State changes
+  
+  // Returns a copy of the level allocated with malloc(), or NULL if the
+  // codec isn't supported. May be called from any thread.
+  GLubyte* decode(int face, int level);
+  bool open(const std::string& fileName);
+  void release();
+  void retain();
+  void touch(int face);
+  bool verify(int face, int level);
+  
+ private:
+  Log& log;
+  
+  std::vector<BundleFace> _arrayOfFaces;
+  int _codec;
+  MappedFile _file;
+  GLint _format;
+  int _height;
+  bool _isCompressed;
+  int _numOfLevels;
+  std::string _resource;
+  unsigned int _retainCount;
+  int _version;
+  int _width;
+  
+  bool _openVersion1();
+  bool _openVersion2();
+  
+  Bundle(const Bundle&);
+  void operator=(const Bundle&);
+};
+  
+}
+
+#endif // DAGON_BUNDLE_H_
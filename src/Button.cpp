@@ -21,6 +21,7 @@
 #include "Config.h"
 #include "FontManager.h"
 #include "Texture.h"
+#include "TextureManager.h"
 
 namespace dagon {
 
@@ -51,7 +52,7 @@ Button::~Button() {
     delete _action;
   
   if (_hasOnHoverTexture)
-    delete _onHoverTexture;
+    TextureManager::releaseTexture(_onHoverTexture);
 }
 
 ////////////////////////////////////////////////////////////
@@ -116,14 +117,15 @@ void Button::setFont(const std::string &fromFileName,
 }
 
 void Button::setOnHoverTexture(const std::string &fromFileName) {
-  // TODO: Important! We should determine first if the texture already exists,
-  // to avoid repeating resources. Eventually, this would be done via the
-  // resource manager.
-  _onHoverTexture = new Texture;
-  _onHoverTexture->setResource(config.path(kPathResources, fromFileName,
-                                           kObjectImage).c_str());
-  _onHoverTexture->load();
+  Texture* previousTexture = _hasOnHoverTexture ? _onHoverTexture : NULL;
+  
+  // Shared with every button or image showing the same file
+  std::string fileName = config.path(kPathResources, fromFileName, kObjectImage);
+  _onHoverTexture = TextureManager::instance().acquireTexture(fileName, 0, true);
   _hasOnHoverTexture = true;
+  
+  if (previousTexture)
+    TextureManager::releaseTexture(previousTexture);
 }
 
 void Button::setText(std::string theText){
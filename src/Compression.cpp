@@ -0,0 +1,244 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include <vector>
+
+#include "Compression.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+#define kLZ4HashBits 16
+#define kLZ4MaxOffset 65535
+#define kLZ4MinMatch 4
+
+// Matches can't start in the last 12 bytes nor extend into the last 5
+#define kLZ4MatchLimit 12
+#define kLZ4LastLiterals 5
+
+// The table is built before main() runs, so that it's safe to use from
+// several threads
+class ChecksumTable {
+ public:
+  unsigned int values[256];
+  
+  ChecksumTable() {
+    for (unsigned int i = 0; i < 256; i++) {
+      unsigned int value = i;
+      for (int j = 0; j < 8; j++)
+        value = (value & 1) ? (0xEDB88320 ^ (value >> 1)) : (value >> 1);
+      values[i] = value;
+    }
+  }
+};
+
+static ChecksumTable checksumTable;
+
+static unsigned int LZ4Read32(const unsigned char* data) {
+  unsigned int value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static unsigned int LZ4Hash(unsigned int sequence) {
+  return (sequence * 2654435761U) >> (32 - kLZ4HashBits);
+}
+
+// Writes the extra bytes of a length already over 15
+static bool LZ4WriteLength(size_t length, unsigned char** output,
+                           unsigned char* end) {
+  while (length >= 255) {
+    if (*output >= end)
+      return false;
+    *(*output)++ = 255;
+    length -= 255;
+  }
+  
+  if (*output >= end)
+    return false;
+  *(*output)++ = static_cast<unsigned char>(length);
+  return true;
+}
+
+static bool LZ4ReadLength(size_t* length, const unsigned char** input,
+                          const unsigned char* end) {
+  unsigned char value;
+  do {
+    if (*input >= end)
+      return false;
+    value = *(*input)++;
+    *length += value;
+  } while (value == 255);
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////
+
+unsigned int Checksum(const unsigned char* data, size_t size) {
+  unsigned int crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < size; i++)
+    crc = checksumTable.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return crc ^ 0xFFFFFFFF;
+}
+
+size_t LZ4Bound(size_t size) {
+  return size + (size / 255) + 16;
+}
+
+size_t LZ4Compress(const unsigned char* source, size_t sourceSize,
+                   unsigned char* destination, size_t capacity) {
+  std::vector<long> arrayOfPositions(1 << kLZ4HashBits, -1);
+  
+  unsigned char* output = destination;
+  unsigned char* end = destination + capacity;
+  size_t anchor = 0;
+  size_t position = 0;
+  
+  size_t limit = (sourceSize > kLZ4MatchLimit) ? sourceSize - kLZ4MatchLimit : 0;
+  size_t matchLimit = (sourceSize > kLZ4LastLiterals) ? sourceSize - kLZ4LastLiterals : 0;
+  
+  while (position < limit) {
+    unsigned int sequence = LZ4Read32(source + position);
+    unsigned int hash = LZ4Hash(sequence);
+    long candidate = arrayOfPositions[hash];
+    arrayOfPositions[hash] = static_cast<long>(position);
+    
+    if (candidate < 0 || position - candidate > kLZ4MaxOffset ||
+        LZ4Read32(source + candidate) != sequence) {
+      position++;
+      continue;
+    }
+    
+    size_t matchLength = kLZ4MinMatch;
+    while (position + matchLength < matchLimit &&
+           source[candidate + matchLength] == source[position + matchLength])
+      matchLength++;
+    
+    // Emit the sequence: token, literals, offset and match length
+    size_t literals = position - anchor;
+    if (output >= end)
+      return 0;
+    unsigned char* token = output++;
+    
+    if (literals >= 15) {
+      *token = 15 << 4;
+      if (!LZ4WriteLength(literals - 15, &output, end))
+        return 0;
+    }
+    else *token = static_cast<unsigned char>(literals << 4);
+    
+    if (static_cast<size_t>(end - output) < literals + 2)
+      return 0;
+    memcpy(output, source + anchor, literals);
+    output += literals;
+    
+    size_t offset = position - candidate;
+    *output++ = static_cast<unsigned char>(offset & 0xFF);
+    *output++ = static_cast<unsigned char>(offset >> 8);
+    
+    size_t extra = matchLength - kLZ4MinMatch;
+    if (extra >= 15) {
+      *token |= 15;
+      if (!LZ4WriteLength(extra - 15, &output, end))
+        return 0;
+    }
+    else *token |= static_cast<unsigned char>(extra);
+    
+    position += matchLength;
+    anchor = position;
+  }
+  
+  // The last sequence only has literals
+  size_t literals = sourceSize - anchor;
+  if (output >= end)
+    return 0;
+  unsigned char* token = output++;
+  
+  if (literals >= 15) {
+    *token = 15 << 4;
+    if (!LZ4WriteLength(literals - 15, &output, end))
+      return 0;
+  }
+  else *token = static_cast<unsigned char>(literals << 4);
+  
+  if (static_cast<size_t>(end - output) < literals)
+    return 0;
+  memcpy(output, source + anchor, literals);
+  output += literals;
+  
+  return output - destination;
+}
+
+size_t LZ4Decompress(const unsigned char* source, size_t sourceSize,
+                     unsigned char* destination, size_t capacity) {
+  const unsigned char* input = source;
+  const unsigned char* inputEnd = source + sourceSize;
+  unsigned char* output = destination;
+  unsigned char* outputEnd = destination + capacity;
+  
+  while (input < inputEnd) {
+    unsigned char token = *input++;
+    
+    size_t length = token >> 4;
+    if (length == 15 && !LZ4ReadLength(&length, &input, inputEnd))
+      return 0;
+    
+    if (length > static_cast<size_t>(inputEnd - input) ||
+        length > static_cast<size_t>(outputEnd - output))
+      return 0;
+    memcpy(output, input, length);
+    output += length;
+    input += length;
+    
+    // The last sequence ends right after its literals
+    if (input >= inputEnd)
+      break;
+    
+    if (inputEnd - input < 2)
+      return 0;
+    size_t offset = input[0] | (input[1] << 8);
+    input += 2;
+    
+    if (offset == 0 || offset > static_cast<size_t>(output - destination))
+      return 0;
+    
+    length = token & 15;
+    if (length == 15 && !LZ4ReadLength(&length, &input, inputEnd))
+      return 0;
+    length += kLZ4MinMatch;
+    
+    if (length > static_cast<size_t>(outputEnd - output))
+      return 0;
+    
+    // Matches may overlap the output, so we copy byte by byte
+    const unsigned char* match = output - offset;
+    while (length--)
+      *output++ = *match++;
+  }
+  
+  return output - destination;
+}
+  
+}
@@ -0,0 +1,48 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_COMPRESSION_H_
+#define DAGON_COMPRESSION_H_
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////
+
+// Payload helpers shared by the engine and the offline tools. The
+// compressed data follows the LZ4 block format, so it may also be
+// produced with the reference LZ4 library.
+
+// CRC-32 (same polynomial as zlib)
+unsigned int Checksum(const unsigned char* data, size_t size);
+
+// Returns the number of bytes written, or 0 if the destination is too
+// small. Use LZ4Bound() to size the destination.
+size_t LZ4Bound(size_t size);
+size_t LZ4Compress(const unsigned char* source, size_t sourceSize,
+                   unsigned char* destination, size_t capacity);
+
+// Returns the number of bytes decompressed, or 0 if the data is corrupt
+size_t LZ4Decompress(const unsigned char* source, size_t sourceSize,
+                     unsigned char* destination, size_t capacity);
+  
+}
+
+#endif // DAGON_COMPRESSION_H_
@@ -31,6 +31,7 @@ Config::Config() {
   antialiasing = kDefAntialiasing;
   audioBuffer = kDefAudioBuffer;
   audioDevice = kDefAudioDevice;
+  audioSampleSize = kDefAudioSampleSize;
   autopaths = kDefAutopaths;
   autorun = kDefAutorun;
   bundleEnabled = kDefBundleEnabled;
@@ -47,12 +48,22 @@ Config::Config() {
   log = kDefLog;
   mute = kDefMute;
   numOfAudioBuffers = kDefNumOfAudioBuffers;
+  numOfAudioDecoders = kDefNumOfAudioDecoders;
+  numOfPrefetchedNodes = kDefNumOfPrefetchedNodes;
+  numOfTexLoaders = kDefNumOfTexLoaders;
+  pixelBuffers = kDefPixelBuffers;
   showHelpers = kDefShowHelpers;
   showSplash = kDefShowSplash;
   showSpots = kDefShowSpots;
   silentFeeds = kDefSilentFeeds;
   subtitles = kDefSubtitles;
+  texAnisotropy = kDefTexAnisotropy;
+  texCacheSize = kDefTexCacheSize;
   texCompression = kDefTexCompression;
+  texCompressionCache = kDefTexCompressionCache;
+  texMipmaps = kDefTexMipmaps;
+  texProxySize = kDefTexProxySize;
+  texUploadsPerFrame = kDefTexUploadsPerFrame;
   verticalSync = kDefVerticalSync;
   _scriptName = kDefScriptFile;
   _resPath = kDefResourcePath;
@@ -40,6 +40,7 @@ enum DefaultConfiguration {
   kDefAntialiasing = false,
   kDefAudioBuffer = 8192,
   kDefAudioDevice = 0,
+  kDefAudioSampleSize = 262144,
   kDefAutopaths = true,
   kDefAutorun = true,
   kDefBundleEnabled = true,
@@ -56,12 +57,22 @@ enum DefaultConfiguration {
   kDefLog = true,
   kDefMute = false,
   kDefNumOfAudioBuffers = 8,
+  kDefNumOfAudioDecoders = 2,
+  kDefNumOfPrefetchedNodes = 2,
+  kDefNumOfTexLoaders = 2,
+  kDefPixelBuffers = true,
   kDefShowHelpers = false,
   kDefShowSplash = true,
   kDefShowSpots = false,
   kDefSilentFeeds = false,
   kDefSubtitles = true,
+  kDefTexAnisotropy = 4,
+  kDefTexCacheSize = 256,
   kDefTexCompression = false,
+  kDefTexCompressionCache = true,
+  kDefTexMipmaps = true,
+  kDefTexProxySize = 128,
+  kDefTexUploadsPerFrame = 2,
   kDefVerticalSync = true
 };
 
@@ -85,6 +96,7 @@ class Config {
   bool antialiasing;
   int audioBuffer;
   int audioDevice;
+  int audioSampleSize;
   bool autopaths;
   bool autorun;
   bool bundleEnabled;
@@ -101,12 +113,22 @@ class Config {
   bool log;
   bool mute;
   int numOfAudioBuffers;
+  int numOfAudioDecoders;
+  int numOfPrefetchedNodes;
+  int numOfTexLoaders;
+  bool pixelBuffers;
   bool showHelpers;
   bool showSplash;
   bool showSpots;
   bool silentFeeds;
   bool subtitles;
+  int texAnisotropy;
+  int texCacheSize;
   bool texCompression;
+  bool texCompressionCache;
+  bool texMipmaps;
+  int texProxySize;
+  int texUploadsPerFrame;
   bool verticalSync;
   
   double framesPerSecond();
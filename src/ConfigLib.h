@@ -52,6 +52,11 @@ static int ConfigLibGet(lua_State *L) {
     return 1;
   }
   
+  if (strcmp(key, "audioSampleSize") == 0) {
+    lua_pushnumber(L, Config::instance().audioSampleSize);
+    return 1;
+  }
+  
   if (strcmp(key, "autopaths") == 0) {
     lua_pushboolean(L, Config::instance().autopaths);
     return 1;
@@ -127,6 +132,26 @@ static int ConfigLibGet(lua_State *L) {
     return 1;
   }
   
+  if (strcmp(key, "numOfAudioDecoders") == 0) {
+    lua_pushnumber(L, Config::instance().numOfAudioDecoders);
+    return 1;
+  }
+  
+  if (strcmp(key, "numOfPrefetchedNodes") == 0) {
+    lua_pushnumber(L, Config::instance().numOfPrefetchedNodes);
+    return 1;
+  }
+  
+  if (strcmp(key, "numOfTexLoaders") == 0) {
+    lua_pushnumber(L, Config::instance().numOfTexLoaders);
+    return 1;
+  }
+  
+  if (strcmp(key, "pixelBuffers") == 0) {
+    lua_pushboolean(L, Config::instance().pixelBuffers);
+    return 1;
+  }
+  
   if (strcmp(key, "script") == 0) {
     lua_pushstring(L, Config::instance().script().c_str());
     return 1;
@@ -157,16 +182,46 @@ static int ConfigLibGet(lua_State *L) {
     return 1;
   }
   
+  if (strcmp(key, "texAnisotropy") == 0) {
+    lua_pushnumber(L, Config::instance().texAnisotropy);
+    return 1;
+  }
+  
+  if (strcmp(key, "texCacheSize") == 0) {
+    lua_pushnumber(L, Config::instance().texCacheSize);
+    return 1;
+  }
+  
   if (strcmp(key, "texCompression") == 0) {
     lua_pushboolean(L, Config::instance().texCompression);
     return 1;
   }
   
+  if (strcmp(key, "texCompressionCache") == 0) {
+    lua_pushboolean(L, Config::instance().texCompressionCache);
+    return 1;
+  }
+  
   if (strcmp(key, "texExtension") == 0) {
     lua_pushstring(L, Config::instance().texExtension().c_str());
     return 1;
   }
   
+  if (strcmp(key, "texMipmaps") == 0) {
+    lua_pushboolean(L, Config::instance().texMipmaps);
+    return 1;
+  }
+  
+  if (strcmp(key, "texProxySize") == 0) {
+    lua_pushnumber(L, Config::instance().texProxySize);
+    return 1;
+  }
+  
+  if (strcmp(key, "texUploadsPerFrame") == 0) {
+    lua_pushnumber(L, Config::instance().texUploadsPerFrame);
+    return 1;
+  }
+  
   if (strcmp(key, "verticalSync") == 0) {
     lua_pushboolean(L, Config::instance().verticalSync);
     return 1;
@@ -187,6 +242,9 @@ static int ConfigLibSet(lua_State *L) {
   if (strcmp(key, "audioDevice") == 0)
     Config::instance().audioDevice = (int)luaL_checknumber(L, 3);
   
+  if (strcmp(key, "audioSampleSize") == 0)
+    Config::instance().audioSampleSize = (int)luaL_checknumber(L, 3);
+  
   if (strcmp(key, "autopaths") == 0)
     Config::instance().autopaths = (bool)lua_toboolean(L, 3);
   
@@ -241,6 +299,18 @@ static int ConfigLibSet(lua_State *L) {
     Config::instance().numOfAudioBuffers = (int)luaL_checknumber(L, 3);
   }
   
+  if (strcmp(key, "numOfAudioDecoders") == 0)
+    Config::instance().numOfAudioDecoders = (int)luaL_checknumber(L, 3);
+  
+  if (strcmp(key, "numOfPrefetchedNodes") == 0)
+    Config::instance().numOfPrefetchedNodes = (int)luaL_checknumber(L, 3);
+  
+  if (strcmp(key, "numOfTexLoaders") == 0)
+    Config::instance().numOfTexLoaders = (int)luaL_checknumber(L, 3);
+  
+  if (strcmp(key, "pixelBuffers") == 0)
+    Config::instance().pixelBuffers = (bool)lua_toboolean(L, 3);
+  
   if (strcmp(key, "script") == 0)
     Config::instance().setScript(luaL_checkstring(L, 3));
   
@@ -259,12 +329,30 @@ static int ConfigLibSet(lua_State *L) {
   if (strcmp(key, "subtitles") == 0)
     Config::instance().subtitles = (bool)lua_toboolean(L, 3);
   
+  if (strcmp(key, "texAnisotropy") == 0)
+    Config::instance().texAnisotropy = (int)luaL_checknumber(L, 3);
+  
+  if (strcmp(key, "texCacheSize") == 0)
+    Config::instance().texCacheSize = (int)luaL_checknumber(L, 3);
+  
   if (strcmp(key, "texCompression") == 0)
     Config::instance().texCompression = (bool)lua_toboolean(L, 3);
   
+  if (strcmp(key, "texCompressionCache") == 0)
+    Config::instance().texCompressionCache = (bool)lua_toboolean(L, 3);
+  
   if (strcmp(key, "texExtension") == 0)
     Config::instance().setTexExtension(luaL_checkstring(L, 3));
   
+  if (strcmp(key, "texMipmaps") == 0)
+    Config::instance().texMipmaps = (bool)lua_toboolean(L, 3);
+  
+  if (strcmp(key, "texProxySize") == 0)
+    Config::instance().texProxySize = (int)luaL_checknumber(L, 3);
+  
+  if (strcmp(key, "texUploadsPerFrame") == 0)
+    Config::instance().texUploadsPerFrame = (int)luaL_checknumber(L, 3);
+  
   if (strcmp(key, "verticalSync") == 0)
     Config::instance().verticalSync = (bool)lua_toboolean(L, 3);
   
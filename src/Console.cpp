@@ -15,6 +15,7 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include "Audio.h"
 #include "CameraManager.h"
 #include "Config.h"
 #include "Console.h"
@@ -22,6 +23,7 @@
 #include "Log.h"
 #include "FontManager.h"
 #include "RenderManager.h"
+#include "TextureManager.h"
 
 namespace dagon {
 
@@ -35,7 +37,8 @@ config(Config::instance()),
 cursorManager(CursorManager::instance()),
 fontManager(FontManager::instance()),
 log(Log::instance()),
-renderManager(RenderManager::instance())
+renderManager(RenderManager::instance()),
+textureManager(TextureManager::instance())
 {
   _command = "";
   
@@ -140,6 +143,22 @@ void Console::update() {
                      "Viewing angle: %2.0f", cameraManager.fieldOfView());
         _font->print(DGInfoMargin, (DGInfoMargin * 4) + (kDefFontSize * 3),
                      "FPS: %2.0f", config.framesPerSecond());
+        _font->print(DGInfoMargin, (DGInfoMargin * 5) + (kDefFontSize * 4),
+                     "Texture cache: %d MB (hits: %u, misses: %u, evictions: %u)",
+                     static_cast<int>(textureManager.cacheSize() / (1024 * 1024)),
+                     textureManager.cacheHits(), textureManager.cacheMisses(),
+                     textureManager.cacheEvictions());
+        _font->print(DGInfoMargin, (DGInfoMargin * 6) + (kDefFontSize * 5),
+                     "Texture memory: %d MB (nodes: %d, interface: %d, fonts: %d, video: %d, framebuffers: %d)",
+                     static_cast<int>(textureManager.memoryUsed() / (1024 * 1024)),
+                     static_cast<int>(textureManager.memoryUsed(kTextureNode) / (1024 * 1024)),
+                     static_cast<int>(textureManager.memoryUsed(kTextureInterface) / (1024 * 1024)),
+                     static_cast<int>(textureManager.memoryUsed(kTextureFont) / (1024 * 1024)),
+                     static_cast<int>(textureManager.memoryUsed(kTextureVideo) / (1024 * 1024)),
+                     static_cast<int>(textureManager.memoryUsed(kTextureFramebuffer) / (1024 * 1024)));
+        _font->print(DGInfoMargin, (DGInfoMargin * 7) + (kDefFontSize * 6),
+                     "Audio buffers: %d allocations, %d refills",
+                     Audio::numOfAllocations(), Audio::numOfRefills());
         
         break;
       case ConsoleHiding:
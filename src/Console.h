@@ -46,6 +46,7 @@ class Font;
 class FontManager;
 class Log;
 class RenderManager;
+class TextureManager;
 
 ////////////////////////////////////////////////////////////
 // Interface
@@ -58,6 +59,7 @@ class Console {
   FontManager& fontManager;
   Log& log;
   RenderManager& renderManager;
+  TextureManager& textureManager;
   
   Font* _font;
   
@@ -42,6 +42,7 @@
 #include "System.h"
 #include "TextureManager.h"
 #include "TimerManager.h"
+#include "UploadManager.h"
 #include "VideoManager.h"
 
 namespace dagon {
@@ -63,6 +64,7 @@ script(Script::instance()),
 system(Config::instance(), Log::instance()),
 textureManager(TextureManager::instance()),
 timerManager(TimerManager::instance()),
+uploadManager(UploadManager::instance()),
 videoManager(VideoManager::instance())
 {
   
@@ -127,6 +129,9 @@ void Control::init(int argc, char* argv[]) {
   renderManager.init();
   renderManager.resetView(); // Test for errors
   
+  // Pixel buffers for asynchronous texture uploads
+  uploadManager.init();
+  
   cameraManager.init();
   cameraManager.setViewport(config.displayWidth, config.displayHeight);
   
@@ -137,7 +142,7 @@ void Control::init(int argc, char* argv[]) {
   fontManager.init();
   
   // Init the texture manager
-  //textureManager.init(); // Preloader thread not working yet
+  textureManager.init();
   
   // Init the video manager
   videoManager.init();
@@ -653,8 +658,6 @@ void Control::switchTo(Object* theTarget) {
           return;
         }
         
-        textureManager.setRoomToPreload(_currentRoom);
-        
         if (_eventHandlers.hasEnterRoom) {
           //log.trace(kModControl, "Has global enter event");
           script.processCallback(_eventHandlers.enterRoom, 0);
@@ -718,7 +721,6 @@ void Control::switchTo(Object* theTarget) {
             _currentRoom = room;
             _scene->setRoom(room);
             timerManager.setLuaObject(_currentRoom->luaObject());
-            textureManager.setRoomToPreload(_currentRoom);
             
             if (_eventHandlers.hasEnterRoom) {
               //log.trace(kModControl, "Has global room enter event");
@@ -796,8 +798,7 @@ void Control::switchTo(Object* theTarget) {
     if (_currentRoom->hasNodes()) {
       // Now we proceed to load the textures of the current node
       Node* current = _currentRoom->currentNode();
-      //log.trace(kModControl, "Flushing textures...");
-      textureManager.flush();
+      textureManager.setCurrentNode(current);
       
       if (current->hasSpots()) {
         current->beginIteratingSpots();
@@ -844,11 +845,13 @@ void Control::switchTo(Object* theTarget) {
           
           if (spot->hasTexture()) {
             //log.trace(kModControl, "Loading image...");
-            textureManager.requestTexture(spot->texture());
-            
-            // Only resize if nothing but origin
-            if (spot->vertexCount() == 1)
+            // Only resize if nothing but origin, in which case we need the
+            // texture right away. Otherwise it's decoded in the background.
+            if (spot->vertexCount() == 1) {
+              textureManager.requestTexture(spot->texture());
               spot->resize(spot->texture()->width(), spot->texture()->height());
+            }
+            else textureManager.queueTexture(spot->texture());
           }
           
           if (spot->hasFlag(kSpotAuto) || spot->isPlaying())
@@ -859,6 +862,9 @@ void Control::switchTo(Object* theTarget) {
         log.warning(kModControl, "%s", kString12006);
       }
       
+      //log.trace(kModControl, "Flushing textures...");
+      textureManager.flush();
+      
       // Prepare the name for the window
       char title[kMaxObjectName];
       snprintf(title, kMaxObjectName, "%s (%s, %s)", config.script().c_str(),
@@ -954,8 +960,10 @@ void Control::terminate() {
   _isRunning = false;
   
   audioManager.terminate();
+  textureManager.terminate();
   timerManager.terminate();
   videoManager.terminate();
+  uploadManager.terminate();
   
   int r = rand() % 8; // Double the replies, so that the default one appears often
   
@@ -1072,6 +1080,21 @@ void Control::_updateView(int state, bool inBackground) {
       }
       break;
     case StateNode:
+      // Upload any textures decoded by the loader threads
+      textureManager.update();
+      
+      // Replace the proxies of the node once all its full textures are
+      // uploaded, crossfading from the current view unless we're still
+      // blending a switch
+      if (!inBackground && textureManager.isRefinementReady()) {
+        if (!renderManager.isBlending()) {
+          _scene->drawSpots(true);
+          renderManager.blendNextUpdate();
+          _scene->clear();
+        }
+        textureManager.refine();
+      }
+      
       _scene->scanSpots();
       _scene->drawSpots(inBackground);
       
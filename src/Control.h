@@ -50,6 +50,7 @@ class Spot;
 class State;
 class TextureManager;
 class TimerManager;
+class UploadManager;
 class VideoManager;
 
 typedef struct {
@@ -98,6 +99,7 @@ class Control {
   System system;
   TextureManager& textureManager;
   TimerManager& timerManager;
+  UploadManager& uploadManager;
   VideoManager& videoManager;
   
   std::vector<Room*> _arrayOfRooms;
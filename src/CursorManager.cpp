@@ -71,6 +71,10 @@ float* CursorManager::arrayOfCoords() {
   return _arrayOfCoords;
 }
 
+float* CursorManager::arrayOfTexCoords() {
+  return (*_current).arrayOfTexCoords;
+}
+
 bool CursorManager::hasAction() {
   return _hasAction;
 }
@@ -83,15 +87,23 @@ bool CursorManager::isDragging() {
   return _isDragging;
 }
 
-// NOTE: These textures aren't managed
+// NOTE: Cursors are never released, so neither are their textures
 void CursorManager::load(int typeOfCursor, const char* imageFromFile, int offsetX, int offsetY) {
+  std::string fileName = config.path(kPathResources, imageFromFile, kObjectCursor);
   Texture* texture;
   
-  texture = new Texture;
-  texture->setResource(config.path(kPathResources, imageFromFile, kObjectCursor).c_str());
-  texture->load();
+  // Cursors are usually small enough to share an atlas with the overlays
+  AtlasRegion region;
+  if (!TextureManager::instance().loadIntoAtlas(fileName, &region)) {
+    float texCoords[] = {0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f};
+    memcpy(region.arrayOfTexCoords, texCoords, sizeof(texCoords));
+    
+    texture = TextureManager::instance().acquireTexture(fileName, 0, true);
+  }
+  else texture = region.texture;
   
   _arrayOfCursors.push_back(_makeCursorData(typeOfCursor, texture,
+                                            region.arrayOfTexCoords,
                                             MakePoint(_half - offsetX,
                                                       _half - offsetY)));
 }
@@ -171,10 +183,13 @@ void CursorManager::updateCoords(int x, int y) {
 ////////////////////////////////////////////////////////////
 
 DGCursorData CursorManager::_makeCursorData(int type, Texture* image,
+                                            const float* arrayOfTexCoords,
                                             Point origin) {
   DGCursorData cursorData;
   cursorData.type = type;
   cursorData.image = image;
+  memcpy(cursorData.arrayOfTexCoords, arrayOfTexCoords,
+         sizeof(cursorData.arrayOfTexCoords));
   cursorData.origin = origin;
   return cursorData;
 }
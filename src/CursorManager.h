@@ -37,6 +37,7 @@ class Texture;
 typedef struct {
   int type;
   Texture* image;
+  float arrayOfTexCoords[8]; // Region of the image, which may be an atlas
   Point origin;
 } DGCursorData;
 
@@ -61,7 +62,8 @@ class CursorManager : public Object {
   int _x;
   int _y;
   
-  DGCursorData _makeCursorData(int type, Texture* image, Point origin);
+  DGCursorData _makeCursorData(int type, Texture* image, const float* arrayOfTexCoords,
+                               Point origin);
   void _set(int typeOfCursor);
   
   CursorManager();
@@ -78,6 +80,7 @@ public:
   Action* action();
   void bindImage();
   float* arrayOfCoords();
+  float* arrayOfTexCoords();
   bool hasAction();
   bool hasImage();
   bool isDragging();
@@ -0,0 +1,620 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "DecodeKernels.h"
+#include "stb_image.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DAGON_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define DAGON_NEON
+#include <arm_neon.h>
+#endif
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// GCC and Clang only emit these instructions in functions marked for
+// them, unless the whole program is built for that CPU
+#if defined(__GNUC__) && !defined(__x86_64__)
+#define DAGON_TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define DAGON_TARGET_SSE2
+#endif
+
+#if defined(__GNUC__)
+#define DAGON_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DAGON_TARGET_AVX2
+#endif
+
+// Same rounding as the portable IDCT, so that constants match exactly
+#define kFixed(x) ((int)(((x) * 4096 + 0.5)))
+
+// PNG filter types
+enum PNGFilters {
+  kFilterSub = 1,
+  kFilterUp = 2,
+  kFilterAverage = 3,
+  kFilterPaeth = 4
+};
+
+#if defined(STBI_SIMD) && defined(DAGON_X86)
+
+////////////////////////////////////////////////////////////
+// Implementation - CPU detection
+////////////////////////////////////////////////////////////
+
+static void CPUID(int leaf, unsigned int* regs) {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuidex(info, leaf, 0);
+  for (int i = 0; i < 4; i++)
+    regs[i] = static_cast<unsigned int>(info[i]);
+#else
+  __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Which registers the OS saves on context switches
+static unsigned int XGetBV() {
+#ifdef _MSC_VER
+  return static_cast<unsigned int>(_xgetbv(0));
+#else
+  unsigned int eax, edx;
+  __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return eax;
+#endif
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - JPEG
+////////////////////////////////////////////////////////////
+
+// Two 16-bit rows multiplied by a pair of constants into 32 bits:
+// out0 = x * c0[even] + y * c0[odd], out1 likewise with c1
+#define IDCTRotate(out0, out1, x, y, c0, c1) \
+  __m128i out0##Interleaved_l = _mm_unpacklo_epi16((x), (y)); \
+  __m128i out0##Interleaved_h = _mm_unpackhi_epi16((x), (y)); \
+  __m128i out0##_l = _mm_madd_epi16(out0##Interleaved_l, c0); \
+  __m128i out0##_h = _mm_madd_epi16(out0##Interleaved_h, c0); \
+  __m128i out1##_l = _mm_madd_epi16(out0##Interleaved_l, c1); \
+  __m128i out1##_h = _mm_madd_epi16(out0##Interleaved_h, c1)
+
+// out = in << 12, widened to 32 bits
+#define IDCTWiden(out, in) \
+  __m128i out##_l = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), (in)), 4); \
+  __m128i out##_h = _mm_srai_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), (in)), 4)
+
+#define IDCTAdd(out, a, b) \
+  __m128i out##_l = _mm_add_epi32(a##_l, b##_l); \
+  __m128i out##_h = _mm_add_epi32(a##_h, b##_h)
+
+#define IDCTSubtract(out, a, b) \
+  __m128i out##_l = _mm_sub_epi32(a##_l, b##_l); \
+  __m128i out##_h = _mm_sub_epi32(a##_h, b##_h)
+
+// Butterfly of a and b, biased, shifted and packed back to 16 bits
+#define IDCTButterfly(out0, out1, a, b, bias, shift) { \
+  __m128i biased_l = _mm_add_epi32(a##_l, bias); \
+  __m128i biased_h = _mm_add_epi32(a##_h, bias); \
+  IDCTAdd(sum, biased, b); \
+  IDCTSubtract(difference, biased, b); \
+  out0 = _mm_packs_epi32(_mm_srai_epi32(sum_l, shift), _mm_srai_epi32(sum_h, shift)); \
+  out1 = _mm_packs_epi32(_mm_srai_epi32(difference_l, shift), \
+                         _mm_srai_epi32(difference_h, shift)); }
+
+#define IDCTInterleave8(a, b) \
+  temp = a; \
+  a = _mm_unpacklo_epi8(a, b); \
+  b = _mm_unpackhi_epi8(temp, b)
+
+#define IDCTInterleave16(a, b) \
+  temp = a; \
+  a = _mm_unpacklo_epi16(a, b); \
+  b = _mm_unpackhi_epi16(temp, b)
+
+// One pass of the portable IDCT_1D over all eight rows at once
+#define IDCTPass(bias, shift) { \
+  IDCTRotate(t2e, t3e, row2, row6, rot0_0, rot0_1); \
+  __m128i sum04 = _mm_add_epi16(row0, row4); \
+  __m128i difference04 = _mm_sub_epi16(row0, row4); \
+  IDCTWiden(t0e, sum04); \
+  IDCTWiden(t1e, difference04); \
+  IDCTAdd(x0, t0e, t3e); \
+  IDCTSubtract(x3, t0e, t3e); \
+  IDCTAdd(x1, t1e, t2e); \
+  IDCTSubtract(x2, t1e, t2e); \
+  IDCTRotate(y0o, y2o, row7, row3, rot2_0, rot2_1); \
+  IDCTRotate(y1o, y3o, row5, row1, rot3_0, rot3_1); \
+  __m128i sum17 = _mm_add_epi16(row1, row7); \
+  __m128i sum35 = _mm_add_epi16(row3, row5); \
+  IDCTRotate(y4o, y5o, sum17, sum35, rot1_0, rot1_1); \
+  IDCTAdd(x4, y0o, y4o); \
+  IDCTAdd(x5, y1o, y5o); \
+  IDCTAdd(x6, y2o, y5o); \
+  IDCTAdd(x7, y3o, y4o); \
+  IDCTButterfly(row0, row7, x0, x7, bias, shift); \
+  IDCTButterfly(row1, row6, x1, x6, bias, shift); \
+  IDCTButterfly(row2, row5, x2, x5, bias, shift); \
+  IDCTButterfly(row3, row4, x3, x4, bias, shift); }
+
+static inline DAGON_TARGET_SSE2 __m128i PairOfConstants(int x, int y) {
+  return _mm_setr_epi16(static_cast<short>(x), static_cast<short>(y),
+                        static_cast<short>(x), static_cast<short>(y),
+                        static_cast<short>(x), static_cast<short>(y),
+                        static_cast<short>(x), static_cast<short>(y));
+}
+
+// Columns are transformed first, then the block is transposed and the
+// rows are transformed, with the same rounding as the portable code
+static DAGON_TARGET_SSE2 void IDCTSSE2(stbi_uc* out, int outStride, short data[64],
+                                       unsigned short* dequantize) {
+  const __m128i rot0_0 = PairOfConstants(kFixed(0.5411961f),
+                                         kFixed(0.5411961f) + kFixed(-1.847759065f));
+  const __m128i rot0_1 = PairOfConstants(kFixed(0.5411961f) + kFixed(0.765366865f),
+                                         kFixed(0.5411961f));
+  const __m128i rot1_0 = PairOfConstants(kFixed(1.175875602f) + kFixed(-0.899976223f),
+                                         kFixed(1.175875602f));
+  const __m128i rot1_1 = PairOfConstants(kFixed(1.175875602f),
+                                         kFixed(1.175875602f) + kFixed(-2.562915447f));
+  const __m128i rot2_0 = PairOfConstants(kFixed(-1.961570560f) + kFixed(0.298631336f),
+                                         kFixed(-1.961570560f));
+  const __m128i rot2_1 = PairOfConstants(kFixed(-1.961570560f),
+                                         kFixed(-1.961570560f) + kFixed(3.072711026f));
+  const __m128i rot3_0 = PairOfConstants(kFixed(-0.390180644f) + kFixed(2.053119869f),
+                                         kFixed(-0.390180644f));
+  const __m128i rot3_1 = PairOfConstants(kFixed(-0.390180644f),
+                                         kFixed(-0.390180644f) + kFixed(1.501321110f));
+  
+  // Rounding of each pass, see idct_block() in stb_image.c
+  const __m128i bias0 = _mm_set1_epi32(512);
+  const __m128i bias1 = _mm_set1_epi32(65536 + (128 << 17));
+  
+  // The buffers given by stb_image aren't aligned
+  const __m128i* in = reinterpret_cast<const __m128i*>(data);
+  const __m128i* dq = reinterpret_cast<const __m128i*>(dequantize);
+  __m128i row0 = _mm_mullo_epi16(_mm_loadu_si128(in + 0), _mm_loadu_si128(dq + 0));
+  __m128i row1 = _mm_mullo_epi16(_mm_loadu_si128(in + 1), _mm_loadu_si128(dq + 1));
+  __m128i row2 = _mm_mullo_epi16(_mm_loadu_si128(in + 2), _mm_loadu_si128(dq + 2));
+  __m128i row3 = _mm_mullo_epi16(_mm_loadu_si128(in + 3), _mm_loadu_si128(dq + 3));
+  __m128i row4 = _mm_mullo_epi16(_mm_loadu_si128(in + 4), _mm_loadu_si128(dq + 4));
+  __m128i row5 = _mm_mullo_epi16(_mm_loadu_si128(in + 5), _mm_loadu_si128(dq + 5));
+  __m128i row6 = _mm_mullo_epi16(_mm_loadu_si128(in + 6), _mm_loadu_si128(dq + 6));
+  __m128i row7 = _mm_mullo_epi16(_mm_loadu_si128(in + 7), _mm_loadu_si128(dq + 7));
+  __m128i temp;
+  
+  IDCTPass(bias0, 10);
+  
+  // Transpose the 16-bit block
+  IDCTInterleave16(row0, row4);
+  IDCTInterleave16(row1, row5);
+  IDCTInterleave16(row2, row6);
+  IDCTInterleave16(row3, row7);
+  IDCTInterleave16(row0, row2);
+  IDCTInterleave16(row1, row3);
+  IDCTInterleave16(row4, row6);
+  IDCTInterleave16(row5, row7);
+  IDCTInterleave16(row0, row1);
+  IDCTInterleave16(row2, row3);
+  IDCTInterleave16(row4, row5);
+  IDCTInterleave16(row6, row7);
+  
+  IDCTPass(bias1, 17);
+  
+  // Clamp to bytes and transpose back
+  __m128i p0 = _mm_packus_epi16(row0, row1);
+  __m128i p1 = _mm_packus_epi16(row2, row3);
+  __m128i p2 = _mm_packus_epi16(row4, row5);
+  __m128i p3 = _mm_packus_epi16(row6, row7);
+  IDCTInterleave8(p0, p2);
+  IDCTInterleave8(p1, p3);
+  IDCTInterleave8(p0, p1);
+  IDCTInterleave8(p2, p3);
+  IDCTInterleave8(p0, p2);
+  IDCTInterleave8(p1, p3);
+  
+  __m128i rows[4] = { p0, p2, p1, p3 };
+  for (int i = 0; i < 4; i++) {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), rows[i]);
+    out += outStride;
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out),
+                     _mm_shuffle_epi32(rows[i], 0x4e));
+    out += outStride;
+  }
+}
+
+// Identical to YCbCr_to_RGB_row() in stb_image.c, for the last pixels
+static void YCbCrToRGB(stbi_uc* out, const stbi_uc* y, const stbi_uc* pcb,
+                       const stbi_uc* pcr, int count, int step) {
+  for (int i = 0; i < count; i++) {
+    int yFixed = (y[i] << 16) + 32768;
+    int cr = pcr[i] - 128;
+    int cb = pcb[i] - 128;
+    int r = (yFixed + cr * 91881) >> 16;
+    int g = (yFixed - cr * 46802 - cb * 22554) >> 16;
+    int b = (yFixed + cb * 116130) >> 16;
+    out[0] = static_cast<stbi_uc>(r < 0 ? 0 : (r > 255 ? 255 : r));
+    out[1] = static_cast<stbi_uc>(g < 0 ? 0 : (g > 255 ? 255 : g));
+    out[2] = static_cast<stbi_uc>(b < 0 ? 0 : (b > 255 ? 255 : b));
+    out[3] = 255;
+    out += step;
+  }
+}
+
+// One channel for eight pixels: (y << 16) + 32768 + a * c[even] + b * c[odd],
+// shifted back to 16 bits. The fixed point constants of the portable code
+// don't fit in 16 bits, so they're split across both factors.
+static inline DAGON_TARGET_SSE2 __m128i YCbCrChannel(__m128i yLow, __m128i yHigh, __m128i a,
+                                                     __m128i b, __m128i constants) {
+  __m128i low = _mm_add_epi32(yLow, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), constants));
+  __m128i high = _mm_add_epi32(yHigh, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), constants));
+  return _mm_packs_epi32(_mm_srai_epi32(low, 16), _mm_srai_epi32(high, 16));
+}
+
+// Clamps eight pixels to bytes and writes them as RGB or RGBA
+static inline DAGON_TARGET_SSE2 void YCbCrStore(stbi_uc* out, __m128i r, __m128i g, __m128i b,
+                                                int step) {
+  __m128i rg = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_packus_epi16(g, g));
+  __m128i ba = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_set1_epi8(-1));
+  __m128i low = _mm_unpacklo_epi16(rg, ba);
+  __m128i high = _mm_unpackhi_epi16(rg, ba);
+  
+  if (step == 4) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), low);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), high);
+  }
+  else {
+    stbi_uc rgba[32];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba), low);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + 16), high);
+    for (int i = 0; i < 8; i++)
+      memcpy(out + i * 3, rgba + i * 4, 3);
+  }
+}
+
+static DAGON_TARGET_SSE2 void YCbCrToRGBSSE2(stbi_uc* out, const stbi_uc* y, const stbi_uc* pcb,
+                                             const stbi_uc* pcr, int count, int step) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i bias = _mm_set1_epi16(128);
+  const __m128i rounding = _mm_set1_epi32(32768);
+  // (cr << 2) * 22970 + cr = cr * 91881
+  const __m128i rConstants = PairOfConstants(22970, 1);
+  // (cr << 1) * -23401 + cb * -22554 = cr * -46802 + cb * -22554
+  const __m128i gConstants = PairOfConstants(-23401, -22554);
+  // (cb << 2) * 29032 + cb * 2 = cb * 116130
+  const __m128i bConstants = PairOfConstants(29032, 2);
+  
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i y16 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + i)), zero);
+    __m128i cb = _mm_sub_epi16(_mm_unpacklo_epi8(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pcb + i)), zero), bias);
+    __m128i cr = _mm_sub_epi16(_mm_unpacklo_epi8(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pcr + i)), zero), bias);
+    __m128i yLow = _mm_add_epi32(_mm_unpacklo_epi16(zero, y16), rounding);
+    __m128i yHigh = _mm_add_epi32(_mm_unpackhi_epi16(zero, y16), rounding);
+    
+    __m128i r = YCbCrChannel(yLow, yHigh, _mm_slli_epi16(cr, 2), cr, rConstants);
+    __m128i g = YCbCrChannel(yLow, yHigh, _mm_slli_epi16(cr, 1), cb, gConstants);
+    __m128i b = YCbCrChannel(yLow, yHigh, _mm_slli_epi16(cb, 2), cb, bConstants);
+    YCbCrStore(out, r, g, b, step);
+    out += 8 * step;
+  }
+  
+  YCbCrToRGB(out, y + i, pcb + i, pcr + i, count - i, step);
+}
+
+static inline DAGON_TARGET_AVX2 __m256i YCbCrChannelAVX2(__m256i yLow, __m256i yHigh, __m256i a,
+                                                         __m256i b, __m256i constants) {
+  __m256i low = _mm256_add_epi32(yLow, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), constants));
+  __m256i high = _mm256_add_epi32(yHigh, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), constants));
+  return _mm256_packs_epi32(_mm256_srai_epi32(low, 16), _mm256_srai_epi32(high, 16));
+}
+
+// Same as the SSE2 version, sixteen pixels at a time. Unpacking and packing
+// work within each 128-bit lane, so pixels stay in order.
+static DAGON_TARGET_AVX2 void YCbCrToRGBAVX2(stbi_uc* out, const stbi_uc* y, const stbi_uc* pcb,
+                                             const stbi_uc* pcr, int count, int step) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i bias = _mm256_set1_epi16(128);
+  const __m256i rounding = _mm256_set1_epi32(32768);
+  const __m256i rConstants = _mm256_broadcastsi128_si256(PairOfConstants(22970, 1));
+  const __m256i gConstants = _mm256_broadcastsi128_si256(PairOfConstants(-23401, -22554));
+  const __m256i bConstants = _mm256_broadcastsi128_si256(PairOfConstants(29032, 2));
+  
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i y16 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + i)));
+    __m256i cb = _mm256_sub_epi16(_mm256_cvtepu8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(pcb + i))), bias);
+    __m256i cr = _mm256_sub_epi16(_mm256_cvtepu8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(pcr + i))), bias);
+    __m256i yLow = _mm256_add_epi32(_mm256_unpacklo_epi16(zero, y16), rounding);
+    __m256i yHigh = _mm256_add_epi32(_mm256_unpackhi_epi16(zero, y16), rounding);
+    
+    __m256i r = YCbCrChannelAVX2(yLow, yHigh, _mm256_slli_epi16(cr, 2), cr, rConstants);
+    __m256i g = YCbCrChannelAVX2(yLow, yHigh, _mm256_slli_epi16(cr, 1), cb, gConstants);
+    __m256i b = YCbCrChannelAVX2(yLow, yHigh, _mm256_slli_epi16(cb, 2), cb, bConstants);
+    YCbCrStore(out, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g),
+               _mm256_castsi256_si128(b), step);
+    YCbCrStore(out + 8 * step, _mm256_extracti128_si256(r, 1),
+               _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(b, 1), step);
+    out += 16 * step;
+  }
+  
+  YCbCrToRGBSSE2(out, y + i, pcb + i, pcr + i, count - i, step);
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - PNG
+////////////////////////////////////////////////////////////
+
+// Pixels of three bytes are moved one byte at a time so that we never
+// touch memory past the end of the row. The size is a template argument
+// so that these become plain loads and stores.
+template <int n>
+static inline DAGON_TARGET_SSE2 __m128i LoadPixel(const stbi_uc* pixel) {
+  int value;
+  if (n == 3) value = pixel[0] | (pixel[1] << 8) | (pixel[2] << 16);
+  else memcpy(&value, pixel, sizeof(value));
+  return _mm_cvtsi32_si128(value);
+}
+
+template <int n>
+static inline DAGON_TARGET_SSE2 void StorePixel(stbi_uc* pixel, __m128i value) {
+  int bytes = _mm_cvtsi128_si32(value);
+  if (n == 3) {
+    pixel[0] = static_cast<stbi_uc>(bytes);
+    pixel[1] = static_cast<stbi_uc>(bytes >> 8);
+    pixel[2] = static_cast<stbi_uc>(bytes >> 16);
+  }
+  else memcpy(pixel, &bytes, sizeof(bytes));
+}
+
+static DAGON_TARGET_SSE2 void UnfilterUpSSE2(stbi_uc* cur, const stbi_uc* prior,
+                                             const stbi_uc* raw, int bytes) {
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prior + i));
+    __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(raw + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(cur + i), _mm_add_epi8(value, up));
+  }
+  
+  for (; i < bytes; i++)
+    cur[i] = static_cast<stbi_uc>(raw[i] + prior[i]);
+}
+
+// Every filter but Up depends on the previous pixel, so these work on one
+// pixel at a time with all of its channels in a register
+template <int n>
+static DAGON_TARGET_SSE2 int UnfilterPixelsSSE2(stbi_uc* cur, const stbi_uc* prior,
+                                                const stbi_uc* raw, int filter, int count) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i a = zero;
+  
+  switch (filter) {
+    case kFilterSub: {
+      for (int i = 0; i < count; i++) {
+        a = _mm_add_epi8(a, LoadPixel<n>(raw));
+        StorePixel<n>(cur, a);
+        raw += n;
+        cur += n;
+      }
+      
+      return 1;
+    }
+    case kFilterAverage: {
+      const __m128i one = _mm_set1_epi8(1);
+      for (int i = 0; i < count; i++) {
+        // avg_epu8 rounds up, so drop the carried bit when a + b is odd
+        __m128i b = LoadPixel<n>(prior);
+        __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b),
+                                       _mm_and_si128(_mm_xor_si128(a, b), one));
+        a = _mm_add_epi8(average, LoadPixel<n>(raw));
+        StorePixel<n>(cur, a);
+        raw += n;
+        cur += n;
+        prior += n;
+      }
+      
+      return 1;
+    }
+    case kFilterPaeth: {
+      // Predictors are kept as 16-bit values: a is left, b is up and c is
+      // up and left
+      const __m128i mask = _mm_set1_epi16(0xff);
+      __m128i c = zero;
+      for (int i = 0; i < count; i++) {
+        __m128i b = _mm_unpacklo_epi8(LoadPixel<n>(prior), zero);
+        __m128i pa = _mm_sub_epi16(b, c);
+        __m128i pb = _mm_sub_epi16(a, c);
+        __m128i pc = _mm_add_epi16(pa, pb);
+        
+        // SSE2 has no absolute value, so use max(x, -x)
+        pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+        pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+        pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+        
+        // Ties go to a, then b, as in the portable code
+        __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+        __m128i useA = _mm_cmpeq_epi16(smallest, pa);
+        __m128i useB = _mm_andnot_si128(useA, _mm_cmpeq_epi16(smallest, pb));
+        __m128i useC = _mm_andnot_si128(_mm_or_si128(useA, useB), _mm_set1_epi16(-1));
+        __m128i nearest = _mm_or_si128(_mm_or_si128(_mm_and_si128(useA, a),
+                                                    _mm_and_si128(useB, b)),
+                                       _mm_and_si128(useC, c));
+        
+        a = _mm_and_si128(_mm_add_epi16(nearest, _mm_unpacklo_epi8(LoadPixel<n>(raw), zero)),
+                          mask);
+        StorePixel<n>(cur, _mm_packus_epi16(a, a));
+        c = b;
+        raw += n;
+        cur += n;
+        prior += n;
+      }
+      
+      return 1;
+    }
+  }
+  
+  return 0;
+}
+
+static DAGON_TARGET_SSE2 int UnfilterPNGSSE2(stbi_uc* cur, const stbi_uc* prior, const stbi_uc* raw,
+                                             int filter, int count, int n) {
+  if (filter == kFilterUp) {
+    UnfilterUpSSE2(cur, prior, raw, count * n);
+    return 1;
+  }
+  
+  switch (n) {
+    case 3: return UnfilterPixelsSSE2<3>(cur, prior, raw, filter, count);
+    case 4: return UnfilterPixelsSSE2<4>(cur, prior, raw, filter, count);
+  }
+  
+  return 0;
+}
+
+static DAGON_TARGET_AVX2 int UnfilterPNGAVX2(stbi_uc* cur, const stbi_uc* prior, const stbi_uc* raw,
+                                             int filter, int count, int n) {
+  if (filter != kFilterUp)
+    return UnfilterPNGSSE2(cur, prior, raw, filter, count, n);
+  
+  int bytes = count * n;
+  int i = 0;
+  for (; i + 32 <= bytes; i += 32) {
+    __m256i up = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prior + i));
+    __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(raw + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(cur + i), _mm256_add_epi8(value, up));
+  }
+  
+  UnfilterUpSSE2(cur + i, prior + i, raw + i, bytes - i);
+  return 1;
+}
+
+#endif // STBI_SIMD && DAGON_X86
+
+#if defined(STBI_SIMD) && defined(DAGON_NEON)
+
+////////////////////////////////////////////////////////////
+// Implementation - PNG (NEON)
+////////////////////////////////////////////////////////////
+
+// Only the Up filter is done here, the rest is left to the portable code
+static int UnfilterPNGNEON(stbi_uc* cur, const stbi_uc* prior, const stbi_uc* raw,
+                           int filter, int count, int n) {
+  if (filter != kFilterUp)
+    return 0;
+  
+  int bytes = count * n;
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16)
+    vst1q_u8(cur + i, vaddq_u8(vld1q_u8(raw + i), vld1q_u8(prior + i)));
+  
+  for (; i < bytes; i++)
+    cur[i] = static_cast<stbi_uc>(raw[i] + prior[i]);
+  
+  return 1;
+}
+
+#endif // STBI_SIMD && DAGON_NEON
+
+////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////
+
+int DetectCPUFeatures() {
+  int features = 0;
+  
+#if defined(STBI_SIMD) && defined(DAGON_X86)
+  unsigned int regs[4];
+  CPUID(0, regs);
+  unsigned int maxLeaf = regs[0];
+  
+  CPUID(1, regs);
+  if (regs[3] & (1 << 26))
+    features |= kCPUSSE2;
+  
+  // AVX2 also needs the OS to save the YMM registers
+  bool hasAVX = (regs[2] & (1 << 27)) && (regs[2] & (1 << 28));
+  if (hasAVX && maxLeaf >= 7 && (XGetBV() & 0x6) == 0x6) {
+    CPUID(7, regs);
+    if (regs[1] & (1 << 5))
+      features |= kCPUAVX2;
+  }
+#elif defined(STBI_SIMD) && defined(DAGON_NEON)
+  // Builds for these targets can only run where NEON is available
+  features |= kCPUNEON;
+#endif
+  
+  return features;
+}
+
+const char* InstallDecodeKernels(int features) {
+#ifdef STBI_SIMD
+#ifdef DAGON_X86
+  // Every CPU with AVX2 also has SSE2
+  if (features & kCPUAVX2) {
+    stbi_install_idct(IDCTSSE2);
+    stbi_install_YCbCr_to_RGB(YCbCrToRGBAVX2);
+    stbi_install_png_unfilter(UnfilterPNGAVX2);
+    return "AVX2";
+  }
+  
+  if (features & kCPUSSE2) {
+    stbi_install_idct(IDCTSSE2);
+    stbi_install_YCbCr_to_RGB(YCbCrToRGBSSE2);
+    stbi_install_png_unfilter(UnfilterPNGSSE2);
+    return "SSE2";
+  }
+#endif
+  
+#ifdef DAGON_NEON
+  if (features & kCPUNEON) {
+    stbi_install_idct(NULL);
+    stbi_install_YCbCr_to_RGB(NULL);
+    stbi_install_png_unfilter(UnfilterPNGNEON);
+    return "NEON";
+  }
+#endif
+  
+  stbi_install_idct(NULL);
+  stbi_install_YCbCr_to_RGB(NULL);
+  stbi_install_png_unfilter(NULL);
+#endif
+  
+  // Not every build has kernels to pick from
+  (void)features;
+  return "portable";
+}
+  
+}
@@ -0,0 +1,47 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_DECODEKERNELS_H_
+#define DAGON_DECODEKERNELS_H_
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+enum CPUFeatures {
+  kCPUSSE2 = 0x01,
+  kCPUAVX2 = 0x02,
+  kCPUNEON = 0x04
+};
+
+////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////
+
+// SIMD versions of the hot loops of stb_image: the JPEG IDCT and color
+// conversion, and PNG unfiltering. They give exactly the same output as
+// the portable code.
+
+// Features of the CPU we're running on
+int DetectCPUFeatures();
+
+// Installs the fastest kernels allowed by the given features and returns
+// their name, which is "portable" if none could be used. Must be called
+// before any decoding starts, as stb_image keeps these in globals.
+const char* InstallDecodeKernels(int features);
+  
+}
+
+#endif // DAGON_DECODEKERNELS_H_
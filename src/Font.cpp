@@ -24,6 +24,7 @@
 #include "Font.h"
 #include "Language.h"
 #include "Log.h"
+#include "TextureManager.h"
 
 namespace dagon {
 
@@ -36,6 +37,7 @@ config(Config::instance()),
 log(Log::instance())
 {
   _isLoaded = false;
+  _size = 0;
   this->setType(kObjectFont);
 }
 
@@ -44,8 +46,11 @@ log(Log::instance())
 ////////////////////////////////////////////////////////////
 
 void Font::clear() {
-  if (_isLoaded)
+  if (_isLoaded) {
     glDeleteTextures(kMaxChars, _textures);
+    TextureManager::trackMemory(kTextureFont, -static_cast<long>(_size));
+    _size = 0;
+  }
 }
 
 bool Font::isLoaded() {
@@ -180,6 +185,7 @@ void Font::_loadFont(FT_Face &face) {
   FT_Set_Char_Size(face, _height << 6, _height << 6, 96, 96);
   glGenTextures(kMaxChars, _textures);
   
+  size_t size = 0;
   for (wchar_t ch = 0; ch < kMaxChars; ch++) {
     if (FT_Load_Glyph(face, FT_Get_Char_Index(face, ch), FT_LOAD_DEFAULT)) {
       log.error(kModFont, "%s: %c", kString15006, ch);
@@ -220,7 +226,10 @@ void Font::_loadFont(FT_Face &face) {
     glTexImage2D(GL_TEXTURE_2D, 0, 2, width, height, 0,
                  GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, expandedData);
     delete[] expandedData;
+    size += 2 * width * height;
   }
+  _size = size;
+  TextureManager::trackMemory(kTextureFont, static_cast<long>(_size));
   _isLoaded = true;
 }
   
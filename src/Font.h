@@ -86,6 +86,7 @@ class Font : public Object {
   unsigned int _height;
   bool _isLoaded;
   FT_Library* _library;
+  size_t _size; // Bytes taken by the glyphs in video memory
   GLuint _textures[kMaxChars];
   
   void _loadFont(FT_Face &face);
@@ -18,9 +18,17 @@
 #include "Config.h"
 #include "Image.h"
 #include "Texture.h"
+#include "TextureManager.h"
 
 namespace dagon {
 
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Coordinates of textures drawn whole
+static const float FullTexCoords[] = {0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f};
+
 ////////////////////////////////////////////////////////////
 // Implementation - Constructor
 ////////////////////////////////////////////////////////////
@@ -29,23 +37,37 @@ Image::Image() :
 config(Config::instance())
 {
   _hasTexture = false;
+  _isInAtlas = false;
   _rect = ZeroRect;
+  memcpy(_arrayOfTexCoords, FullTexCoords, sizeof(_arrayOfTexCoords));
   this->setType(kObjectImage);
 }
 
 Image::Image(const std::string &fromFileName) :
 config(Config::instance())
 {
+  _hasTexture = false;
+  _isInAtlas = false;
   this->setTexture(fromFileName);
   if (_attachedTexture->isLoaded()) {
     _rect.origin = ZeroPoint;
-    _rect.size = MakeSize(_attachedTexture->width(),
-                          _attachedTexture->height());
+    _rect.size = _textureSize;
     _calculateCoordinates();
   }
   this->setType(kObjectImage);
 }
 
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+Image::~Image() {
+  if (_isInAtlas)
+    TextureManager::releaseFromAtlas(_atlasFileName);
+  else if (_hasTexture)
+    TextureManager::releaseTexture(_attachedTexture);
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Checks
 ////////////////////////////////////////////////////////////
@@ -62,6 +84,10 @@ float* Image::arrayOfCoordinates() {
   return _arrayOfCoordinates;
 }
 
+float* Image::arrayOfTexCoords() {
+  return _arrayOfTexCoords;
+}
+
 Point Image::position() {
   return _rect.origin;
 }
@@ -89,16 +115,35 @@ void Image::setSize(float width, float height) {
 }
 
 void Image::setTexture(const std::string &fromFileName) {
-  // TODO: Important! We should determine first if the texture already exists
-  // to avoid repeating resources. Eventually, this would be done via the
-  // resource manager.
   // FIXME: These textures are immediately loaded which isn't very efficient.
   
-  _attachedTexture = new Texture;
-  _attachedTexture->setResource(config.path(kPathResources, fromFileName,
-                                            kObjectImage).c_str());
-  _attachedTexture->load();
+  std::string fileName = config.path(kPathResources, fromFileName, kObjectImage);
+  
+  // Released only once we hold the new one, in case it's the same file
+  Texture* previousTexture = (_hasTexture && !_isInAtlas) ? _attachedTexture : NULL;
+  std::string previousFileName = _isInAtlas ? _atlasFileName : std::string();
+  
+  // Small bitmaps are packed with others, larger ones get a texture shared
+  // by every image showing the same file
+  TextureManager& textureManager = TextureManager::instance();
+  AtlasRegion region;
+  _isInAtlas = textureManager.loadIntoAtlas(fileName, &region);
+  if (_isInAtlas) {
+    _atlasFileName = fileName;
+    _attachedTexture = region.texture;
+    memcpy(_arrayOfTexCoords, region.arrayOfTexCoords, sizeof(_arrayOfTexCoords));
+    _textureSize = MakeSize(region.width, region.height);
+  } else {
+    _attachedTexture = textureManager.acquireTexture(fileName, 0, true);
+    memcpy(_arrayOfTexCoords, FullTexCoords, sizeof(_arrayOfTexCoords));
+    _textureSize = MakeSize(_attachedTexture->width(), _attachedTexture->height());
+  }
   _hasTexture = true;
+  
+  if (previousTexture)
+    TextureManager::releaseTexture(previousTexture);
+  else if (!previousFileName.empty())
+    TextureManager::releaseFromAtlas(previousFileName);
 }
 
 ////////////////////////////////////////////////////////////
@@ -40,13 +40,14 @@ class Image : public Object {
  public:
   Image();
   Image(const std::string &fromFileName);
-  ~Image() {};
+  ~Image();
   
   // Checks
   bool hasTexture();
   
   // Gets
   float* arrayOfCoordinates();
+  float* arrayOfTexCoords(); // Region of the texture, which may be an atlas
   Point position();
   Size size();
   Texture* texture();
@@ -64,9 +65,13 @@ class Image : public Object {
   Config& config;
   
   float _arrayOfCoordinates[8];
+  float _arrayOfTexCoords[8];
   Texture* _attachedTexture;
   bool _hasTexture;
+  bool _isInAtlas; // Otherwise the texture is shared with the texture manager
+  std::string _atlasFileName;
   Rect _rect;
+  Size _textureSize;
   
   void _calculateCoordinates();
   
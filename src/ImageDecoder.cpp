@@ -0,0 +1,360 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef DAGON_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+#ifdef DAGON_SPNG
+#include <spng.h>
+#endif
+
+#ifdef DAGON_WEBP
+#include <webp/decode.h>
+#endif
+
+#include "ImageDecoder.h"
+#include "stb_image.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Implementation - Conversion
+////////////////////////////////////////////////////////////
+
+// Changes the number of channels of a decoded image, with the same
+// luminance weights as stb_image
+static bool ConvertImage(DecodedImage* image, int depth) {
+  if (depth == 0 || depth == image->depth)
+    return true;
+  
+  size_t numOfPixels = static_cast<size_t>(image->width) * image->height;
+  unsigned char* converted = static_cast<unsigned char*>(malloc(numOfPixels * depth));
+  if (!converted) {
+    free(image->data);
+    image->data = NULL;
+    image->failureReason = "Out of memory";
+    return false;
+  }
+  
+  const unsigned char* source = image->data;
+  unsigned char* target = converted;
+  for (size_t i = 0; i < numOfPixels; i++) {
+    int r, g, b, a = 255;
+    switch (image->depth) {
+      case kImageGrey: r = g = b = source[0]; break;
+      case kImageGreyAlpha: r = g = b = source[0]; a = source[1]; break;
+      case kImageRGB: r = source[0]; g = source[1]; b = source[2]; break;
+      default: r = source[0]; g = source[1]; b = source[2]; a = source[3]; break;
+    }
+    
+    int luminance = (r * 77 + g * 150 + b * 29) >> 8;
+    switch (depth) {
+      case kImageGrey:
+        target[0] = static_cast<unsigned char>(luminance);
+        break;
+      case kImageGreyAlpha:
+        target[0] = static_cast<unsigned char>(luminance);
+        target[1] = static_cast<unsigned char>(a);
+        break;
+      case kImageRGB:
+        target[0] = static_cast<unsigned char>(r);
+        target[1] = static_cast<unsigned char>(g);
+        target[2] = static_cast<unsigned char>(b);
+        break;
+      default:
+        target[0] = static_cast<unsigned char>(r);
+        target[1] = static_cast<unsigned char>(g);
+        target[2] = static_cast<unsigned char>(b);
+        target[3] = static_cast<unsigned char>(a);
+        break;
+    }
+    
+    source += image->depth;
+    target += depth;
+  }
+  
+  free(image->data);
+  image->data = converted;
+  image->depth = depth;
+  return true;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Decoders
+////////////////////////////////////////////////////////////
+
+#ifdef DAGON_TURBOJPEG
+
+static bool DecodeTurboJPEG(const unsigned char* data, size_t size, int depth,
+                            DecodedImage* image) {
+  tjhandle handle = tjInitDecompress();
+  if (!handle) {
+    image->failureReason = tjGetErrorStr();
+    return false;
+  }
+  
+  // Older versions of the library take non-const buffers
+  unsigned char* buffer = const_cast<unsigned char*>(data);
+  int width, height, subsampling, colorSpace;
+  bool success = false;
+  if (tjDecompressHeader3(handle, buffer, static_cast<unsigned long>(size),
+                          &width, &height, &subsampling, &colorSpace) == 0) {
+    // Grey with alpha is the only depth we have to convert ourselves
+    int native = (colorSpace == TJCS_GRAY) ? kImageGrey : kImageRGB;
+    int target = (depth == 0 || depth == kImageGreyAlpha) ? native : depth;
+    int pixelFormat = TJPF_RGB;
+    if (target == kImageGrey) pixelFormat = TJPF_GRAY;
+    else if (target == kImageRGBA) pixelFormat = TJPF_RGBA;
+    
+    image->data = static_cast<unsigned char*>(malloc(static_cast<size_t>(width) *
+                                                     height * target));
+    if (image->data &&
+        tjDecompress2(handle, buffer, static_cast<unsigned long>(size), image->data,
+                      width, 0, height, pixelFormat, 0) == 0) {
+      image->width = width;
+      image->height = height;
+      image->depth = target;
+      success = true;
+    } else {
+      free(image->data);
+      image->data = NULL;
+    }
+  }
+  
+  if (!success)
+    image->failureReason = tjGetErrorStr();
+  
+  tjDestroy(handle);
+  return success && ConvertImage(image, depth);
+}
+
+static bool InfoTurboJPEG(const unsigned char* data, size_t size,
+                          int* width, int* height) {
+  tjhandle handle = tjInitDecompress();
+  if (!handle)
+    return false;
+  
+  int subsampling, colorSpace;
+  bool success = (tjDecompressHeader3(handle, const_cast<unsigned char*>(data),
+                                      static_cast<unsigned long>(size), width, height,
+                                      &subsampling, &colorSpace) == 0);
+  tjDestroy(handle);
+  return success;
+}
+
+#endif // DAGON_TURBOJPEG
+
+#ifdef DAGON_SPNG
+
+static bool DecodeSPNG(const unsigned char* data, size_t size, int depth,
+                       DecodedImage* image) {
+  spng_ctx* context = spng_ctx_new(0);
+  if (!context) {
+    image->failureReason = "Out of memory";
+    return false;
+  }
+  
+  // libspng gives us either RGB or RGBA, so other depths are converted
+  struct spng_ihdr header;
+  struct spng_trns transparency;
+  size_t decodedSize = 0;
+  int result = spng_set_png_buffer(context, data, size);
+  if (result == 0)
+    result = spng_get_ihdr(context, &header);
+  
+  if (result == 0) {
+    bool hasAlpha = (header.color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA ||
+                     header.color_type == SPNG_COLOR_TYPE_TRUECOLOR_ALPHA ||
+                     spng_get_trns(context, &transparency) == 0);
+    bool needsAlpha = (depth == 0) ? hasAlpha : (depth == kImageRGBA ||
+                                                 depth == kImageGreyAlpha);
+    int format = needsAlpha ? SPNG_FMT_RGBA8 : SPNG_FMT_RGB8;
+    result = spng_decoded_image_size(context, format, &decodedSize);
+    
+    if (result == 0) {
+      image->data = static_cast<unsigned char*>(malloc(decodedSize));
+      if (!image->data)
+        result = SPNG_EMEM;
+      else
+        result = spng_decode_image(context, image->data, decodedSize, format,
+                                   SPNG_DECODE_TRNS);
+    }
+    
+    if (result == 0) {
+      image->width = static_cast<int>(header.width);
+      image->height = static_cast<int>(header.height);
+      image->depth = needsAlpha ? kImageRGBA : kImageRGB;
+    }
+  }
+  
+  if (result != 0) {
+    free(image->data);
+    image->data = NULL;
+    image->failureReason = spng_strerror(result);
+  }
+  
+  spng_ctx_free(context);
+  return (result == 0) && ConvertImage(image, depth);
+}
+
+static bool InfoSPNG(const unsigned char* data, size_t size,
+                     int* width, int* height) {
+  spng_ctx* context = spng_ctx_new(0);
+  if (!context)
+    return false;
+  
+  struct spng_ihdr header;
+  bool success = (spng_set_png_buffer(context, data, size) == 0 &&
+                  spng_get_ihdr(context, &header) == 0);
+  if (success) {
+    *width = static_cast<int>(header.width);
+    *height = static_cast<int>(header.height);
+  }
+  
+  spng_ctx_free(context);
+  return success;
+}
+
+#endif // DAGON_SPNG
+
+#ifdef DAGON_WEBP
+
+static bool DecodeWebP(const unsigned char* data, size_t size, int depth,
+                       DecodedImage* image) {
+  WebPBitstreamFeatures features;
+  if (WebPGetFeatures(data, size, &features) != VP8_STATUS_OK) {
+    image->failureReason = "Corrupt WebP";
+    return false;
+  }
+  
+  // libwebp gives us either RGB or RGBA, so other depths are converted
+  bool needsAlpha = (depth == 0) ? (features.has_alpha != 0) :
+                                   (depth == kImageRGBA || depth == kImageGreyAlpha);
+  int target = needsAlpha ? kImageRGBA : kImageRGB;
+  int stride = features.width * target;
+  size_t decodedSize = static_cast<size_t>(stride) * features.height;
+  
+  image->data = static_cast<unsigned char*>(malloc(decodedSize));
+  if (!image->data) {
+    image->failureReason = "Out of memory";
+    return false;
+  }
+  
+  uint8_t* result;
+  if (needsAlpha)
+    result = WebPDecodeRGBAInto(data, size, image->data, decodedSize, stride);
+  else
+    result = WebPDecodeRGBInto(data, size, image->data, decodedSize, stride);
+  
+  if (!result) {
+    free(image->data);
+    image->data = NULL;
+    image->failureReason = "Corrupt WebP";
+    return false;
+  }
+  
+  image->width = features.width;
+  image->height = features.height;
+  image->depth = target;
+  return ConvertImage(image, depth);
+}
+
+static bool InfoWebP(const unsigned char* data, size_t size,
+                     int* width, int* height) {
+  return WebPGetInfo(data, size, width, height) != 0;
+}
+
+#endif // DAGON_WEBP
+
+// Handles every format it knows, so it's also the fallback
+static bool DecodeSTB(const unsigned char* data, size_t size, int depth,
+                      DecodedImage* image) {
+  int width, height, comp;
+  image->data = stbi_load_from_memory(data, static_cast<int>(size), &width, &height,
+                                      &comp, depth);
+  if (!image->data) {
+    image->failureReason = stbi_failure_reason();
+    return false;
+  }
+  
+  image->width = width;
+  image->height = height;
+  image->depth = depth ? depth : comp;
+  return true;
+}
+
+static bool InfoSTB(const unsigned char* data, size_t size,
+                    int* width, int* height) {
+  int comp;
+  return stbi_info_from_memory(data, static_cast<int>(size), width, height, &comp) != 0;
+}
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Checked in order, the first decoder whose magic bytes match is used
+static const ImageDecoder Decoders[] = {
+#ifdef DAGON_TURBOJPEG
+  { "libjpeg-turbo", "\xFF\xD8\xFF", 3, 0, DecodeTurboJPEG, InfoTurboJPEG },
+#endif
+#ifdef DAGON_SPNG
+  { "libspng", "\x89PNG\r\n\x1A\n", 8, 0, DecodeSPNG, InfoSPNG },
+#endif
+#ifdef DAGON_WEBP
+  { "libwebp", "WEBP", 4, 8, DecodeWebP, InfoWebP },
+#endif
+  { "stb_image", "", 0, 0, DecodeSTB, InfoSTB }
+};
+
+#define kNumOfDecoders (sizeof(Decoders) / sizeof(ImageDecoder))
+
+////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////
+
+const ImageDecoder* FindImageDecoder(const unsigned char* data, size_t size) {
+  for (size_t i = 0; i < kNumOfDecoders - 1; i++) {
+    const ImageDecoder& decoder = Decoders[i];
+    if (size >= decoder.magicOffset + decoder.magicSize &&
+        memcmp(data + decoder.magicOffset, decoder.magic, decoder.magicSize) == 0)
+      return &decoder;
+  }
+  
+  return &Decoders[kNumOfDecoders - 1];
+}
+
+bool DecodeImage(const unsigned char* data, size_t size, int depth,
+                 DecodedImage* image) {
+  image->data = NULL;
+  image->width = 0;
+  image->height = 0;
+  image->depth = 0;
+  image->failureReason = NULL;
+  
+  return FindImageDecoder(data, size)->decode(data, size, depth, image);
+}
+
+bool ImageInfo(const unsigned char* data, size_t size, int* width, int* height) {
+  return FindImageDecoder(data, size)->info(data, size, width, height);
+}
+  
+}
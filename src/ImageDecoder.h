@@ -0,0 +1,82 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_IMAGEDECODER_H_
+#define DAGON_IMAGEDECODER_H_
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Number of 8-bit channels in a decoded image
+enum ImageDepths {
+  kImageGrey = 1,
+  kImageGreyAlpha,
+  kImageRGB,
+  kImageRGBA
+};
+
+typedef struct {
+  unsigned char* data; // Allocated with malloc()
+  int width;
+  int height;
+  int depth;
+  const char* failureReason;
+} DecodedImage;
+
+// A depth of 0 keeps the channels of the image
+typedef bool (*ImageDecodeFunction)(const unsigned char* data, size_t size,
+                                    int depth, DecodedImage* image);
+typedef bool (*ImageInfoFunction)(const unsigned char* data, size_t size,
+                                  int* width, int* height);
+
+typedef struct {
+  const char* name;
+  const char* magic;
+  size_t magicSize;
+  size_t magicOffset;
+  ImageDecodeFunction decode;
+  ImageInfoFunction info;
+} ImageDecoder;
+
+////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////
+
+// Registry of image decoders, picked by the magic bytes of the data.
+// libjpeg-turbo, libspng and libwebp are used when the engine is built
+// with them (see premake4.lua); stb_image decodes everything else.
+
+// Returns the decoder for the given data, which is stb_image if no
+// other matches
+const ImageDecoder* FindImageDecoder(const unsigned char* data, size_t size);
+
+// Decodes with the matching decoder. The channels are converted if the
+// decoder can't provide the given depth itself.
+bool DecodeImage(const unsigned char* data, size_t size, int depth,
+                 DecodedImage* image);
+
+// Reads the size without decoding anything
+bool ImageInfo(const unsigned char* data, size_t size, int* width, int* height);
+  
+}
+
+#endif // DAGON_IMAGEDECODER_H_
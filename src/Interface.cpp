@@ -65,7 +65,8 @@ void Interface::drawCursor() {
       cursorManager.updateFade(); // Process fade (supported only with bitmaps)
       cursorManager.bindImage();
       renderManager.setAlpha(cursorManager.fadeLevel());
-      renderManager.drawSlide(cursorManager.arrayOfCoords());
+      renderManager.drawSlide(cursorManager.arrayOfCoords(),
+                              cursorManager.arrayOfTexCoords());
     }
     else {
       Point position = cursorManager.position();
@@ -103,6 +104,10 @@ void Interface::drawOverlays() {
   if (!_arrayOfOverlays.empty()) {
     std::vector<Overlay*>::iterator itOverlay;
     
+    // Elements often share the page of an atlas, so we only bind
+    // textures when they change
+    Texture* boundTexture = NULL;
+    
     itOverlay = _arrayOfOverlays.begin();
     
     while (itOverlay != _arrayOfOverlays.end()) {
@@ -119,8 +124,12 @@ void Interface::drawOverlays() {
               
               if (button->hasTexture()) {
                 renderManager.setAlpha(button->fadeLevel());
-                button->texture()->bind();
-                renderManager.drawSlide(button->arrayOfCoordinates());
+                if (button->texture() != boundTexture) {
+                  button->texture()->bind();
+                  boundTexture = button->texture();
+                }
+                renderManager.drawSlide(button->arrayOfCoordinates(),
+                                        button->arrayOfTexCoords());
               }
               
               if (button->hasText()) {
@@ -132,6 +141,7 @@ void Interface::drawOverlays() {
                   renderManager.setColor(button->textColor());
                 button->font()->print(position.x, position.y, button->text().c_str());
                 renderManager.setColor(kColorWhite); // Reset the color
+                boundTexture = NULL; // Fonts bind their own textures
               }
             }
           } while ((*itOverlay)->iterateButtons());
@@ -147,9 +157,13 @@ void Interface::drawOverlays() {
             Image* image = (*itOverlay)->currentImage();
             if (image->isEnabled()) {
               image->updateFade(); // Perform any necessary updates
-              image->texture()->bind();
+              if (image->texture() != boundTexture) {
+                image->texture()->bind();
+                boundTexture = image->texture();
+              }
               renderManager.setAlpha(image->fadeLevel());
-              renderManager.drawSlide(image->arrayOfCoordinates());
+              renderManager.drawSlide(image->arrayOfCoordinates(),
+                                      image->arrayOfTexCoords());
             }
           } while ((*itOverlay)->iterateImages());
         }
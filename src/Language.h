@@ -44,6 +44,18 @@
 #define kString10003 "Error while loading compressed image"
 #define kString10004 "Unsupported number of channels in image"
 #define kString10005 "No resource found for texture"
+#define kString10006 "Could not map file"
+#define kString10007 "Corrupt texture bundle"
+#define kString10008 "Unsupported texture codec"
+#define kString10009 "Checksum mismatch in texture bundle"
+#define kString10010 "Compressed format not supported by the video card"
+#define kString10011 "Error while loading KTX texture"
+#define kString10012 "Cube maps can only be loaded from bundles"
+#define kString10013 "Image decoding kernels"
+#define kString10014 "Could not write texture cache"
+#define kString10015 "Texture memory"
+#define kString10016 "Texture cache"
+#define kString10017 "Largest textures"
 
 // Render module
 #define kString11001 "Initializing renderer..."
@@ -52,6 +64,10 @@
 #define kString11004 "Could not create framebuffer"
 #define kString11005 "GLEW version"
 #define kString11006 "OpenGL error"
+#define kString11007 "Pixel buffers not supported on this system"
+#define kString11008 "Using persistently mapped pixel buffers"
+#define kString11009 "Using streamed pixel buffers"
+#define kString11010 "Pixel buffer lost, uploading from memory"
 
 // Control module
 #define kString12001 "Dagon version"
@@ -120,6 +136,7 @@
 #define kString16008 "File not found"
 #define kString16009 "Unsupported number of channels in file"
 #define kString16010 "Unable to initialize Ogg callbacks"
+#define kString16011 "Audio voices"
 
 // Video module
 #define kString17001 "Initializing video manager..."
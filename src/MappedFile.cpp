@@ -0,0 +1,219 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include "MappedFile.h"
+#include "Platform.h"
+
+#ifdef DAGON_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+#define kPageSize 4096
+
+// Pages dropped from memory must be whole, and of the size the system uses
+static size_t SystemPageSize() {
+#ifdef DAGON_WINDOWS
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return static_cast<size_t>(info.dwPageSize);
+#else
+  long size = sysconf(_SC_PAGESIZE);
+  return (size > 0) ? static_cast<size_t>(size) : kPageSize;
+#endif
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Constructor
+////////////////////////////////////////////////////////////
+
+MappedFile::MappedFile() {
+  _data = NULL;
+  _size = 0;
+  _file = NULL;
+  _mapping = NULL;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+MappedFile::~MappedFile() {
+  this->close();
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Checks
+////////////////////////////////////////////////////////////
+
+bool MappedFile::isOpen() {
+  return (_data != NULL);
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Gets
+////////////////////////////////////////////////////////////
+
+const unsigned char* MappedFile::data() {
+  return _data;
+}
+
+size_t MappedFile::size() {
+  return _size;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - State changes
+////////////////////////////////////////////////////////////
+
+#ifdef DAGON_WINDOWS
+
+void MappedFile::close() {
+  if (_data)
+    UnmapViewOfFile(_data);
+  if (_mapping)
+    CloseHandle(static_cast<HANDLE>(_mapping));
+  if (_file)
+    CloseHandle(static_cast<HANDLE>(_file));
+  
+  _data = NULL;
+  _size = 0;
+  _file = NULL;
+  _mapping = NULL;
+}
+
+bool MappedFile::open(const std::string& fileName) {
+  this->close();
+  
+  HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+  
+  _file = file;
+  
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    this->close();
+    return false;
+  }
+  
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!mapping) {
+    this->close();
+    return false;
+  }
+  
+  _mapping = mapping;
+  _data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!_data) {
+    this->close();
+    return false;
+  }
+  
+  _size = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+#else
+
+void MappedFile::close() {
+  if (_data)
+    munmap(const_cast<unsigned char*>(_data), _size);
+  
+  _data = NULL;
+  _size = 0;
+}
+
+bool MappedFile::open(const std::string& fileName) {
+  this->close();
+  
+  int descriptor = ::open(fileName.c_str(), O_RDONLY);
+  if (descriptor < 0)
+    return false;
+  
+  struct stat info;
+  if (fstat(descriptor, &info) != 0 || info.st_size == 0) {
+    ::close(descriptor);
+    return false;
+  }
+  
+  void* data = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE,
+                    descriptor, 0);
+  
+  // The mapping remains valid after closing the descriptor
+  ::close(descriptor);
+  
+  if (data == MAP_FAILED)
+    return false;
+  
+  _data = static_cast<const unsigned char*>(data);
+  _size = static_cast<size_t>(info.st_size);
+  return true;
+}
+
+#endif
+
+void MappedFile::release(size_t offset, size_t length) {
+  if (!_data || offset >= _size)
+    return;
+  
+  if (offset + length > _size)
+    length = _size - offset;
+  
+  // Mappings start on a page, so offsets are aligned the same way
+  static const size_t pageSize = SystemPageSize();
+  size_t first = (offset + pageSize - 1) / pageSize * pageSize;
+  size_t last = (offset + length) / pageSize * pageSize;
+  if (first >= last)
+    return;
+  
+  unsigned char* data = const_cast<unsigned char*>(_data) + first;
+#ifdef DAGON_WINDOWS
+  // Unlocking pages that aren't locked removes them from the working set
+  VirtualUnlock(data, last - first);
+#else
+  madvise(data, last - first, MADV_DONTNEED);
+#endif
+}
+
+void MappedFile::touch(size_t offset, size_t length) {
+  if (!_data || offset >= _size)
+    return;
+  
+  if (offset + length > _size)
+    length = _size - offset;
+  
+  // Reading a single byte per page is enough to fault it in
+  volatile unsigned char sum = 0;
+  for (size_t i = 0; i < length; i += kPageSize)
+    sum += _data[offset + i];
+  if (length)
+    sum += _data[offset + length - 1];
+}
+  
+}
@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_MAPPEDFILE_H_
+#define DAGON_MAPPEDFILE_H_
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <string>
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////
+
+// Read-only view of a whole file mapped into memory. Pages are read
+// from disk on demand by the operating system.
+
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+  
+  // Checks
+  bool isOpen();
+  
+  // Gets
+  const unsigned char* data();
+  size_t size();
+  
+  // State changes
+  void close();
+  bool open(const std::string& fileName);
+  
+  // Lets the operating system drop the pages of the given range from
+  // memory, since they won't be needed for a while. They're read again
+  // if they are.
+  void release(size_t offset, size_t length);
+  
+  // Touches the given range so that its pages are read before they're
+  // actually needed (usually from a loader thread)
+  void touch(size_t offset, size_t length);
+  
+ private:
+  const unsigned char* _data;
+  size_t _size;
+  
+  // Native handles
+  void* _file;
+  void* _mapping;
+  
+  MappedFile(const MappedFile&);
+  void operator=(const MappedFile&);
+};
+  
+}
+
+#endif // DAGON_MAPPEDFILE_H_
@@ -20,6 +20,7 @@
 #include "Log.h"
 #include "RenderManager.h"
 #include "Texture.h"
+#include "TextureManager.h"
 
 namespace dagon {
 
@@ -34,6 +35,7 @@ log(Log::instance())
 {
   _blendTexture = NULL;
   _fadeTexture = NULL;
+  _fboTextureSize = 0;
   _fadeWithZoom = false;
   _helperLoop = 0.0f;
   
@@ -85,6 +87,10 @@ void RenderManager::init() {
   glDisable(GL_DITHER);
   
   glDisable(GL_DEPTH_TEST);
+  
+  // Filter across the edges of the faces of nodes
+  if (GLEW_VERSION_3_2 || GLEW_ARB_seamless_cube_map)
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
   //glDepthFunc(GL_ALWAYS);
   //glDepthMask(GL_TRUE);
   
@@ -104,6 +110,7 @@ void RenderManager::init() {
   glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
   
   _blendTexture = new Texture(0, 0, 0); // All default values
+  _blendTexture->setCategory(kTextureFramebuffer);
   _fadeTexture = new Texture(1, 1, 0); // Minimal black texture
   _fadeTexture->setFadeSpeed(kFadeFast);
   
@@ -131,6 +138,10 @@ void RenderManager::blendNextUpdate(bool fadeWithZoom) {
   _fadeWithZoom = fadeWithZoom;
 }
 
+bool RenderManager::isBlending() {
+  return _blendNextUpdate;
+}
+
 void RenderManager::fadeInNextUpdate() {
   _fadeTexture->fadeOut();
 }
@@ -238,6 +249,39 @@ void RenderManager::disableTextures() {
   }
 }
 
+void RenderManager::drawCube() {
+  // Same layout as the faces drawn with drawPolygon(), in the order north,
+  // east, south, west, up and down
+  static const GLfloat cubeVertCoords[] = {
+    -1,  1, -1,   1,  1, -1,   1, -1, -1,  -1, -1, -1,
+     1,  1, -1,   1,  1,  1,   1, -1,  1,   1, -1, -1,
+     1,  1,  1,  -1,  1,  1,  -1, -1,  1,   1, -1,  1,
+    -1,  1,  1,  -1,  1, -1,  -1, -1, -1,  -1, -1,  1,
+    -1,  1,  1,   1,  1,  1,   1,  1, -1,  -1,  1, -1,
+    -1, -1, -1,   1, -1, -1,   1, -1,  1,  -1, -1,  1
+  };
+  const int numCoords = sizeof(cubeVertCoords) / sizeof(GLfloat);
+  
+  // Cube maps are sampled with the direction of each vertex, with z
+  // flipped to match how faces are stored
+  GLfloat texCoords[numCoords];
+  for (int i = 0; i < numCoords; i += 3) {
+    texCoords[i] = cubeVertCoords[i];
+    texCoords[i + 1] = cubeVertCoords[i + 1];
+    texCoords[i + 2] = -cubeVertCoords[i + 2];
+  }
+  
+  glDisable(GL_TEXTURE_2D);
+  glEnable(GL_TEXTURE_CUBE_MAP);
+  
+  glTexCoordPointer(3, GL_FLOAT, 0, texCoords);
+  glVertexPointer(3, GL_FLOAT, 0, cubeVertCoords);
+  glDrawArrays(GL_QUADS, 0, numCoords / 3);
+  
+  glDisable(GL_TEXTURE_CUBE_MAP);
+  glEnable(GL_TEXTURE_2D);
+}
+
 void RenderManager::drawHelper(int xPosition, int yPosition, bool animate) {
   glDisable(GL_LINE_SMOOTH);
   
@@ -433,12 +477,15 @@ void RenderManager::drawPostprocessedView() {
   }
 }
 
-void RenderManager::drawSlide(float* withArrayOfCoordinates) {
+void RenderManager::drawSlide(float* withArrayOfCoordinates,
+                              float* withArrayOfTexCoords) {
   glPushMatrix();
   
+  GLfloat texCoords[] = {0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f};
   if (_texturesEnabled) {
-    GLfloat texCoords[] = {0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f};
-    glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
+    if (withArrayOfTexCoords)
+      glTexCoordPointer(2, GL_FLOAT, 0, withArrayOfTexCoords);
+    else glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
   }
   
   glVertexPointer(2, GL_FLOAT, 0, withArrayOfCoordinates);
@@ -587,6 +634,13 @@ void RenderManager::reshape() {
   glBindTexture(GL_TEXTURE_2D, _fboTexture);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, config.displayWidth, config.displayHeight, 0,
                GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  
+  if (_fboTextureSize) {
+    size_t size = static_cast<size_t>(config.displayWidth) * config.displayHeight * 4;
+    TextureManager::trackMemory(kTextureFramebuffer,
+                                static_cast<long>(size) - static_cast<long>(_fboTextureSize));
+    _fboTextureSize = size;
+  }
 }
 
 void RenderManager::fadeView() {
@@ -689,6 +743,8 @@ void RenderManager::_initFrameBufferTexture() {
   
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, config.displayWidth, config.displayHeight, 0,
                GL_RGBA, GL_UNSIGNED_BYTE, NULL); // Create a standard texture with the width and height of our window
+  _fboTextureSize = static_cast<size_t>(config.displayWidth) * config.displayHeight * 4;
+  TextureManager::trackMemory(kTextureFramebuffer, static_cast<long>(_fboTextureSize));
   
   // Setup the basic texture parameters
   glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -50,6 +50,7 @@ class RenderManager {
   GLuint _fbo; // The frame buffer object
   GLuint _fboDepth; // The depth buffer for the frame buffer object
   GLuint _fboTexture; // The texture object to write our frame buffer object to
+  size_t _fboTextureSize;
   
   bool _blendNextUpdate;
   float _blendOpacity;
@@ -89,6 +90,7 @@ public:
   // Control blend and fades
   
   void blendNextUpdate(bool fadeWithZoom = false);
+  bool isBlending();
   void fadeInNextUpdate();
   void fadeOutNextUpdate();
   void resetFade();
@@ -106,10 +108,12 @@ public:
   void disableAlpha();
   void disablePostprocess();
   void disableTextures();
+  void drawCube(); // Expects a cube map bound, see Texture
   void drawHelper(int xPosition, int yPosition, bool animate);
   void drawPolygon(std::vector<int> withArrayOfCoordinates, unsigned int onFace);
   void drawPostprocessedView(); // Expects orthogonal mode
-  void drawSlide(float* withArrayOfCoordinates);
+  void drawSlide(float* withArrayOfCoordinates,
+                 float* withArrayOfTexCoords = NULL); // Whole texture by default
   void setAlpha(float alpha);
   void setColor(uint32_t color, float alpha = 0);
   uint32_t    testColor(int xPosition, int yPosition);
@@ -112,7 +112,9 @@ void Scene::drawSpots(bool disableVideos) {
             else {
               // Draw right away...
               spot->texture()->bind();
-              renderManager.drawPolygon(spot->arrayOfCoordinates(), spot->face());
+              if (spot->texture()->isCubeMap())
+                renderManager.drawCube();
+              else renderManager.drawPolygon(spot->arrayOfCoordinates(), spot->face());
             }
           }
         }
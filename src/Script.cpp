@@ -22,6 +22,7 @@
 #include "Log.h"
 #include "Proxy.h"
 #include "Script.h"
+#include "TextureManager.h"
 #include "TimerManager.h"
 
 #include "Luna.h"
@@ -582,6 +583,16 @@ int Script::_globalStopTimer(lua_State *L) {
   return 0;
 }
   
+int Script::_globalTextures(lua_State *L) {
+  int numOfTextures = kTexReportEntries;
+  if (lua_isnumber(L, 1))
+    numOfTextures = static_cast<int>(lua_tonumber(L, 1));
+  
+  TextureManager::instance().report(numOfTextures);
+  
+  return 0;
+}
+
 int Script::_globalWalkTo(lua_State *L) {
   switch (DGCheckProxy(L, 1)) {
     case kObjectNode:
@@ -752,6 +763,7 @@ void Script::_registerGlobals() {
     {"switch", _globalSwitch},
     {"startTimer", _globalStartTimer},
     {"stopTimer", _globalStopTimer},
+    {"textures", _globalTextures},
     {"version", _globalVersion},
     {"walkTo", _globalWalkTo},
     {"whichRoom", _globalWhichRoom},
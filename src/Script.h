@@ -82,6 +82,7 @@ class Script {
   static int _globalSwitch(lua_State *L);
   static int _globalStartTimer(lua_State *L);
   static int _globalStopTimer(lua_State *L);
+  static int _globalTextures(lua_State *L);
   static int _globalVersion(lua_State *L);
   static int _globalWalkTo(lua_State *L);
   static int _globalWhichRoom(lua_State *L);
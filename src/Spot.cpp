@@ -21,6 +21,7 @@
 #include "Group.h"
 #include "Spot.h"
 #include "Texture.h"
+#include "TextureManager.h"
 #include "Video.h"
 
 namespace dagon {
@@ -41,6 +42,7 @@ Spot::Spot(std::vector<int> withArrayOfCoordinates,
   _hasTexture = false;
   _hasVideo = false;
   _isPlaying = false;
+  _isTextureShared = false;
   _volume = 1.0f;
   _xOrigin = 0;
   _yOrigin = 0;
@@ -55,6 +57,9 @@ Spot::Spot(std::vector<int> withArrayOfCoordinates,
 Spot::~Spot() {
   if (_hasAction)
     delete _actionData;
+  
+  if (_isTextureShared)
+    TextureManager::releaseTexture(_attachedTexture);
 }
 
 ////////////////////////////////////////////////////////////
@@ -185,8 +190,30 @@ void Spot::setOrigin(int x, int y) {
 }
 
 void Spot::setTexture(Texture* aTexture) {
+  if (_isTextureShared)
+    TextureManager::releaseTexture(_attachedTexture);
+  
   _attachedTexture = aTexture;
   _hasTexture = true;
+  _isTextureShared = false;
+}
+
+void Spot::setTexture(const std::string& fromFileName, int indexInBundle) {
+  // Spots showing the same file share its texture, which is cached like
+  // those of nodes
+  Texture* texture = TextureManager::instance().acquireTexture(fromFileName,
+                                                               indexInBundle, false);
+  texture->setCategory(kTextureNode);
+  
+  // Released only once we hold the new one, in case it's the same file
+  Texture* previousTexture = _isTextureShared ? _attachedTexture : NULL;
+  
+  _attachedTexture = texture;
+  _hasTexture = true;
+  _isTextureShared = true;
+  
+  if (previousTexture)
+    TextureManager::releaseTexture(previousTexture);
 }
 
 void Spot::setVideo(Video* aVideo) {
@@ -209,6 +236,10 @@ void Spot::play() {
   if (_hasAudio && _attachedAudio->isLoaded())
     _attachedAudio->play();
   
+  // Synced videos follow the audio of the spot, if any
+  if (_hasVideo && _attachedVideo->isSynced())
+    _attachedVideo->setClock(_hasAudio ? _attachedAudio : NULL);
+  
   if (_hasVideo && _attachedVideo->isLoaded())
     _attachedVideo->play();
   
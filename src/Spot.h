@@ -19,6 +19,7 @@
 ////////////////////////////////////////////////////////////
 
 #include <stdint.h>
+#include <string>
 #include <vector>
 
 #include "Action.h"
@@ -80,6 +81,7 @@ class Spot : public Object {
   void setColor(uint32_t theColor);
   void setOrigin(int x, int y);
   void setTexture(Texture* aTexture);
+  void setTexture(const std::string& fromFileName, int indexInBundle);
   void setVideo(Video* aVideo);
   void setVolume(float theVolume);
   
@@ -105,6 +107,7 @@ class Spot : public Object {
   bool _hasTexture;
   bool _hasVideo; 
   bool _isPlaying;
+  bool _isTextureShared;
   float _volume;
   int _xOrigin;
   int _yOrigin;
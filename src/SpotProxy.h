@@ -122,7 +122,7 @@ public:
   int attach(lua_State *L) {
     Action action;
     Audio* audio;
-    Texture* texture;
+    int indexInBundle;
     Video* video;
     
     // For the video attach, autoplay defaults to true
@@ -191,21 +191,16 @@ public:
         
         break;
       case IMAGE:
-        // FIXME: This texture isn't managed. We should be able to communicate with the
-        // texture manager, register this texture, and parse its path if necessary, OR
-        // use the Control register method.
-        
         // TODO: Decide here if we have an extension and therefore set the name or the
         // resource of the texture.
         
-        texture = new Texture;
-        texture->setResource(Config::instance().path(kPathResources, luaL_checkstring(L, 2), kObjectImage).c_str());
-        
         // If we have a third parameter, use it to set the index inside a bundle
+        indexInBundle = 0;
         if (lua_isnumber(L, 3))
-          texture->setIndexInBundle(static_cast<int>(lua_tonumber(L, 3)));
+          indexInBundle = static_cast<int>(lua_tonumber(L, 3));
         
-        s->setTexture(texture);
+        s->setTexture(Config::instance().path(kPathResources, luaL_checkstring(L, 2), kObjectImage),
+                      indexInBundle);
         break;
       case SWITCH:
         action.type = kActionSwitch;
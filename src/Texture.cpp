@@ -16,13 +16,21 @@
 ////////////////////////////////////////////////////////////
 
 #include <fstream>
-//#include <ktx.h>
 
+// GLEW must come first, since libktx includes the core profile headers
+#include <GL/glew.h>
+#include <ktx.h>
+
+#include "Bundle.h"
 #include "Config.h"
+#include "ImageDecoder.h"
 #include "Language.h"
 #include "Log.h"
+#include "MappedFile.h"
 #include "Texture.h"
-#include "stb_image.h"
+#include "TextureCache.h"
+#include "TextureManager.h"
+#include "UploadManager.h"
 
 namespace dagon {
 
@@ -30,9 +38,126 @@ namespace dagon {
 // Defines
 ////////////////////////////////////////////////////////////
 
-char TEXIdent[] = "KS_TEX"; // We keep this one for backward compatibility
 const char KTXIdent[] = { '\xAB', '\x4B', '\x54', '\x58', '\x20', '\x31', '\x31', '\xBB', '\x0D', '\x0A', '\x1A', '\x0A' };
 
+// Everything that follows the identifier in a KTX header
+typedef struct {
+  khronos_uint32_t endianness;
+  KTX_texture_info info;
+  khronos_uint32_t bytesOfKeyValueData;
+} KTXHeader;
+
+#define kKTXEndianness 0x04030201
+
+// Node faces are stored so that the cube is sampled with the direction
+// (x, y, -z), leaving adjacent faces adjacent in the cube map as well
+static const GLenum CubeMapFaces[kNumOfCubeFaces] = {
+  GL_TEXTURE_CUBE_MAP_POSITIVE_Z, // kNorth
+  GL_TEXTURE_CUBE_MAP_POSITIVE_X, // kEast
+  GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, // kSouth
+  GL_TEXTURE_CUBE_MAP_NEGATIVE_X, // kWest
+  GL_TEXTURE_CUBE_MAP_POSITIVE_Y, // kUp
+  GL_TEXTURE_CUBE_MAP_NEGATIVE_Y  // kDown
+};
+
+// Checks the compressed formats we may find in KTX files and bundles.
+// Anything else is either uncompressed, generic or unpacked by libktx.
+static bool IsFormatSupported(GLint internalFormat) {
+  switch (internalFormat) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+      return GLEW_EXT_texture_compression_s3tc ? true : false;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM_ARB:
+    case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB:
+    case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT_ARB:
+    case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_ARB:
+      return (GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc) ? true : false;
+    case GL_COMPRESSED_R11_EAC:
+    case GL_COMPRESSED_SIGNED_R11_EAC:
+    case GL_COMPRESSED_RG11_EAC:
+    case GL_COMPRESSED_SIGNED_RG11_EAC:
+    case GL_COMPRESSED_RGB8_ETC2:
+    case GL_COMPRESSED_SRGB8_ETC2:
+    case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+    case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+    case GL_COMPRESSED_RGBA8_ETC2_EAC:
+    case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+      return (GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility) ? true : false;
+    default:
+      return true;
+  }
+}
+
+// Faces of a cube map must all share the same format
+static bool HasUniformFaces(Bundle* bundle) {
+  if (bundle->numOfFaces() < kNumOfCubeFaces)
+    return false;
+  
+  for (int i = 1; i < kNumOfCubeFaces; i++) {
+    if (bundle->internalFormat(i) != bundle->internalFormat(0) ||
+        bundle->depth(i) != bundle->depth(0))
+      return false;
+  }
+  
+  return true;
+}
+
+// Frees the levels that were allocated by us
+static void FreeLevels(std::vector<TextureLevel>& arrayOfLevels) {
+  for (size_t i = 0; i < arrayOfLevels.size(); i++) {
+    if (arrayOfLevels[i].isOwned)
+      free(arrayOfLevels[i].data);
+  }
+  arrayOfLevels.clear();
+}
+
+// Reads the levels of a face from the given one onwards. Uncompressed
+// payloads are used straight from the mapping.
+static bool ReadLevels(Bundle* bundle, int face, int first,
+                       std::vector<TextureLevel>& arrayOfLevels) {
+  for (int i = first; i < bundle->numOfLevels(); i++) {
+    BundleLevel source = bundle->level(face, i);
+    if (!bundle->verify(face, i)) {
+      FreeLevels(arrayOfLevels);
+      return false;
+    }
+    
+    TextureLevel level;
+    level.width = source.width;
+    level.height = source.height;
+    level.size = static_cast<GLsizei>(source.rawSize);
+    
+    if (bundle->codec() == kTEXCodecNone) {
+      level.data = const_cast<GLubyte*>(bundle->data(face, i));
+      level.isOwned = false;
+    } else {
+      level.data = bundle->decode(face, i);
+      level.isOwned = true;
+      if (!level.data) {
+        FreeLevels(arrayOfLevels);
+        return false;
+      }
+    }
+    
+    arrayOfLevels.push_back(level);
+  }
+  
+  return true;
+}
+
+// Largest anisotropy the driver takes, or zero if it takes none
+static GLfloat MaxAnisotropy() {
+  static GLfloat maxAnisotropy = -1.0f;
+  if (maxAnisotropy < 0.0f) {
+    maxAnisotropy = 0.0f;
+    if (GLEW_EXT_texture_filter_anisotropic)
+      glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+  }
+  return maxAnisotropy;
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Constructor
 ////////////////////////////////////////////////////////////
@@ -41,9 +166,20 @@ Texture::Texture() :
 config(Config::instance()),
 log(Log::instance())
 {
+  _bitmap = NULL;
+  _bundle = NULL;
+  _category = kTextureInterface;
   _hasResource = false;
+  _indexInBundle = 0;
+  _isBitmapCompressed = false;
+  _isBitmapContainer = false;
   _isBitmapLoaded = false;
+  _isCubeMap = false;
   _isLoaded = false;
+  _isProxy = false;
+  _isRefined = false;
+  _lastUsed = 0;
+  _size = 0;
   _usageCount = 0;
   _compressionLevel = config.texCompression;
   this->setType(kObjectTexture);
@@ -82,6 +218,20 @@ log(Log::instance())
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   delete[] _bitmap;
   
+  _category = kTextureInterface;
+  _size = 0;
+  _measure();
+  _bitmap = NULL;
+  _bundle = NULL;
+  _indexInBundle = 0;
+  _isBitmapCompressed = false;
+  _isBitmapContainer = false;
+  _isBitmapLoaded = false;
+  _isCubeMap = false;
+  _isProxy = false;
+  _isRefined = false;
+  _lastUsed = 0;
+  
   // The texture doesn't require a resource, so we make it clear
   _hasResource = true;
   _isLoaded = true;
@@ -111,14 +261,51 @@ bool Texture::hasResource() {
   return _hasResource;
 }
 
+bool Texture::isBitmapLoaded() {
+  return _isBitmapLoaded;
+}
+
+bool Texture::isCubeMap() {
+  return _isCubeMap;
+}
+
 bool Texture::isLoaded() {
   return _isLoaded;
 }
 
+bool Texture::isProxy() {
+  return _isProxy;
+}
+
+bool Texture::isRefined() {
+  return _isRefined;
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Gets
 ////////////////////////////////////////////////////////////
 
+size_t Texture::bitmapSize() {
+  size_t size = 0;
+  
+  // Levels read straight from a mapped bundle take no memory of their own
+  if (SDL_LockMutex(_mutex) == 0) {
+    for (size_t i = 0; i < _arrayOfLevels.size(); i++) {
+      if (_arrayOfLevels[i].isOwned)
+        size += static_cast<size_t>(_arrayOfLevels[i].size);
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
+  }
+  
+  return size;
+}
+
+int Texture::category() {
+  return _category;
+}
+
 int Texture::depth() {
   return _depth;
 }
@@ -131,10 +318,18 @@ int Texture::height() {
   return _height;
 }
 
+unsigned int Texture::lastUsed() {
+  return _lastUsed;
+}
+
 std::string Texture::resource() {
   return _resource;
 }
 
+size_t Texture::size() {
+  return _size;
+}
+
 unsigned int Texture::usageCount() {
   return _usageCount;
 }
@@ -153,10 +348,26 @@ void Texture::increaseUsageCount() {
     _usageCount++;
 }
 
+void Texture::setCategory(int category) {
+  // Move whatever we take already to the new category
+  size_t size = _size;
+  _setSize(0);
+  _category = category;
+  _setSize(size);
+}
+
+void Texture::setCubeMap(bool enabled) {
+  _isCubeMap = enabled;
+}
+
 void Texture::setIndexInBundle(int index) {
   _indexInBundle = index;
 }
 
+void Texture::setLastUsed(unsigned int serial) {
+  _lastUsed = serial;
+}
+
 void Texture::setResource(std::string fromFileName) {
   _resource = fromFileName;
   _hasResource = true;
@@ -169,7 +380,7 @@ void Texture::setResource(std::string fromFileName) {
 void Texture::bind() {
   if (SDL_LockMutex(_mutex) == 0) {
     if (_isLoaded)
-      glBindTexture(GL_TEXTURE_2D, _ident);
+      glBindTexture(_target(), _ident);
     SDL_UnlockMutex(_mutex);
   } else {
     log.error(kModTexture, "%s", kString18002);
@@ -190,213 +401,269 @@ void Texture::clear() {
 }
 
 void Texture::load() {
-  if (SDL_LockMutex(_mutex) == 0) {
-    if (!_isLoaded) {
-      if (!_hasResource) {
-        log.error(kModTexture, "%s: %s", kString10005, this->name().c_str());
+  if (!_isLoaded || _isProxy) {
+    if (!_isBitmapLoaded)
+      this->loadBitmap();
+    
+    this->uploadBitmap();
+  }
+}
+
+void Texture::loadBitmap() {
+  if (_isBitmapLoaded || (_isLoaded && !_isProxy) || _isRefined)
+    return;
+  
+  if (!_hasResource) {
+    log.error(kModTexture, "%s: %s", kString10005, this->name().c_str());
+  }
+  
+  // Everything is decoded into local variables first and only published
+  // once it's complete, so that this can safely run in a loader thread
+  std::vector<TextureLevel> arrayOfLevels;
+  GLint width = 0, height = 0, depth = 0;
+  GLint format = 0, internalFormat = 0;
+  bool isCompressed = false;
+  bool isContainer = false;
+  
+  Bundle* bundle = NULL;
+  char magic[12]; // Used to identity file types
+  
+  // Bundles are mapped only once and shared by all their faces, so we
+  // don't open them here when the extension already tells us
+  bool isBundle = _hasBundleExtension();
+  
+  FILE* fh = NULL;
+  if (!isBundle) {
+    fh = fopen(_resource.c_str(), "rb");
+    if (fh != NULL) {
+      if (fread(&magic, sizeof(magic), 1, fh) == 0) {
+        // Couldn't read magic number
+        log.error(kModTexture, "%s: %s", kString10003, _resource.c_str());
       }
       
-      FILE* fh = fopen(_resource.c_str(), "rb");
-      if (fh != NULL) {
-        char magic[12]; // Used to identity file types
-        if (fread(&magic, sizeof(magic), 1, fh) == 0) {
-          // Couldn't read magic number
-          log.error(kModTexture, "%s: %s", kString10003, _resource.c_str());
-        }
+      if (memcmp(TEXIdent, &magic, 7) == 0 ||
+          memcmp(TEXv2Ident, &magic, 8) == 0) {
+        isBundle = true;
+        fclose(fh);
+        fh = NULL;
+      }
+    } else {
+      // File not found
+      log.error(kModTexture, "%s: %s", kString10001, _resource.c_str());
+    }
+  }
+  
+  if (_isCubeMap && !isBundle && fh != NULL) {
+    log.error(kModTexture, "%s: %s", kString10012, _resource.c_str());
+    fclose(fh);
+    fh = NULL;
+  }
+  
+  if (isBundle) { // Handle our own TEX format
+    bundle = TextureManager::instance().acquireBundle(_resource);
+    if (bundle) {
+      int firstFace = _isCubeMap ? 0 : _indexInBundle;
+      int numOfFaces = _isCubeMap ? kNumOfCubeFaces : 1;
+      
+      if (firstFace >= bundle->numOfFaces() ||
+          (_isCubeMap && !HasUniformFaces(bundle))) {
+        log.error(kModTexture, "%s: %s", kString10007, _resource.c_str());
+      }
+      else if (!IsFormatSupported(bundle->internalFormat(firstFace))) {
+        log.error(kModTexture, "%s: (%s) 0x%x", kString10010, _resource.c_str(),
+                  bundle->internalFormat(firstFace));
+      } else {
+        width = static_cast<GLint>(bundle->width());
+        height = static_cast<GLint>(bundle->height());
+        depth = bundle->depth(firstFace);
+        internalFormat = bundle->internalFormat(firstFace);
+        format = bundle->format();
+        isCompressed = bundle->isCompressed();
         
-        if (memcmp(TEXIdent, &magic, 7) == 0) { // Handle our own TEX format
-          TEXMainHeader header;
-          TEXSubHeader subheader;
-          
-          // Read the main header
-          fseek(fh, 8, SEEK_SET); // Skip identifier
-          fread(&header, 1, sizeof(header), fh);
-          _width = static_cast<GLint>(header.width);
-          _height = static_cast<GLint>(header.height);
+        for (int i = firstFace; i < firstFace + numOfFaces; i++) {
+          // Read the pages from disk now rather than while uploading
+          bundle->touch(i);
           
-          // Skip subheaders based on the index
-          if (_indexInBundle) {
-            for (int i = 0; i < _indexInBundle; i++) {
-              fread(&subheader, 1, sizeof(subheader), fh);
-              fseek(fh, sizeof(char) * subheader.size, SEEK_CUR);
+          if (!ReadLevels(bundle, i, 0, arrayOfLevels))
+            break;
+        }
+      }
+      
+      if (arrayOfLevels.empty()) {
+        TextureManager::instance().releaseBundle(bundle);
+        bundle = NULL;
+      }
+    }
+  }
+  else if (fh != NULL) {
+    if (memcmp(KTXIdent, &magic, sizeof(KTXIdent)) == 0) {
+      // libktx needs OpenGL, so we only read the file here and leave the
+      // rest to the upload
+      KTXHeader header;
+      memset(&header, 0, sizeof(header));
+      long size = 0;
+      if (fread(&header, sizeof(header), 1, fh) == 1 &&
+          fseek(fh, 0, SEEK_END) == 0)
+        size = ftell(fh);
+      
+      if (header.endianness != kKTXEndianness) {
+        // Swap the fields we look at below
+        khronos_uint32_t* field = reinterpret_cast<khronos_uint32_t*>(&header.info);
+        for (size_t i = 0; i < sizeof(header.info) / sizeof(khronos_uint32_t); i++) {
+          field[i] = ((field[i] >> 24) & 0xFF) | ((field[i] >> 8) & 0xFF00) |
+                     ((field[i] & 0xFF00) << 8) | ((field[i] & 0xFF) << 24);
+        }
+      }
+      
+      if (size <= static_cast<long>(sizeof(KTXIdent) + sizeof(header))) {
+        log.error(kModTexture, "%s: (%s) %s", kString10011, _resource.c_str(),
+                  ktxErrorString(KTX_UNEXPECTED_END_OF_FILE));
+      }
+      else if (!IsFormatSupported(header.info.glInternalFormat)) {
+        log.error(kModTexture, "%s: (%s) 0x%x", kString10010, _resource.c_str(),
+                  header.info.glInternalFormat);
+      } else {
+        TextureLevel level;
+        level.data = static_cast<GLubyte*>(malloc(size));
+        level.size = static_cast<GLsizei>(size);
+        level.width = header.info.pixelWidth;
+        level.height = header.info.pixelHeight;
+        level.isOwned = true;
+        
+        fseek(fh, 0, SEEK_SET);
+        if (level.data && fread(level.data, size, 1, fh) == 1) {
+          width = level.width;
+          height = level.height;
+          depth = (header.info.glBaseInternalFormat == GL_RGBA) ? 4 : 3;
+          format = header.info.glFormat;
+          internalFormat = header.info.glInternalFormat;
+          isCompressed = (header.info.glType == 0);
+          isContainer = true;
+          arrayOfLevels.push_back(level);
+        } else {
+          log.error(kModTexture, "%s: (%s) %s", kString10011, _resource.c_str(),
+                    ktxErrorString(KTX_UNEXPECTED_END_OF_FILE));
+          free(level.data);
+        }
+      }
+    }
+    else if (_compressionLevel &&
+             TextureCache::instance().read(_resource, arrayOfLevels,
+                                           &internalFormat, &format)) {
+      // What the driver compressed last time, so we skip decoding too
+      width = arrayOfLevels[0].width;
+      height = arrayOfLevels[0].height;
+      isCompressed = true;
+      switch (format) {
+        case GL_LUMINANCE: depth = kImageGrey; break;
+        case GL_LUMINANCE_ALPHA: depth = kImageGreyAlpha; break;
+        case GL_RGB: depth = kImageRGB; break;
+        default: depth = kImageRGBA; break;
+      }
+    } else { // Let the decoder registered for this format load the texture
+      MappedFile file;
+      DecodedImage image;
+      image.failureReason = kString10006;
+      if (file.open(_resource) && DecodeImage(file.data(), file.size(), 0, &image)) {
+        width = image.width;
+        height = image.height;
+        depth = image.depth;
+        
+        TextureLevel level;
+        level.data = image.data;
+        level.size = image.width * image.height * image.depth;
+        level.width = image.width;
+        level.height = image.height;
+        level.isOwned = true;
+        arrayOfLevels.push_back(level);
+        
+        switch (depth) {
+          case kImageGrey: {
+            format = GL_LUMINANCE;
+            if (_compressionLevel) {
+              internalFormat = GL_COMPRESSED_LUMINANCE;
+            } else {
+              internalFormat = GL_LUMINANCE;
             }
+            break;
           }
-          
-          // Read the subheader
-          fread(&subheader, 1, sizeof(subheader), fh);
-          _depth = static_cast<GLuint>(subheader.depth);
-          GLint size = static_cast<GLint>(subheader.size);
-          GLint internalFormat = static_cast<GLint>(subheader.format);
-          
-          // Get the bitmap
-          _bitmap = new GLubyte[size];
-          fread(_bitmap, 1, sizeof(GLubyte) * size, fh);
-          
-          glGenTextures(1, &_ident);
-          glBindTexture(GL_TEXTURE_2D, _ident);
-          
-          // Detect the compression level
-          if (header.compressionLevel) {
-            GLint compressed;
-            glCompressedTexImage2D(GL_TEXTURE_2D, 0, internalFormat,
-                                   _width, _height, 0, size, _bitmap);
-            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED,
-                                     &compressed);
-            if (compressed == GL_TRUE) {
-              _isLoaded = true;
+          case kImageGreyAlpha: {
+            format = GL_LUMINANCE_ALPHA;
+            if (_compressionLevel) {
+              internalFormat = GL_COMPRESSED_LUMINANCE_ALPHA;
             } else {
-              log.error(kModTexture, "%s: %s", kString10003, fh);
+              internalFormat = GL_LUMINANCE_ALPHA;
             }
-          } else {
-            // Note that we only support RGB textures
-            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, _width, _height,
-                         0, GL_RGB, GL_UNSIGNED_BYTE, _bitmap);
-            _isLoaded = true;
+            break;
           }
-          
-          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-          delete[] _bitmap;
-        } /*else if (memcmp(KTXIdent, &magic, sizeof(KTXIdent)) == 0) {
-          GLenum target = 0;
-          GLenum error = 0;
-          GLboolean mipmapped = false;
-          KTX_error_code ktxerror;
-
-          fseek(fh, 0, SEEK_SET);
-
-          ktxerror = ktxLoadTextureF(fh, &_ident, &target, NULL, &mipmapped, &error, NULL, NULL);
-
-          if (ktxerror == KTX_SUCCESS) {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-            if (mipmapped) {
-              glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+          case kImageRGB: {
+            format = GL_RGB;
+            if (_compressionLevel) {
+              internalFormat = GL_COMPRESSED_RGB;
             } else {
-              glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+              internalFormat = GL_RGB;
             }
-
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-            _isLoaded = true;
-          } else {
-            log.error(kModTexture, "KTX load error: %s", ktxerror);
-          }
-        }*/ else { // Let stb_image load the texture
-          if (!_isBitmapLoaded) {
-            fseek(fh, 0, SEEK_SET);
-            int x, y, comp;
-            _bitmap = static_cast<GLubyte*>(stbi_load_from_file(fh, &x, &y,
-                                                                &comp,
-                                                                STBI_default));
-            _width = x;
-            _height = y;
-            _depth = comp;
+            break;
           }
-          if (_bitmap) {
-            GLint format = 0, internalFormat = 0;
-            switch (_depth) {
-              case STBI_grey: {
-                format = GL_LUMINANCE;
-                if (_compressionLevel) {
-                  internalFormat = GL_COMPRESSED_LUMINANCE;
-                } else {
-                  internalFormat = GL_LUMINANCE;
-                }
-                break;
-              }
-              case STBI_grey_alpha: {
-                format = GL_LUMINANCE_ALPHA;
-                if (_compressionLevel) {
-                  internalFormat = GL_COMPRESSED_LUMINANCE_ALPHA;
-                } else {
-                  internalFormat = GL_LUMINANCE_ALPHA;
-                }
-                break;
-              }
-              case STBI_rgb: {
-                format = GL_RGB;
-                if (_compressionLevel) {
-                  internalFormat = GL_COMPRESSED_RGB;
-                } else {
-                  internalFormat = GL_RGB;
-                }
-                break;
-              }
-              case STBI_rgb_alpha: {
-                format = GL_RGBA;
-                if (_compressionLevel) {
-                  internalFormat = GL_COMPRESSED_RGBA;
-                } else {
-                  internalFormat = GL_RGBA;
-                }
-                break;
-              }
-              default: {
-                log.warning(kModTexture, "%s: (%s) %d", kString10004,
-                            _resource.c_str(), _depth);
-                break;
-              }
+          case kImageRGBA: {
+            format = GL_RGBA;
+            if (_compressionLevel) {
+              internalFormat = GL_COMPRESSED_RGBA;
+            } else {
+              internalFormat = GL_RGBA;
             }
-            glGenTextures(1, &_ident);
-            glBindTexture(GL_TEXTURE_2D, _ident);
-            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, _width, _height,
-                         0, format, GL_UNSIGNED_BYTE, _bitmap);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            free(_bitmap);
-            _isBitmapLoaded = false;
-            _isLoaded = true;
-          } else {
-            // Nothing loaded
-            log.error(kModTexture, "%s: (%s) %s", kString10002,
-                      _resource.c_str(), stbi_failure_reason());
+            break;
+          }
+          default: {
+            log.warning(kModTexture, "%s: (%s) %d", kString10004,
+                        _resource.c_str(), depth);
+            break;
           }
         }
-        fclose(fh);
       } else {
-        // File not found
-        log.error(kModTexture, "%s: %s", kString10001, _resource.c_str());
+        // Nothing loaded
+        log.error(kModTexture, "%s: (%s) %s", kString10002,
+                  _resource.c_str(), image.failureReason);
       }
     }
-    SDL_UnlockMutex(_mutex);
-  } else {
-    log.error(kModTexture, "%s", kString18002);
+    fclose(fh);
   }
-}
-
-void Texture::loadBitmap() {
-  FILE* fh = fopen(_resource.c_str(), "rb");
-  if (fh != NULL) {
-    int x, y, comp;
-    _bitmap = static_cast<GLubyte*>(stbi_load_from_file(fh, &x, &y,
-                                                        &comp, STBI_default));
-    _width = x;
-    _height = y;
-    _depth = comp;
-    _isBitmapLoaded = true;
+  
+  if (!arrayOfLevels.empty()) {
+    if (SDL_LockMutex(_mutex) == 0) {
+      _arrayOfLevels = arrayOfLevels;
+      _bundle = bundle;
+      _width = width;
+      _height = height;
+      _depth = depth;
+      _format = format;
+      _internalFormat = internalFormat;
+      _isBitmapCompressed = isCompressed;
+      _isBitmapContainer = isContainer;
+      _isBitmapLoaded = true;
+      SDL_UnlockMutex(_mutex);
+    } else {
+      log.error(kModTexture, "%s", kString18002);
+      FreeLevels(arrayOfLevels);
+      if (bundle)
+        TextureManager::instance().releaseBundle(bundle);
+    }
   }
 }
 
 void Texture::loadFromMemory(const unsigned char* dataToLoad, long size) {
   if (!_isLoaded) {
-    int x, y, comp;
-    _bitmap = static_cast<GLubyte*>(stbi_load_from_memory(dataToLoad, (int)size,
-                                                          &x, &y, &comp,
-                                                          STBI_default));
-    if (_bitmap) {
-      _width = x;
-      _height = y;
-      _depth = comp;
+    DecodedImage image;
+    if (DecodeImage(dataToLoad, static_cast<size_t>(size), 0, &image)) {
+      _bitmap = image.data;
+      _width = image.width;
+      _height = image.height;
+      _depth = image.depth;
+      int comp = image.depth;
       
       GLint format = 0, internalFormat = 0;
       switch (comp) {
-        case STBI_grey: {
+        case kImageGrey: {
           format = GL_LUMINANCE;
           if (_compressionLevel) {
             internalFormat = GL_COMPRESSED_LUMINANCE;
@@ -405,7 +672,7 @@ void Texture::loadFromMemory(const unsigned char* dataToLoad, long size) {
           }
           break;
         }
-        case STBI_grey_alpha: {
+        case kImageGreyAlpha: {
           format = GL_LUMINANCE_ALPHA;
           if (_compressionLevel) {
             internalFormat = GL_COMPRESSED_LUMINANCE_ALPHA;
@@ -414,7 +681,7 @@ void Texture::loadFromMemory(const unsigned char* dataToLoad, long size) {
           }
           break;
         }
-        case STBI_rgb: {
+        case kImageRGB: {
           format = GL_RGB;
           if (_compressionLevel) {
             internalFormat = GL_COMPRESSED_RGB;
@@ -423,7 +690,7 @@ void Texture::loadFromMemory(const unsigned char* dataToLoad, long size) {
           }
           break;
         }
-        case STBI_rgb_alpha: {
+        case kImageRGBA: {
           format = GL_RGBA;
           if (_compressionLevel) {
             internalFormat = GL_COMPRESSED_RGBA;
@@ -445,24 +712,92 @@ void Texture::loadFromMemory(const unsigned char* dataToLoad, long size) {
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      _measure();
       _isLoaded = true;
       free(_bitmap);
+      _bitmap = NULL;
     } else {
       // Nothing loaded
-      log.error(kModTexture, "%s: %s", kString10002, stbi_failure_reason());
+      log.error(kModTexture, "%s: %s", kString10002, image.failureReason);
     }
   }
 }
 
+bool Texture::loadProxy() {
+  if (_isLoaded || _isBitmapLoaded || !config.texProxySize || !_hasBundleExtension())
+    return false;
+  
+  Bundle* bundle = TextureManager::instance().acquireBundle(_resource);
+  if (!bundle)
+    return false;
+  
+  // Pick the smallest level that is still as large as requested
+  std::vector<TextureLevel> arrayOfLevels;
+  int firstFace = _isCubeMap ? 0 : _indexInBundle;
+  int numOfFaces = _isCubeMap ? kNumOfCubeFaces : 1;
+  if (firstFace < bundle->numOfFaces() && (!_isCubeMap || HasUniformFaces(bundle)) &&
+      IsFormatSupported(bundle->internalFormat(firstFace))) {
+    int first = 0;
+    for (int i = 1; i < bundle->numOfLevels(); i++) {
+      BundleLevel level = bundle->level(firstFace, i);
+      if (level.width < config.texProxySize || level.height < config.texProxySize)
+        break;
+      first = i;
+    }
+    
+    for (int i = firstFace; first > 0 && i < firstFace + numOfFaces; i++) {
+      if (!ReadLevels(bundle, i, first, arrayOfLevels))
+        break;
+    }
+  }
+  
+  if (!arrayOfLevels.empty()) {
+    if (SDL_LockMutex(_mutex) == 0) {
+      // A loader thread may have beaten us
+      if (!_isLoaded && !_isBitmapLoaded) {
+        _width = static_cast<GLint>(bundle->width());
+        _height = static_cast<GLint>(bundle->height());
+        _depth = bundle->depth(firstFace);
+        _format = bundle->format();
+        _internalFormat = bundle->internalFormat(firstFace);
+        _isBitmapCompressed = bundle->isCompressed();
+        
+        GLuint ident;
+        glGenTextures(1, &ident);
+        if (_upload(ident, arrayOfLevels)) {
+          _ident = ident;
+          _isLoaded = true;
+          _isProxy = true;
+          _measure();
+        }
+        else glDeleteTextures(1, &ident);
+      }
+      SDL_UnlockMutex(_mutex);
+    } else {
+      log.error(kModTexture, "%s", kString18002);
+    }
+  }
+  
+  FreeLevels(arrayOfLevels);
+  TextureManager::instance().releaseBundle(bundle);
+  
+  return _isProxy;
+}
+
 void Texture::loadRawData(const unsigned char* dataToLoad,
                           int withWidth, int andHeight) {
   // Mostly useful to load frames from Video.
   // Note it defaults to inverted RGB.
+  UploadManager& uploadManager = UploadManager::instance();
+  size_t size = static_cast<size_t>(withWidth) * andHeight * 3;
+  
   if (!_isLoaded) {
+    _category = kTextureVideo;
     glGenTextures(1, &_ident);
     glBindTexture(GL_TEXTURE_2D, _ident);
     glTexImage2D(GL_TEXTURE_2D, 0, 3, withWidth, andHeight,
-                 0, GL_BGR, GL_UNSIGNED_BYTE, dataToLoad);
+                 0, GL_BGR, GL_UNSIGNED_BYTE, uploadManager.stage(dataToLoad, size));
+    uploadManager.finish();
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -470,16 +805,36 @@ void Texture::loadRawData(const unsigned char* dataToLoad,
     _width = withWidth;
     _height = andHeight;
     _depth = 24;
+    _measure();
     _isLoaded = true;
   } else {
     glBindTexture(GL_TEXTURE_2D, _ident);
 	//log.trace(kModTexture, "Copying data...");
+    // The frame is copied into a pixel buffer and transferred while the
+    // scene is drawn
     glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, withWidth, andHeight,
-                    GL_BGR, GL_UNSIGNED_BYTE, dataToLoad);
+                    GL_BGR, GL_UNSIGNED_BYTE, uploadManager.stage(dataToLoad, size));
+    uploadManager.finish();
 	//log.trace(kModTexture, "Done copying!");
   }
 }
 
+void Texture::refine() {
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_isRefined) {
+      glDeleteTextures(1, &_ident);
+      _ident = _refinedIdent;
+      _isProxy = false;
+      _isRefined = false;
+      glBindTexture(_target(), _ident);
+      _measure();
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
+  }
+}
+
 void Texture::saveToFile(std::string fileName){
   // NOTE: Always saves in TGA format
   if (_isLoaded) {
@@ -518,12 +873,288 @@ void Texture::saveToFile(std::string fileName){
 }
 
 void Texture::unload() {
-  if (_isLoaded) {
-    glDeleteTextures(1, &_ident);
-    _usageCount = 0;
-    _isBitmapLoaded = false;
-    _isLoaded = false;
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_isBitmapLoaded)
+      _releaseBitmap();
+    
+    if (_isRefined) {
+      glDeleteTextures(1, &_refinedIdent);
+      _isRefined = false;
+    }
+    
+    if (_isLoaded) {
+      glDeleteTextures(1, &_ident);
+      _setSize(0);
+      _usageCount = 0;
+      _isLoaded = false;
+      _isProxy = false;
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
   }
 }
+
+void Texture::unloadBitmap() {
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_isBitmapLoaded)
+      _releaseBitmap();
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
+  }
+}
+
+void Texture::uploadBitmap() {
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_isBitmapLoaded && (!_isLoaded || _isProxy) && !_isRefined) {
+      GLuint ident;
+      glGenTextures(1, &ident);
+      
+      bool isUploaded = false;
+      if (_isBitmapContainer) {
+        const TextureLevel& file = _arrayOfLevels[0];
+        GLenum target = 0, error = 0;
+        GLboolean isMipmapped = GL_FALSE;
+        KTX_dimensions dimensions;
+        KTX_error_code result = ktxLoadTextureM(file.data, file.size, &ident,
+                                                &target, &dimensions,
+                                                &isMipmapped, &error,
+                                                NULL, NULL);
+        if (result == KTX_SUCCESS && target == GL_TEXTURE_2D) {
+          _width = dimensions.width;
+          _height = dimensions.height;
+          isUploaded = true;
+          
+          // Count the levels that were actually loaded or generated
+          GLint numOfLevels = 1;
+          while (isMipmapped && numOfLevels < 16) {
+            GLint levelWidth = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, numOfLevels,
+                                     GL_TEXTURE_WIDTH, &levelWidth);
+            if (!levelWidth)
+              break;
+            numOfLevels++;
+          }
+          
+          _setParameters(GL_TEXTURE_2D, numOfLevels);
+        } else {
+          // We only support plain 2D textures
+          if (result == KTX_SUCCESS)
+            result = KTX_UNSUPPORTED_TEXTURE_TYPE;
+          log.error(kModTexture, "%s: (%s) %s", kString10011,
+                    _resource.c_str(), ktxErrorString(result));
+        }
+      }
+      else {
+        isUploaded = _upload(ident, _arrayOfLevels);
+        
+        // Keep what the driver made of the image for the next time
+        if (isUploaded && _compressionLevel && !_isBitmapCompressed &&
+            !_bundle && !_isCubeMap)
+          TextureCache::instance().write(_resource, _format);
+      }
+      
+      if (!isUploaded) {
+        glDeleteTextures(1, &ident);
+      }
+      else if (_isProxy) {
+        // Keep drawing the proxy until we're told to replace it
+        _refinedIdent = ident;
+        _isRefined = true;
+      } else {
+        _ident = ident;
+        _isLoaded = true;
+        _measure();
+      }
+      
+      // The bitmap is no longer needed once it's in video memory
+      _releaseBitmap();
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
+  }
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+bool Texture::_hasBundleExtension() {
+  return (_resource.size() > 4 &&
+          (_resource.compare(_resource.size() - 4, 4, ".tex") == 0 ||
+           _resource.compare(_resource.size() - 4, 4, ".TEX") == 0));
+}
+
+// Measures the footprint of the texture currently bound, including its
+// mipmaps
+void Texture::_measure() {
+  size_t size = 0;
+  
+  // All the faces of a cube map are alike, so we measure one
+  GLenum target = _isCubeMap ? CubeMapFaces[0] : GL_TEXTURE_2D;
+  
+  GLint compressed = GL_FALSE;
+  glGetTexLevelParameteriv(target, 0, GL_TEXTURE_COMPRESSED, &compressed);
+  
+  for (GLint level = 0; level < 16; level++) {
+    GLint width = 0, height = 0;
+    glGetTexLevelParameteriv(target, level, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(target, level, GL_TEXTURE_HEIGHT, &height);
+    if (!width || !height)
+      break;
+    
+    if (compressed == GL_TRUE) {
+      GLint levelSize = 0;
+      glGetTexLevelParameteriv(target, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &levelSize);
+      size += static_cast<size_t>(levelSize);
+    } else {
+      // Add up the bits of every component actually stored by the driver
+      GLenum components[] = {GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE,
+        GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_LUMINANCE_SIZE};
+      GLint bits = 0;
+      for (int i = 0; i < 5; i++) {
+        GLint componentBits = 0;
+        glGetTexLevelParameteriv(target, level, components[i], &componentBits);
+        bits += componentBits;
+      }
+      size += static_cast<size_t>(width) * height * ((bits + 7) / 8);
+    }
+  }
+  
+  if (_isCubeMap)
+    size *= kNumOfCubeFaces;
+  
+  _setSize(size);
+}
+
+// Callers hold our mutex, as loader threads may be publishing levels
+void Texture::_releaseBitmap() {
+  FreeLevels(_arrayOfLevels);
+  
+  // Levels from bundles may point straight into the mapped file
+  if (_bundle) {
+    TextureManager::instance().releaseBundle(_bundle);
+    _bundle = NULL;
+  }
+  
+  _isBitmapLoaded = false;
+}
+
+// Sets the filters of the texture currently bound. Images that come
+// without a chain get one from the driver, so that faces don't shimmer
+// when minified.
+void Texture::_setParameters(GLenum target, GLint numOfLevels) {
+  bool isMipmapped = (numOfLevels > 1);
+  if (!isMipmapped && config.texMipmaps && (GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object)) {
+    // Compressed formats can't be rendered to, so drivers may refuse them
+    GLint compressed = GL_FALSE;
+    glGetTexLevelParameteriv(_isCubeMap ? CubeMapFaces[0] : GL_TEXTURE_2D, 0,
+                             GL_TEXTURE_COMPRESSED, &compressed);
+    if (compressed != GL_TRUE) {
+      glGenerateMipmap(target);
+      isMipmapped = true;
+    }
+  }
+  
+  // Chains may stop before 1x1, so we tell where they end
+  if (numOfLevels > 1)
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, numOfLevels - 1);
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER,
+                  isMipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  
+  // Faces seen at an angle near the edges of the view stay sharp
+  GLfloat anisotropy = static_cast<GLfloat>(config.texAnisotropy);
+  if (isMipmapped && anisotropy > 1.0f && MaxAnisotropy() > 1.0f) {
+    if (anisotropy > MaxAnisotropy())
+      anisotropy = MaxAnisotropy();
+    glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+  }
+}
+
+// Keeps the texture manager informed of the memory we take
+void Texture::_setSize(size_t size) {
+  if (size != _size) {
+    TextureManager::trackTexture(this, _size, size);
+    _size = size;
+  }
+}
+
+GLenum Texture::_target() {
+  return _isCubeMap ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+}
+
+// Uploads the levels into the given texture, which is left bound. Cube
+// maps take as many levels for each of their faces.
+bool Texture::_upload(GLuint ident, const std::vector<TextureLevel>& arrayOfLevels) {
+  GLint numOfFaces = _isCubeMap ? kNumOfCubeFaces : 1;
+  GLint numOfLevels = static_cast<GLint>(arrayOfLevels.size()) / numOfFaces;
+  GLint count = numOfFaces * numOfLevels;
+  GLenum target = _target();
+  glBindTexture(target, ident);
+  
+  // The whole chain goes into one pixel buffer, so that we don't wait
+  // on the transfer of each level before copying the next one
+  UploadManager& uploadManager = UploadManager::instance();
+  std::vector<const GLvoid*> arrayOfPixels(count);
+  size_t size = 0;
+  for (GLint i = 0; i < count; i++)
+    size += arrayOfLevels[i].size;
+  
+  GLubyte* staging = uploadManager.map(size);
+  size_t offset = 0;
+  for (GLint i = 0; i < count; i++) {
+    const TextureLevel& level = arrayOfLevels[i];
+    if (staging) {
+      memcpy(staging + offset, level.data, level.size);
+      arrayOfPixels[i] = static_cast<const GLubyte*>(NULL) + offset;
+    }
+    else arrayOfPixels[i] = level.data;
+    offset += level.size;
+  }
+  
+  // Read from client memory after all if the copy was lost
+  if (staging && !uploadManager.unmap()) {
+    for (GLint i = 0; i < count; i++)
+      arrayOfPixels[i] = arrayOfLevels[i].data;
+  }
+  
+  if (_isBitmapCompressed) {
+    for (GLint i = 0; i < count; i++) {
+      const TextureLevel& level = arrayOfLevels[i];
+      GLenum face = _isCubeMap ? CubeMapFaces[i / numOfLevels] : GL_TEXTURE_2D;
+      glCompressedTexImage2D(face, i % numOfLevels, _internalFormat,
+                             level.width, level.height, 0,
+                             level.size, arrayOfPixels[i]);
+    }
+    uploadManager.finish();
+    
+    GLint compressed;
+    glGetTexLevelParameteriv(_isCubeMap ? CubeMapFaces[0] : GL_TEXTURE_2D, 0,
+                             GL_TEXTURE_COMPRESSED, &compressed);
+    if (compressed != GL_TRUE) {
+      log.error(kModTexture, "%s: %s", kString10003, _resource.c_str());
+      return false;
+    }
+  } else {
+    // Rows of smaller levels are rarely aligned to four bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (GLint i = 0; i < count; i++) {
+      const TextureLevel& level = arrayOfLevels[i];
+      GLenum face = _isCubeMap ? CubeMapFaces[i / numOfLevels] : GL_TEXTURE_2D;
+      glTexImage2D(face, i % numOfLevels, _internalFormat, level.width,
+                   level.height, 0, _format, GL_UNSIGNED_BYTE, arrayOfPixels[i]);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    uploadManager.finish();
+  }
+  
+  _setParameters(target, numOfLevels);
+  return true;
+}
   
 }
@@ -19,6 +19,7 @@
 ////////////////////////////////////////////////////////////
 
 #include <string>
+#include <vector>
 
 #include <GL/glew.h>
 #include <SDL2/SDL_mutex.h>
@@ -31,27 +32,32 @@ namespace dagon {
 // Definitions
 ////////////////////////////////////////////////////////////
 
-// TODO: We should convert all short vars to int for better speed here,
-// also read new defines.
+// Faces of the cube maps holding whole nodes
+#define kNumOfCubeFaces 6
 
-typedef struct {
-  char name[80];
-  short width;
-  short height;
-  short compressionLevel; // 0: None, 1: GL only, 2: GL & zlib
-  short numTextures;
-} TEXMainHeader;
-
-typedef struct {
-  short cubePosition;
-  short depth;
-  int size;
-  int format;
-} TEXSubHeader;
+// What textures are used for, so that we can break down the video
+// memory we take
+enum TextureCategories {
+  kTextureNode = 0,
+  kTextureInterface, // Overlays, buttons, cursors and effects
+  kTextureFont,
+  kTextureVideo,
+  kTextureFramebuffer,
+  kNumOfTextureCategories
+};
 
+class Bundle;
 class Config;
 class Log;
 
+typedef struct {
+  GLubyte* data;
+  GLsizei size;
+  GLint width;
+  GLint height;
+  bool isOwned; // Levels from bundles may point into the mapped file
+} TextureLevel;
+
 ////////////////////////////////////////////////////////////
 // Interface
 ////////////////////////////////////////////////////////////
@@ -64,26 +70,52 @@ class Texture : public Object {
   
   // Checks
   bool hasResource();
+  bool isBitmapLoaded();
+  bool isCubeMap();
   bool isLoaded();
+  bool isProxy(); // Only a small level is loaded so far
+  bool isRefined(); // The full texture is uploaded and waiting to replace the proxy
   
   // Gets
+  size_t bitmapSize(); // Bytes of decoded levels held in memory
+  int category();
   int depth();
   int indexInBundle();
   int height();
+  unsigned int lastUsed();
   std::string resource();
+  size_t size(); // Bytes taken in video memory
   unsigned int usageCount();
   int width();
   
   // Sets
   void increaseUsageCount();
+  
+  // Textures are accounted as interface elements unless told otherwise
+  void setCategory(int category);
+  
+  // Cube maps take the six faces of a bundle at once and ignore the index
+  void setCubeMap(bool enabled);
   void setIndexInBundle(int index);
+  void setLastUsed(unsigned int serial);
   void setResource(std::string fromFileName);
   
   // State changes
   void bind();
   void clear();
   void load();
-  void loadBitmap(); // Temporary to test preloader
+  
+  // Loading is split in two steps: loadBitmap() decodes the file into
+  // memory and may be called from any thread, while uploadBitmap() sends
+  // the decoded data to OpenGL and must be called from the main thread.
+  void loadBitmap();
+  void uploadBitmap();
+  
+  // Proxies are small levels taken from bundles with mipmaps, uploaded
+  // right away so that nodes can be drawn while their full textures are
+  // decoded. Once uploaded, those wait for refine() to replace the proxy.
+  bool loadProxy();
+  void refine();
   
   // Textures loaded from memory are not managed
   void loadFromMemory(const unsigned char* dataToLoad, long size);
@@ -91,20 +123,34 @@ class Texture : public Object {
                    int withWidth, int andHeight);
   void saveToFile(std::string fileName);
   void unload();
+  void unloadBitmap();
   
  private:
   Config& config;
   Log& log;
   
+  std::vector<TextureLevel> _arrayOfLevels; // Decoded mip chain, one per face
   GLubyte* _bitmap;
+  Bundle* _bundle; // Set while levels point into a mapped bundle
+  int _category;
   unsigned int _compressionLevel;
   GLint _depth;
+  GLint _format;
   bool _hasResource;
   GLint _height;
   GLuint _ident;
+  GLuint _refinedIdent;
   int _indexInBundle;
+  GLint _internalFormat;
+  bool _isBitmapCompressed;
+  bool _isBitmapContainer; // The bitmap holds a whole KTX file
   bool _isBitmapLoaded;
+  bool _isCubeMap;
   bool _isLoaded;
+  bool _isProxy;
+  bool _isRefined;
+  unsigned int _lastUsed; // Serial of the last switch that requested it
+  size_t _size;
   unsigned int _usageCount; // Used to keep track of the most used textures
   GLint _width;
   
@@ -112,6 +158,14 @@ class Texture : public Object {
   // Eventually all file management will be handled by a ResourceManager object
   std::string _resource;
   
+  bool _hasBundleExtension();
+  void _measure();
+  void _releaseBitmap();
+  void _setParameters(GLenum target, GLint numOfLevels);
+  void _setSize(size_t size);
+  GLenum _target();
+  bool _upload(GLuint ident, const std::vector<TextureLevel>& arrayOfLevels);
+  
   Texture(const Texture&);
   void operator=(const Texture&);
 };
@@ -0,0 +1,277 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "Compression.h"
+#include "Config.h"
+#include "Log.h"
+#include "TextureCache.h"
+
+#ifdef DAGON_WINDOWS
+#include <direct.h>
+#endif
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Same limit as everywhere else we walk a mip chain
+#define kTexCacheMaxLevels 16
+
+static void FreeCachedLevels(std::vector<TextureLevel>& arrayOfLevels) {
+  for (size_t i = 0; i < arrayOfLevels.size(); i++)
+    free(arrayOfLevels[i].data);
+  arrayOfLevels.clear();
+}
+
+static std::string GLString(GLenum name) {
+  const GLubyte* value = glGetString(name);
+  return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Constructor
+////////////////////////////////////////////////////////////
+
+TextureCache::TextureCache() :
+config(Config::instance()),
+log(Log::instance())
+{
+  _isEnabled = false;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+TextureCache::~TextureCache() {
+  // Nothing to do here
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Checks
+////////////////////////////////////////////////////////////
+
+bool TextureCache::isEnabled() {
+  return _isEnabled;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - State changes
+////////////////////////////////////////////////////////////
+
+void TextureCache::init() {
+  _isEnabled = false;
+  if (!config.texCompression || !config.texCompressionCache)
+    return;
+  
+  // Reading back compressed images came along with compression itself
+  if (!GLEW_VERSION_1_3 && !GLEW_ARB_texture_compression)
+    return;
+  
+  _renderer = GLString(GL_VENDOR) + "/" + GLString(GL_RENDERER) + "/" +
+              GLString(GL_VERSION);
+  _directory = config.path(kPathUserData, kTexCacheDirectory, kObjectGeneric);
+  
+#ifdef DAGON_WINDOWS
+  _mkdir(_directory.c_str());
+#else
+  mkdir(_directory.c_str(), 0755);
+#endif
+  
+  struct stat info;
+  if (stat(_directory.c_str(), &info) != 0 || !(info.st_mode & S_IFDIR)) {
+    log.warning(kModTexture, "%s: %s", kString10014, _directory.c_str());
+    return;
+  }
+  
+  _isEnabled = true;
+}
+
+bool TextureCache::read(const std::string& resource,
+                        std::vector<TextureLevel>& arrayOfLevels,
+                        GLint* internalFormat, GLint* format) {
+  if (!_isEnabled)
+    return false;
+  
+  std::string key = _key(resource);
+  if (key.empty())
+    return false;
+  
+  FILE* fh = fopen(_fileName(resource).c_str(), "rb");
+  if (!fh)
+    return false;
+  
+  // Anything unexpected is a miss, the entry is replaced after decoding
+  TexCacheHeader header;
+  bool success = (fread(&header, sizeof(header), 1, fh) == 1 &&
+                  memcmp(header.ident, kTexCacheIdent, sizeof(header.ident)) == 0 &&
+                  header.version == kTexCacheVersion && header.keySize == key.size() &&
+                  header.numOfLevels > 0 && header.numOfLevels <= kTexCacheMaxLevels);
+  
+  if (success) {
+    std::vector<char> storedKey(key.size());
+    success = (fread(&storedKey[0], storedKey.size(), 1, fh) == 1 &&
+               memcmp(&storedKey[0], key.data(), key.size()) == 0);
+  }
+  
+  std::vector<TextureLevel> arrayOfCachedLevels;
+  for (uint32_t i = 0; success && i < header.numOfLevels; i++) {
+    TexCacheLevel entry;
+    success = (fread(&entry, sizeof(entry), 1, fh) == 1 && entry.size > 0);
+    if (!success)
+      break;
+    
+    TextureLevel level;
+    level.data = static_cast<GLubyte*>(malloc(entry.size));
+    level.size = static_cast<GLsizei>(entry.size);
+    level.width = static_cast<GLint>(entry.width);
+    level.height = static_cast<GLint>(entry.height);
+    level.isOwned = true;
+    if (!level.data)
+      success = false;
+    else {
+      arrayOfCachedLevels.push_back(level);
+      success = (fread(level.data, entry.size, 1, fh) == 1);
+    }
+  }
+  
+  fclose(fh);
+  
+  if (!success) {
+    FreeCachedLevels(arrayOfCachedLevels);
+    return false;
+  }
+  
+  arrayOfLevels.insert(arrayOfLevels.end(), arrayOfCachedLevels.begin(),
+                       arrayOfCachedLevels.end());
+  *internalFormat = static_cast<GLint>(header.internalFormat);
+  *format = static_cast<GLint>(header.format);
+  return true;
+}
+
+void TextureCache::write(const std::string& resource, GLint format) {
+  if (!_isEnabled)
+    return;
+  
+  // The driver is free to ignore our request
+  GLint compressed = GL_FALSE;
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+  if (compressed != GL_TRUE)
+    return;
+  
+  std::string key = _key(resource);
+  if (key.empty())
+    return;
+  
+  GLint internalFormat = 0;
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+  
+  std::vector<TexCacheLevel> arrayOfEntries;
+  std::vector<GLubyte> payload;
+  for (GLint level = 0; level < kTexCacheMaxLevels; level++) {
+    GLint width = 0, height = 0, size = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+    if (!width || !height)
+      break;
+    
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+    if (size <= 0)
+      return;
+    
+    TexCacheLevel entry;
+    entry.width = static_cast<uint32_t>(width);
+    entry.height = static_cast<uint32_t>(height);
+    entry.size = static_cast<uint32_t>(size);
+    arrayOfEntries.push_back(entry);
+    
+    size_t offset = payload.size();
+    payload.resize(offset + size);
+    glGetCompressedTexImage(GL_TEXTURE_2D, level, &payload[offset]);
+  }
+  
+  if (arrayOfEntries.empty())
+    return;
+  
+  TexCacheHeader header;
+  memcpy(header.ident, kTexCacheIdent, sizeof(header.ident));
+  header.version = kTexCacheVersion;
+  header.keySize = static_cast<uint32_t>(key.size());
+  header.internalFormat = static_cast<uint32_t>(internalFormat);
+  header.format = static_cast<uint32_t>(format);
+  header.numOfLevels = static_cast<uint32_t>(arrayOfEntries.size());
+  
+  // Write elsewhere first, so that loader threads never see half an entry
+  std::string fileName = _fileName(resource);
+  std::string temporaryName = fileName + ".tmp";
+  FILE* fh = fopen(temporaryName.c_str(), "wb");
+  if (!fh) {
+    log.warning(kModTexture, "%s: %s", kString10014, temporaryName.c_str());
+    return;
+  }
+  
+  bool success = (fwrite(&header, sizeof(header), 1, fh) == 1 &&
+                  fwrite(key.data(), key.size(), 1, fh) == 1);
+  size_t offset = 0;
+  for (size_t i = 0; success && i < arrayOfEntries.size(); i++) {
+    success = (fwrite(&arrayOfEntries[i], sizeof(TexCacheLevel), 1, fh) == 1 &&
+               fwrite(&payload[offset], arrayOfEntries[i].size, 1, fh) == 1);
+    offset += arrayOfEntries[i].size;
+  }
+  
+  if (fclose(fh) != 0)
+    success = false;
+  
+  // Windows won't rename over an existing file
+  remove(fileName.c_str());
+  if (!success || rename(temporaryName.c_str(), fileName.c_str()) != 0) {
+    log.warning(kModTexture, "%s: %s", kString10014, fileName.c_str());
+    remove(temporaryName.c_str());
+  }
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+// One entry per image and renderer, so that an entry is replaced rather
+// than left behind when the image changes
+std::string TextureCache::_fileName(const std::string& resource) {
+  std::string name = resource + "|" + _renderer;
+  char hash[16];
+  snprintf(hash, sizeof(hash), "%08x", Checksum(reinterpret_cast<const unsigned char*>(name.data()),
+                                                name.size()));
+  return _directory + "/" + hash + kTexCacheExtension;
+}
+
+std::string TextureCache::_key(const std::string& resource) {
+  struct stat info;
+  if (stat(resource.c_str(), &info) != 0)
+    return "";
+  
+  char attributes[64];
+  snprintf(attributes, sizeof(attributes), "|%ld|%ld", static_cast<long>(info.st_mtime),
+           static_cast<long>(info.st_size));
+  return resource + attributes + "|" + _renderer;
+}
+  
+}
@@ -0,0 +1,110 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_TEXTURECACHE_H_
+#define DAGON_TEXTURECACHE_H_
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "Platform.h"
+#include "Texture.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Bump the version whenever the layout below changes, so that stale
+// files are simply ignored
+#define kTexCacheIdent "DGTC"
+#define kTexCacheVersion 1
+#define kTexCacheDirectory "texcache"
+#define kTexCacheExtension ".dtc"
+
+// The header is followed by the key (not terminated), then every level
+// as a TexCacheLevel and its payload
+typedef struct {
+  char ident[4];
+  uint32_t version;
+  uint32_t keySize;
+  uint32_t internalFormat;
+  uint32_t format;
+  uint32_t numOfLevels;
+} TexCacheHeader;
+
+typedef struct {
+  uint32_t width;
+  uint32_t height;
+  uint32_t size;
+} TexCacheLevel;
+
+class Config;
+class Log;
+
+////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////
+
+// Keeps what the driver made of textures it was asked to compress, so
+// that the slow compression is done only once. Entries are keyed by the
+// path and modification time of the image and by the renderer, since
+// each driver picks its own formats.
+class TextureCache {
+  Config& config;
+  Log& log;
+  
+  std::string _directory;
+  bool _isEnabled;
+  std::string _renderer;
+  
+  std::string _fileName(const std::string& resource);
+  std::string _key(const std::string& resource);
+  
+  TextureCache();
+  TextureCache(TextureCache const&);
+  TextureCache& operator=(TextureCache const&);
+  ~TextureCache();
+  
+public:
+  static TextureCache& instance() {
+    static TextureCache textureCache;
+    return textureCache;
+  }
+  
+  // Checks
+  bool isEnabled();
+  
+  // State changes
+  void init();
+  
+  // Reads the cached levels of an image, if there's an entry and the
+  // image hasn't changed since. Safe to call from the loader threads.
+  bool read(const std::string& resource, std::vector<TextureLevel>& arrayOfLevels,
+            GLint* internalFormat, GLint* format);
+  
+  // Reads back the levels of the bound texture and stores them with the
+  // given pixel format, if the driver did compress it
+  void write(const std::string& resource, GLint format);
+};
+  
+}
+
+#endif // DAGON_TEXTURECACHE_H_
@@ -15,11 +15,19 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <SDL2/SDL_timer.h>
+
+#include "Action.h"
+#include "Bundle.h"
+#include "CameraManager.h"
 #include "Config.h"
+#include "DecodeKernels.h"
 #include "Log.h"
 #include "Node.h"
 #include "Room.h"
 #include "Spot.h"
+#include "stb_image.h"
+#include "TextureCache.h"
 #include "TextureManager.h"
 
 namespace dagon {
@@ -28,17 +36,63 @@ namespace dagon {
 // Definitions
 ////////////////////////////////////////////////////////////
 
-bool TextureSort(Texture* t1, Texture* t2);
+// Textures owned by other singletons or by Lua objects may be released
+// after we're gone, so we only keep track of them while we're around
+static bool IsTracking = false;
+
+static const char* CategoryNames[kNumOfTextureCategories] = {
+  "nodes", "interface", "fonts", "video", "framebuffers"
+};
+
+static bool IsLarger(Texture* first, Texture* second) {
+  return first->size() > second->size();
+}
+
+static double Megabytes(size_t bytes) {
+  return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+// Bytes a texture is expected to take in memory before it's decoded,
+// assuming uncompressed faces of the default size
+static size_t EstimatedSize(Texture* texture) {
+  size_t size = static_cast<size_t>(kDefTexSize) * kDefTexSize * 3;
+  return texture->isCubeMap() ? size * kNumOfCubeFaces : size;
+}
+
+// Faces taken from bundles are textures of their own
+static std::string TextureKey(const std::string& fileName, int indexInBundle) {
+  if (!indexInBundle)
+    return fileName;
+  
+  char index[16];
+  snprintf(index, sizeof(index), "#%d", indexInBundle);
+  return fileName + index;
+}
 
 ////////////////////////////////////////////////////////////
 // Implementation - Constructor
 ////////////////////////////////////////////////////////////
 
 TextureManager::TextureManager() :
+cameraManager(CameraManager::instance()),
 config(Config::instance()),
 log(Log::instance())
 {
-  _roomToPreload = NULL;
+  _cacheSize = 0;
+  _cacheEvictions = 0;
+  _cacheHits = 0;
+  _cacheMisses = 0;
+  _switchSerial = 0;
+  _isRunning = false;
+  _currentNode = NULL;
+  _prefetchQuadrant = -1;
+  for (int i = 0; i < kNumOfTextureCategories; i++)
+    _arrayOfMemory[i] = 0;
+  IsTracking = true;
+  _condition = SDL_CreateCond();
+  _mutex = SDL_CreateMutex();
+  if (!_mutex)
+    log.error(kModTexture, "%s", kString18001);
 }
 
 ////////////////////////////////////////////////////////////
@@ -56,12 +110,145 @@ TextureManager::~TextureManager() {
       ++it;
     }
   }
+  
+  SDL_DestroyCond(_condition);
+  SDL_DestroyMutex(_mutex);
+  IsTracking = false;
 }
 
 ////////////////////////////////////////////////////////////
-// Implementation
+// Implementation - Checks
 ////////////////////////////////////////////////////////////
 
+bool TextureManager::isRefinementReady() {
+  if (_arrayOfProxyTextures.empty())
+    return false;
+  
+  std::vector<Texture*>::iterator it = _arrayOfProxyTextures.begin();
+  while (it != _arrayOfProxyTextures.end()) {
+    if (!(*it)->isRefined())
+      return false;
+    ++it;
+  }
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Gets
+////////////////////////////////////////////////////////////
+
+unsigned int TextureManager::cacheEvictions() {
+  return _cacheEvictions;
+}
+
+unsigned int TextureManager::cacheHits() {
+  return _cacheHits;
+}
+
+unsigned int TextureManager::cacheMisses() {
+  return _cacheMisses;
+}
+
+size_t TextureManager::cacheSize() {
+  return _cacheSize;
+}
+
+size_t TextureManager::memoryUsed() {
+  size_t total = 0;
+  for (int i = 0; i < kNumOfTextureCategories; i++)
+    total += _arrayOfMemory[i];
+  return total;
+}
+
+size_t TextureManager::memoryUsed(int category) {
+  return _arrayOfMemory[category];
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Sets
+////////////////////////////////////////////////////////////
+
+void TextureManager::setCurrentNode(Node* theNode) {
+  // Proxies we leave behind are no longer on screen, so the rest are
+  // replaced as soon as they're uploaded
+  this->refine();
+  _arrayOfProxyTextures.clear();
+  
+  _currentNode = theNode;
+  _prefetchQuadrant = -1; // Forces a new ranking in the next update
+  _switchSerial++;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - State changes
+////////////////////////////////////////////////////////////
+
+Bundle* TextureManager::acquireBundle(const std::string& fileName) {
+  Bundle* bundle = NULL;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    std::map<std::string, Bundle*>::iterator it = _mapOfBundles.find(fileName);
+    if (it != _mapOfBundles.end()) {
+      bundle = it->second;
+    }
+    else {
+      bundle = new Bundle;
+      if (bundle->open(fileName)) {
+        _mapOfBundles[fileName] = bundle;
+      }
+      else {
+        delete bundle;
+        bundle = NULL;
+      }
+    }
+    
+    if (bundle)
+      bundle->retain();
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
+  }
+  
+  return bundle;
+}
+
+Texture* TextureManager::acquireTexture(const std::string& fileName, int indexInBundle,
+                                        bool isPinned) {
+  std::string key = TextureKey(fileName, indexInBundle);
+  Texture* texture;
+  
+  std::map<std::string, Texture*>::iterator it = _mapOfTextures.find(key);
+  if (it != _mapOfTextures.end()) {
+    texture = it->second;
+  }
+  else {
+    texture = new Texture;
+    texture->setResource(fileName);
+    texture->setIndexInBundle(indexInBundle);
+    _mapOfTextures[key] = texture;
+  }
+  
+  texture->retain();
+  if (isPinned)
+    _pin(texture);
+  
+  return texture;
+}
+
+void TextureManager::releaseBundle(Bundle* theBundle) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    theBundle->release();
+    if (theBundle->retainCount() == 0) {
+      _mapOfBundles.erase(theBundle->resource());
+      delete theBundle;
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
+  }
+}
+
 void TextureManager::appendTextureToBundle(const char* nameOfBundle, Texture* textureToAppend) {
   // This function will store individual textures to a bundle
 }
@@ -76,26 +263,141 @@ int TextureManager::itemsInBundle(const char* nameOfBundle) {
 }
 
 void TextureManager::flush() {
-  // This function is called every time a switch is performed
-  // and unloads the least used textures when necessary
-  
-  long texturesToUnload = _arrayOfActiveTextures.size() - kMaxActiveTextures;
+  // This function is called every time a switch is performed and after
+  // uploading new textures. It unloads the least recently used textures
+  // until the cache fits in its budget, breaking ties with the least used
+  // ones. Textures of the current node are never unloaded.
+  size_t budget = static_cast<size_t>(config.texCacheSize) * 1024 * 1024;
   
-  while (texturesToUnload > 0) {
-    _arrayOfActiveTextures.front()->unload();
-    _arrayOfActiveTextures.erase(_arrayOfActiveTextures.begin());
+  while (_cacheSize > budget) {
+    std::vector<Texture*>::iterator victim = _arrayOfActiveTextures.end();
+    std::vector<Texture*>::iterator it = _arrayOfActiveTextures.begin();
     
-    texturesToUnload--;
+    while (it != _arrayOfActiveTextures.end()) {
+      if ((*it)->lastUsed() != _switchSerial) {
+        if (victim == _arrayOfActiveTextures.end() ||
+            (*it)->lastUsed() < (*victim)->lastUsed() ||
+            ((*it)->lastUsed() == (*victim)->lastUsed() &&
+             (*it)->usageCount() < (*victim)->usageCount()))
+          victim = it;
+      }
+      ++it;
+    }
+    
+    // Everything left is pinned
+    if (victim == _arrayOfActiveTextures.end())
+      break;
+    
+    // Make sure no loader is decoding it and it isn't uploaded again
+    Texture* target = *victim;
+    _arrayOfActiveTextures.erase(victim);
+    _dequeue(target);
+    _arrayOfProxyTextures.erase(std::remove(_arrayOfProxyTextures.begin(),
+                                            _arrayOfProxyTextures.end(), target),
+                                _arrayOfProxyTextures.end());
+    
+    _cacheSize -= target->size();
+    target->unload();
+    _cacheEvictions++;
   }
 }
 
 void TextureManager::init() {
-  /*_preloaderThread = thread([&](){
-   chrono::milliseconds dura(1);
-   while (TextureManager::instance().updatePreloader()) {
-   this_thread::sleep_for(dura);
-   }
-   });*/
+  _isRunning = true;
+  
+  // Pick the decoding routines and build the shared decoding tables
+  // before any loader thread starts
+  stbi_init();
+  const char* kernels = InstallDecodeKernels(DetectCPUFeatures());
+  log.trace(kModTexture, "%s: %s", kString10013, kernels);
+  
+  // Needs the renderer, so the context must be current by now
+  TextureCache::instance().init();
+  
+  // Textures are decoded by a pool of loader threads. If none are
+  // configured we simply load everything in the main thread.
+  for (int i = 0; i < config.numOfTexLoaders; i++) {
+    SDL_Thread* thread = SDL_CreateThread(_runThread, "TextureManager", (void*)NULL);
+    if (thread) {
+      _arrayOfThreads.push_back(thread);
+    } else {
+      log.error(kModTexture, "%s:%s", kString18003, SDL_GetError());
+    }
+  }
+}
+
+bool TextureManager::loadIntoAtlas(const std::string& fileName, AtlasRegion* region) {
+  return _atlas.insert(fileName, region);
+}
+
+void TextureManager::releaseFromAtlas(const std::string& fileName) {
+  if (IsTracking)
+    TextureManager::instance()._atlas.release(fileName);
+}
+
+void TextureManager::queueTexture(Texture* target) {
+  if ((target->isLoaded() && !target->isProxy()) || _arrayOfThreads.empty()) {
+    this->requestTexture(target);
+    return;
+  }
+  
+  target->setLastUsed(_switchSerial);
+  _cacheMisses++;
+  
+  // Draw something right away unless the full texture is about to be
+  // uploaded anyway
+  if (!target->isLoaded() && !target->isBitmapLoaded() && target->loadProxy())
+    _activate(target);
+  
+  if (target->isProxy() &&
+      std::find(_arrayOfProxyTextures.begin(), _arrayOfProxyTextures.end(),
+                target) == _arrayOfProxyTextures.end())
+    _arrayOfProxyTextures.push_back(target);
+  
+  // Already uploaded and only waiting to replace its proxy
+  if (target->isRefined())
+    return;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (std::find(_arrayOfRequestedTextures.begin(), _arrayOfRequestedTextures.end(),
+                  target) == _arrayOfRequestedTextures.end()) {
+      _arrayOfRequestedTextures.push_back(target);
+      
+      // Textures that were already decoded, or are being decoded right now,
+      // simply wait for their upload
+      if (!target->isBitmapLoaded() &&
+          std::find(_arrayOfDecodingTextures.begin(), _arrayOfDecodingTextures.end(),
+                    target) == _arrayOfDecodingTextures.end()) {
+        std::deque<Texture*>::iterator it = std::find(_arrayOfPendingTextures.begin(),
+                                                      _arrayOfPendingTextures.end(), target);
+        if (it != _arrayOfPendingTextures.end())
+          _arrayOfPendingTextures.erase(it);
+        
+        // Latest requests always go first
+        _arrayOfPendingTextures.push_front(target);
+        SDL_CondBroadcast(_condition);
+      }
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
+  }
+}
+
+// Replaces every proxy of the current node that has its full texture
+// uploaded. Called from the main thread, usually right before a blend.
+void TextureManager::refine() {
+  std::vector<Texture*> arrayOfProxyTextures;
+  arrayOfProxyTextures.swap(_arrayOfProxyTextures);
+  
+  std::vector<Texture*>::iterator it = arrayOfProxyTextures.begin();
+  while (it != arrayOfProxyTextures.end()) {
+    if ((*it)->isRefined())
+      _refine(*it);
+    else
+      _arrayOfProxyTextures.push_back(*it);
+    ++it;
+  }
 }
 
 void TextureManager::registerTexture(Texture* target) {
@@ -120,15 +422,102 @@ void TextureManager::registerTexture(Texture* target) {
     target->setResource(config.path(kPathResources, fileToLoad, kObjectNode).c_str());
   }
   
+  target->setCategory(kTextureNode);
   _arrayOfTextures.push_back(target);
   
   // Nothing to do for now
   // It's the responsibility of another module to generate the res path accordingly
 }
 
+void TextureManager::releaseTexture(Texture* target) {
+  if (!IsTracking)
+    return;
+  
+  target->release();
+  if (target->retainCount() > 0)
+    return;
+  
+  // Make sure nothing refers to the texture anymore
+  TextureManager& textureManager = TextureManager::instance();
+  textureManager._mapOfTextures.erase(TextureKey(target->resource(), target->indexInBundle()));
+  textureManager._dequeue(target);
+  
+  std::vector<Texture*>& arrayOfActiveTextures = textureManager._arrayOfActiveTextures;
+  std::vector<Texture*>::iterator it = std::find(arrayOfActiveTextures.begin(),
+                                                 arrayOfActiveTextures.end(), target);
+  if (it != arrayOfActiveTextures.end()) {
+    textureManager._cacheSize -= target->size();
+    arrayOfActiveTextures.erase(it);
+  }
+  
+  std::vector<Texture*>& arrayOfProxyTextures = textureManager._arrayOfProxyTextures;
+  arrayOfProxyTextures.erase(std::remove(arrayOfProxyTextures.begin(),
+                                         arrayOfProxyTextures.end(), target),
+                             arrayOfProxyTextures.end());
+  
+  std::vector<Texture*>& arrayOfPrefetchedTextures = textureManager._arrayOfPrefetchedTextures;
+  arrayOfPrefetchedTextures.erase(std::remove(arrayOfPrefetchedTextures.begin(),
+                                              arrayOfPrefetchedTextures.end(), target),
+                                  arrayOfPrefetchedTextures.end());
+  
+  delete target;
+}
+
+void TextureManager::report(int numOfTextures) {
+  log.info(kModTexture, "%s: %.1f MB", kString10015, Megabytes(this->memoryUsed()));
+  for (int i = 0; i < kNumOfTextureCategories; i++)
+    log.info(kModTexture, "  %s: %.1f MB", CategoryNames[i], Megabytes(_arrayOfMemory[i]));
+  
+  log.info(kModTexture, "%s: %.1f of %d MB (hits: %u, misses: %u, evictions: %u)",
+           kString10016, Megabytes(_cacheSize), config.texCacheSize,
+           _cacheHits, _cacheMisses, _cacheEvictions);
+  
+  // Taken before our mutex, since textures lock theirs first
+  size_t prefetchedSize = _prefetchedSize();
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    log.info(kModTexture, "  pending: %d, decoding: %d, uploading: %d, proxies: %d, "
+             "prefetched: %d (%.1f MB), bundles: %d",
+             static_cast<int>(_arrayOfPendingTextures.size()),
+             static_cast<int>(_arrayOfDecodingTextures.size()),
+             static_cast<int>(_arrayOfRequestedTextures.size()),
+             static_cast<int>(_arrayOfProxyTextures.size()),
+             static_cast<int>(_arrayOfPrefetchedTextures.size()),
+             Megabytes(prefetchedSize),
+             static_cast<int>(_mapOfBundles.size()));
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
+  }
+  
+  std::vector<Texture*> arrayOfTextures = _arrayOfResidentTextures;
+  size_t count = std::min(arrayOfTextures.size(), static_cast<size_t>(std::max(numOfTextures, 0)));
+  std::partial_sort(arrayOfTextures.begin(), arrayOfTextures.begin() + count,
+                    arrayOfTextures.end(), IsLarger);
+  
+  log.info(kModTexture, "%s: %d of %d", kString10017, static_cast<int>(count),
+           static_cast<int>(arrayOfTextures.size()));
+  for (size_t i = 0; i < count; i++) {
+    Texture* texture = arrayOfTextures[i];
+    std::string name = texture->resource();
+    if (name.empty())
+      name = texture->name();
+    
+    log.info(kModTexture, "  %.2f MB, %dx%d, %s: %s%s", Megabytes(texture->size()),
+             texture->width(), texture->height(), CategoryNames[texture->category()],
+             name.c_str(), texture->isProxy() ? " (proxy)" : "");
+  }
+}
+
 void TextureManager::requestBundle(Node* forNode) {
   if (forNode->hasBundleName()) {
-    for (int i = 0; i < 6; i++) {
+    // Whole bundles are stored in a single cube map and drawn at once.
+    // Otherwise each face is loaded from its own file.
+    bool isCubeMap = config.bundleEnabled &&
+                     (GLEW_VERSION_1_3 || GLEW_ARB_texture_cube_map);
+    int numOfSpots = isCubeMap ? 1 : kNumOfCubeFaces;
+    
+    for (int i = 0; i < numOfSpots; i++) {
       std::vector<int> arrayOfCoordinates;
       // We ensure the texture is properly stretched, so we take the default cube size
       // TODO: This setting should be obtained from the Config class
@@ -140,7 +529,9 @@ void TextureManager::requestBundle(Node* forNode) {
       Texture* texture = new Texture;
       
       spot->setTexture(texture);
-      spot->texture()->setIndexInBundle(i);
+      if (isCubeMap)
+        spot->texture()->setCubeMap(true);
+      else spot->texture()->setIndexInBundle(i);
       
       // In this case, the filename is generated from the name
       // of the texture
@@ -156,54 +547,437 @@ void TextureManager::requestBundle(Node* forNode) {
 }
 
 void TextureManager::requestTexture(Texture* target) {
+  target->setLastUsed(_switchSerial);
+  
   if (!target->isLoaded()) {
+    // Ensure no loader thread is working on this texture. If it was
+    // already decoded, only the upload takes place here.
+    _dequeue(target);
     target->load();
     
-    _arrayOfActiveTextures.push_back(target);
+    _activate(target);
+    _cacheMisses++;
   }
+  else if (target->isProxy()) {
+    // Same as above, but the full texture replaces the proxy at once
+    _dequeue(target);
+    target->load();
+    
+    _refine(target);
+    _cacheMisses++;
+  }
+  else _cacheHits++;
   
   target->increaseUsageCount();
+}
+
+void TextureManager::terminate() {
+  if (SDL_LockMutex(_mutex) == 0) {
+    _isRunning = false;
+    _arrayOfPendingTextures.clear();
+    SDL_CondBroadcast(_condition);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
+  }
+  
+  int threadReturnValue;
+  std::vector<SDL_Thread*>::iterator it = _arrayOfThreads.begin();
+  while (it != _arrayOfThreads.end()) {
+    SDL_WaitThread(*it, &threadReturnValue);
+    ++it;
+  }
+  _arrayOfThreads.clear();
   
-  sort(_arrayOfActiveTextures.begin(), _arrayOfActiveTextures.end(), TextureSort);
+  _atlas.unload();
 }
 
-void TextureManager::setRoomToPreload(Room* theRoom) {
-  _roomToPreload = theRoom;
+void TextureManager::trackMemory(int category, long bytes) {
+  if (IsTracking)
+    TextureManager::instance()._arrayOfMemory[category] += bytes;
 }
 
-bool TextureManager::updatePreloader() {
-  if (_roomToPreload) {
-    if (_roomToPreload->hasNodes()) {
-      _roomToPreload->beginIteratingNodes();
-      do {
-        Node* node = _roomToPreload->iterator();
-        if (node->hasSpots()) {
-          node->beginIteratingSpots();
-          do {
-            Spot* spot = node->currentSpot();
-            
-            if (spot->hasTexture()) {
-              if (!spot->texture()->isLoaded()) {
-                spot->texture()->loadBitmap();
-                
-                //_arrayOfActiveTextures.push_back(spot->texture());
-              }
-            }
-          } while (node->iterateSpots());
+void TextureManager::trackTexture(Texture* target, size_t previousSize, size_t size) {
+  if (!IsTracking)
+    return;
+  
+  TextureManager& textureManager = TextureManager::instance();
+  textureManager._arrayOfMemory[target->category()] += size - previousSize;
+  
+  std::vector<Texture*>& arrayOfTextures = textureManager._arrayOfResidentTextures;
+  if (!previousSize) {
+    arrayOfTextures.push_back(target);
+  }
+  else if (!size) {
+    arrayOfTextures.erase(std::find(arrayOfTextures.begin(), arrayOfTextures.end(), target));
+  }
+}
+
+// Called once per frame from the main thread
+void TextureManager::update() {
+  if (_currentNode && !_arrayOfThreads.empty()) {
+    // Rank the neighbours again whenever the camera faces another direction
+    int quadrant = (((cameraManager.angleHorizontal() % 360) + 405) % 360) / 90;
+    if (quadrant != _prefetchQuadrant) {
+      _prefetchQuadrant = quadrant;
+      _prefetch();
+    }
+  }
+  
+  if (_arrayOfRequestedTextures.empty())
+    return;
+  
+  std::vector<Texture*> arrayOfReadyTextures;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    std::vector<Texture*>::iterator it = _arrayOfRequestedTextures.begin();
+    while (it != _arrayOfRequestedTextures.end()) {
+      Texture* texture = *it;
+      
+      if (texture->isBitmapLoaded()) {
+        // Keep the upload budget so that we never stall the frame
+        if (static_cast<int>(arrayOfReadyTextures.size()) < config.texUploadsPerFrame) {
+          arrayOfReadyTextures.push_back(texture);
+          it = _arrayOfRequestedTextures.erase(it);
         }
-      } while (_roomToPreload->iterateNodes());
+        else ++it;
+      }
+      else if (std::find(_arrayOfPendingTextures.begin(), _arrayOfPendingTextures.end(),
+                         texture) == _arrayOfPendingTextures.end() &&
+               std::find(_arrayOfDecodingTextures.begin(), _arrayOfDecodingTextures.end(),
+                         texture) == _arrayOfDecodingTextures.end()) {
+        // Decoding failed (the error was logged by the texture), so we give
+        // up and keep any proxy
+        std::vector<Texture*>::iterator jt = std::find(_arrayOfProxyTextures.begin(),
+                                                       _arrayOfProxyTextures.end(), texture);
+        if (jt != _arrayOfProxyTextures.end())
+          _arrayOfProxyTextures.erase(jt);
+        
+        it = _arrayOfRequestedTextures.erase(it);
+      }
+      else ++it;
     }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
   }
   
-  return true;
+  std::vector<Texture*>::iterator it = arrayOfReadyTextures.begin();
+  while (it != arrayOfReadyTextures.end()) {
+    Texture* texture = *it;
+    
+    if (texture->isProxy()) {
+      texture->uploadBitmap();
+      
+      // Proxies that aren't on screen are simply replaced
+      if (std::find(_arrayOfProxyTextures.begin(), _arrayOfProxyTextures.end(),
+                    texture) == _arrayOfProxyTextures.end())
+        _refine(texture);
+    } else {
+      texture->uploadBitmap();
+      _activate(texture);
+    }
+    
+    texture->increaseUsageCount();
+    ++it;
+  }
+  
+  if (!arrayOfReadyTextures.empty())
+    this->flush();
+}
+
+// Asynchronous method
+bool TextureManager::updateLoader() {
+  Texture* target = NULL;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    while (_isRunning && _arrayOfPendingTextures.empty())
+      SDL_CondWait(_condition, _mutex);
+    
+    if (_isRunning) {
+      target = _arrayOfPendingTextures.front();
+      _arrayOfPendingTextures.pop_front();
+      _arrayOfDecodingTextures.push_back(target);
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
+    SDL_Delay(1);
+  }
+  
+  if (target) {
+    target->loadBitmap();
+    
+    if (SDL_LockMutex(_mutex) == 0) {
+      _arrayOfDecodingTextures.erase(std::find(_arrayOfDecodingTextures.begin(),
+                                               _arrayOfDecodingTextures.end(), target));
+      SDL_CondBroadcast(_condition);
+      SDL_UnlockMutex(_mutex);
+    } else {
+      log.error(kModTexture, "%s", kString18002);
+    }
+  }
+  
+  return _isRunning;
 }
 
 ////////////////////////////////////////////////////////////
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
-bool TextureSort(Texture* t1, Texture* t2) {
-  return t1->usageCount() < t2->usageCount();
+void TextureManager::_activate(Texture* target) {
+  if (target->isLoaded()) {
+    _arrayOfActiveTextures.push_back(target);
+    _cacheSize += target->size();
+  }
+}
+
+void TextureManager::_dequeue(Texture* target) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    std::deque<Texture*>::iterator it = std::find(_arrayOfPendingTextures.begin(),
+                                                  _arrayOfPendingTextures.end(), target);
+    if (it != _arrayOfPendingTextures.end())
+      _arrayOfPendingTextures.erase(it);
+    
+    std::vector<Texture*>::iterator jt = std::find(_arrayOfRequestedTextures.begin(),
+                                                   _arrayOfRequestedTextures.end(), target);
+    if (jt != _arrayOfRequestedTextures.end())
+      _arrayOfRequestedTextures.erase(jt);
+    
+    // Wait until any loader thread is done with it
+    while (std::find(_arrayOfDecodingTextures.begin(), _arrayOfDecodingTextures.end(),
+                     target) != _arrayOfDecodingTextures.end())
+      SDL_CondWait(_condition, _mutex);
+    
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
+  }
+}
+
+void TextureManager::_pin(Texture* target) {
+  // Out of the cache for good, so that it's never unloaded
+  std::vector<Texture*>::iterator it = std::find(_arrayOfActiveTextures.begin(),
+                                                 _arrayOfActiveTextures.end(), target);
+  if (it != _arrayOfActiveTextures.end()) {
+    _cacheSize -= target->size();
+    _arrayOfActiveTextures.erase(it);
+  }
+  
+  if (!target->isLoaded() || target->isProxy()) {
+    _dequeue(target);
+    target->load();
+    
+    // Already uploaded by a loader and waiting to replace the proxy
+    if (target->isRefined())
+      target->refine();
+    
+    it = std::find(_arrayOfProxyTextures.begin(), _arrayOfProxyTextures.end(), target);
+    if (it != _arrayOfProxyTextures.end())
+      _arrayOfProxyTextures.erase(it);
+  }
+}
+
+void TextureManager::_prefetch() {
+  std::vector<Node*> arrayOfNodes;
+  std::vector<float> arrayOfScores;
+  
+  // Nodes linked from the current one are weighted by the camera facing,
+  // while those two links away are only likely enough to fill the gaps
+  _rankLinks(_currentNode, cameraManager.angleHorizontal(), 1.0f,
+             arrayOfNodes, arrayOfScores);
+  
+  size_t neighbours = arrayOfNodes.size();
+  for (size_t i = 0; i < neighbours; i++) {
+    _rankLinks(arrayOfNodes[i], -1, arrayOfScores[i] * kPrefetchFalloff,
+               arrayOfNodes, arrayOfScores);
+  }
+  
+  // Pick the best candidates and gather their textures
+  std::vector<Texture*> arrayOfTextures;
+  for (int n = 0; n < config.numOfPrefetchedNodes; n++) {
+    int best = -1;
+    for (size_t i = 0; i < arrayOfNodes.size(); i++) {
+      if (arrayOfScores[i] > 0.0f && (best < 0 || arrayOfScores[i] > arrayOfScores[best]))
+        best = static_cast<int>(i);
+    }
+    
+    if (best < 0)
+      break;
+    
+    Node* node = arrayOfNodes[best];
+    arrayOfScores[best] = 0.0f;
+    
+    if (node->hasSpots()) {
+      node->beginIteratingSpots();
+      do {
+        Spot* spot = node->currentSpot();
+        if (spot->hasTexture() && spot->texture()->hasResource())
+          arrayOfTextures.push_back(spot->texture());
+      } while (node->iterateSpots());
+    }
+  }
+  
+  // Decoded bitmaps wait in memory until their node is entered, so they
+  // get a budget of their own the size of the cache. The best ranked are
+  // kept and the rest dropped, whether decoded already or not.
+  size_t budget = static_cast<size_t>(config.texCacheSize) * 1024 * 1024;
+  size_t size = 0;
+  size_t numOfTextures = 0;
+  while (numOfTextures < arrayOfTextures.size()) {
+    Texture* texture = arrayOfTextures[numOfTextures];
+    size_t bitmapSize = 0;
+    if (texture->isBitmapLoaded())
+      bitmapSize = texture->bitmapSize();
+    else if (!texture->isLoaded() || texture->isProxy())
+      bitmapSize = EstimatedSize(texture);
+    
+    if (size + bitmapSize > budget)
+      break;
+    
+    size += bitmapSize;
+    numOfTextures++;
+  }
+  arrayOfTextures.resize(numOfTextures);
+  
+  std::vector<Texture*> arrayOfDiscardedTextures;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    // Discard the bitmaps we no longer expect to need
+    std::vector<Texture*>::iterator it = _arrayOfPrefetchedTextures.begin();
+    while (it != _arrayOfPrefetchedTextures.end()) {
+      Texture* texture = *it;
+      
+      if (std::find(arrayOfTextures.begin(), arrayOfTextures.end(),
+                    texture) == arrayOfTextures.end() &&
+          std::find(_arrayOfRequestedTextures.begin(), _arrayOfRequestedTextures.end(),
+                    texture) == _arrayOfRequestedTextures.end()) {
+        std::deque<Texture*>::iterator jt = std::find(_arrayOfPendingTextures.begin(),
+                                                      _arrayOfPendingTextures.end(), texture);
+        if (jt != _arrayOfPendingTextures.end())
+          _arrayOfPendingTextures.erase(jt);
+        
+        if (std::find(_arrayOfDecodingTextures.begin(), _arrayOfDecodingTextures.end(),
+                      texture) == _arrayOfDecodingTextures.end())
+          arrayOfDiscardedTextures.push_back(texture);
+      }
+      
+      ++it;
+    }
+    
+    // Requested textures are always queued before these
+    it = arrayOfTextures.begin();
+    while (it != arrayOfTextures.end()) {
+      Texture* texture = *it;
+      
+      if (!texture->isLoaded() && !texture->isBitmapLoaded() &&
+          std::find(_arrayOfPendingTextures.begin(), _arrayOfPendingTextures.end(),
+                    texture) == _arrayOfPendingTextures.end() &&
+          std::find(_arrayOfDecodingTextures.begin(), _arrayOfDecodingTextures.end(),
+                    texture) == _arrayOfDecodingTextures.end())
+        _arrayOfPendingTextures.push_back(texture);
+      
+      ++it;
+    }
+    
+    SDL_CondBroadcast(_condition);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModTexture, "%s", kString18002);
+  }
+  
+  // Outside the lock, since releasing a bitmap may release its bundle
+  std::vector<Texture*>::iterator it = arrayOfDiscardedTextures.begin();
+  while (it != arrayOfDiscardedTextures.end()) {
+    (*it)->unloadBitmap();
+    ++it;
+  }
+  
+  _arrayOfPrefetchedTextures = arrayOfTextures;
+}
+
+size_t TextureManager::_prefetchedSize() {
+  size_t size = 0;
+  std::vector<Texture*>::iterator it = _arrayOfPrefetchedTextures.begin();
+  while (it != _arrayOfPrefetchedTextures.end()) {
+    size += (*it)->bitmapSize();
+    ++it;
+  }
+  
+  return size;
+}
+
+void TextureManager::_refine(Texture* target) {
+  if (!target->isRefined())
+    return;
+  
+  size_t previousSize = target->size();
+  target->refine();
+  _cacheSize = _cacheSize - previousSize + target->size();
+  
+  std::vector<Texture*>::iterator it = std::find(_arrayOfProxyTextures.begin(),
+                                                 _arrayOfProxyTextures.end(), target);
+  if (it != _arrayOfProxyTextures.end())
+    _arrayOfProxyTextures.erase(it);
+}
+
+void TextureManager::_rankLinks(Node* fromNode, int facing, float weight,
+                                std::vector<Node*>& arrayOfNodes,
+                                std::vector<float>& arrayOfScores) {
+  if (!fromNode->hasSpots())
+    return;
+  
+  fromNode->beginIteratingSpots();
+  do {
+    Spot* spot = fromNode->currentSpot();
+    
+    if (!spot->hasAction())
+      continue;
+    
+    Action* action = spot->action();
+    if (action->type != kActionSwitch || !action->target)
+      continue;
+    
+    Node* node = NULL;
+    switch (action->target->type()) {
+      case kObjectNode:
+      case kObjectSlide:
+        node = static_cast<Node*>(action->target);
+        break;
+      case kObjectRoom:
+        node = static_cast<Room*>(action->target)->currentNode();
+        break;
+    }
+    
+    if (!node || node == _currentNode)
+      continue;
+    
+    // Links in front of the camera are the most likely to be followed next
+    float score = weight;
+    if (facing >= 0) {
+      if (spot->face() <= kWest) {
+        float difference = static_cast<float>((facing - spot->face() * 90) * M_PI / 180.0);
+        score = weight * (2.0f + cosf(difference)) / 3.0f;
+      }
+      else score = weight * 2.0f / 3.0f;
+    }
+    
+    std::vector<Node*>::iterator it = std::find(arrayOfNodes.begin(), arrayOfNodes.end(), node);
+    if (it == arrayOfNodes.end()) {
+      arrayOfNodes.push_back(node);
+      arrayOfScores.push_back(score);
+    }
+    else {
+      size_t index = it - arrayOfNodes.begin();
+      if (score > arrayOfScores[index])
+        arrayOfScores[index] = score;
+    }
+  } while (fromNode->iterateSpots());
+}
+
+int TextureManager::_runThread(void *ptr) {
+  while (TextureManager::instance().updateLoader()) {}
+  return 0;
 }
   
 }
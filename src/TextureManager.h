@@ -18,6 +18,13 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <deque>
+#include <map>
+
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+
+#include "Atlas.h"
 #include "Platform.h"
 #include "Texture.h"
 
@@ -27,17 +34,17 @@ namespace dagon {
 // Definitions
 ////////////////////////////////////////////////////////////
 
-// TODO: This class should be a singleton
+// Weight of nodes two links away when ranking candidates to prefetch
+#define kPrefetchFalloff 0.25f
 
-// This is temporary until we actually test how much memory is available.
-// NOT accurate! It's only a reference value since textures are flushed
-// before the next switch.
-#define kMaxActiveTextures 18
+// Largest textures listed in the report unless told otherwise
+#define kTexReportEntries 10
 
+class Bundle;
+class CameraManager;
 class Config;
 class Log;
 class Node;
-class Room;
 
 // This temporary macro is used to generate filenames
 #define mkstr(a) # a
@@ -48,13 +55,63 @@ class Room;
 ////////////////////////////////////////////////////////////
 
 class TextureManager {
+  CameraManager& cameraManager;
   Config& config;
   Log& log;
   
+  // Video memory taken by each category and the textures taking it
+  size_t _arrayOfMemory[kNumOfTextureCategories];
+  std::vector<Texture*> _arrayOfResidentTextures;
+  
+  Atlas _atlas;
+  
   std::vector<Texture*> _arrayOfActiveTextures;
   std::vector<Texture*> _arrayOfTextures;
   
-  Room* _roomToPreload;
+  // Bundles currently mapped, shared by all the textures reading from them
+  std::map<std::string, Bundle*> _mapOfBundles;
+  
+  // Textures shared by the spots, images and buttons showing the same file
+  std::map<std::string, Texture*> _mapOfTextures;
+  
+  // Cache of active textures, bounded by texCacheSize (in megabytes)
+  size_t _cacheSize;
+  unsigned int _cacheEvictions;
+  unsigned int _cacheHits;
+  unsigned int _cacheMisses;
+  unsigned int _switchSerial;
+  
+  // Textures waiting for a loader thread, textures being decoded right
+  // now, and decoded textures waiting to be uploaded in the main thread
+  std::deque<Texture*> _arrayOfPendingTextures;
+  std::vector<Texture*> _arrayOfDecodingTextures;
+  std::vector<Texture*> _arrayOfRequestedTextures;
+  
+  std::vector<SDL_Thread*> _arrayOfThreads;
+  SDL_cond* _condition;
+  SDL_mutex* _mutex;
+  bool _isRunning;
+  
+  // Proxies of the current node, replaced all at once when their full
+  // textures are uploaded
+  std::vector<Texture*> _arrayOfProxyTextures;
+  
+  // Textures of the neighbouring nodes decoded ahead of time
+  std::vector<Texture*> _arrayOfPrefetchedTextures;
+  Node* _currentNode;
+  int _prefetchQuadrant;
+  
+  static int _runThread(void *ptr);
+  
+  void _activate(Texture* target);
+  void _dequeue(Texture* target);
+  void _pin(Texture* target);
+  void _prefetch();
+  size_t _prefetchedSize(); // Bytes of prefetched bitmaps held in memory
+  void _refine(Texture* target);
+  void _rankLinks(Node* fromNode, int facing, float weight,
+                  std::vector<Node*>& arrayOfNodes,
+                  std::vector<float>& arrayOfScores);
   
   TextureManager();
   TextureManager(TextureManager const&);
@@ -67,16 +124,72 @@ public:
     return textureManager;
   }
   
+  // Checks
+  
+  // True when the full textures of the current node are all waiting to
+  // replace their proxies
+  bool isRefinementReady();
+  
+  // Gets
+  unsigned int cacheEvictions();
+  unsigned int cacheHits();
+  unsigned int cacheMisses();
+  size_t cacheSize();
+  size_t memoryUsed(); // All categories
+  size_t memoryUsed(int category);
+  
+  // Sets
+  
+  // The current node is pinned in the cache and used as the starting
+  // point to prefetch textures
+  void setCurrentNode(Node* theNode);
+  
+  // State changes
+  
+  // Bundles are retained by every texture holding a pointer to their data,
+  // and unmapped once released by all of them. Safe to call from any thread.
+  Bundle* acquireBundle(const std::string& fileName);
+  void releaseBundle(Bundle* theBundle);
+  
+  // Textures are shared by everyone showing the same file, and deleted
+  // once released by all of them. Pinned textures are loaded right away
+  // and never evicted from the cache, as interface elements expect. Main
+  // thread only, though releasing is also safe on exit.
+  Texture* acquireTexture(const std::string& fileName, int indexInBundle, bool isPinned);
+  static void releaseTexture(Texture* target);
+  
   void appendTextureToBundle(const char* nameOfBundle, Texture* textureToAppend);
   void createBundle(const char* nameOfBundle);
   int itemsInBundle(const char* nameOfBundle);
   void flush();
   void init();
+  
+  // Small interface bitmaps share the pages of an atlas. Returns false if
+  // the file should be loaded as a texture of its own instead. Each load
+  // is released once done with, which is also safe on exit.
+  bool loadIntoAtlas(const std::string& fileName, AtlasRegion* region);
+  static void releaseFromAtlas(const std::string& fileName);
+  
+  void queueTexture(Texture* target);
+  void refine();
   void registerTexture(Texture* target);
+  
+  // Logs the memory taken by each category, the state of the cache and
+  // the largest textures, mostly for the textures() console command
+  void report(int numOfTextures);
+  
   void requestBundle(Node* forNode);
   void requestTexture(Texture* target);
-  void setRoomToPreload(Room* theRoom);
-  bool updatePreloader();
+  void terminate();
+  
+  // Keep track of video memory. Textures report every change of their
+  // size, while textures created directly with OpenGL report the bytes
+  // they add or release. Main thread only.
+  static void trackMemory(int category, long bytes);
+  static void trackTexture(Texture* target, size_t previousSize, size_t size);
+  
+  void update();
+  bool updateLoader();
 };
   
 }
@@ -0,0 +1,248 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include "Config.h"
+#include "Log.h"
+#include "UploadManager.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Implementation - Constructor
+////////////////////////////////////////////////////////////
+
+UploadManager::UploadManager() :
+config(Config::instance()),
+log(Log::instance())
+{
+  for (int i = 0; i < kNumOfUploadBuffers; i++) {
+    _arrayOfBuffers[i].ident = 0;
+    _arrayOfBuffers[i].data = NULL;
+    _arrayOfBuffers[i].capacity = 0;
+    _arrayOfBuffers[i].fence = NULL;
+  }
+  _streamBuffer.ident = 0;
+  _streamBuffer.data = NULL;
+  _streamBuffer.capacity = 0;
+  _streamBuffer.fence = NULL;
+  _currentBuffer = NULL;
+  _nextBuffer = 0;
+  _isEnabled = false;
+  _isPersistent = false;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+UploadManager::~UploadManager() {
+  // The GL context is gone by now, buffers are released in terminate()
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Checks
+////////////////////////////////////////////////////////////
+
+bool UploadManager::isEnabled() {
+  return _isEnabled;
+}
+
+bool UploadManager::isPersistent() {
+  return _isPersistent;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - State changes
+////////////////////////////////////////////////////////////
+
+void UploadManager::finish() {
+  if (_currentBuffer) {
+    // Persistent buffers are never orphaned, so we must know when the
+    // driver is done reading before writing to them again
+    if (_currentBuffer->data)
+      _currentBuffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    
+    // The driver frees the storage of large uploads once it's done
+    if (_currentBuffer == &_streamBuffer)
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, 0, NULL, GL_STREAM_DRAW);
+    
+    // Leave client memory uploads working for everyone else
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    _currentBuffer = NULL;
+  }
+}
+
+void UploadManager::init() {
+  if (!config.pixelBuffers)
+    return;
+  
+  if (!GLEW_VERSION_2_1 && !GLEW_ARB_pixel_buffer_object) {
+    log.warning(kModRender, "%s", kString11007);
+    return;
+  }
+  
+  // Persistent mapping is only safe if we can fence the buffers
+  bool hasSync = GLEW_VERSION_3_2 || GLEW_ARB_sync;
+  _isPersistent = hasSync && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage);
+  
+  for (int i = 0; i < kNumOfUploadBuffers; i++)
+    glGenBuffers(1, &_arrayOfBuffers[i].ident);
+  glGenBuffers(1, &_streamBuffer.ident);
+  
+  _isEnabled = true;
+  
+  if (_isPersistent)
+    log.trace(kModRender, "%s", kString11008);
+  else
+    log.trace(kModRender, "%s", kString11009);
+}
+
+GLubyte* UploadManager::map(size_t size) {
+  if (!_isEnabled || !size)
+    return NULL;
+  
+  // Finish any upload left open
+  this->finish();
+  
+  UploadBuffer* buffer;
+  if (size > kUploadBufferLimit) {
+    buffer = &_streamBuffer;
+  } else {
+    buffer = &_arrayOfBuffers[_nextBuffer];
+    _nextBuffer = (_nextBuffer + 1) % kNumOfUploadBuffers;
+  }
+  
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->ident);
+  
+  GLubyte* destination;
+  if (_isPersistent && buffer != &_streamBuffer) {
+    // If the driver may still be reading it, the storage is replaced
+    // rather than overwritten. The old one is freed once it's done.
+    if (!_wait(buffer))
+      _reserve(buffer, std::max(size, buffer->capacity));
+    else if (size > buffer->capacity)
+      _reserve(buffer, size);
+    destination = buffer->data;
+  } else {
+    // Orphan the previous storage so that mapping never stalls on a
+    // transfer still in flight
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    destination = static_cast<GLubyte*>(glMapBuffer(GL_PIXEL_UNPACK_BUFFER,
+                                                    GL_WRITE_ONLY));
+  }
+  
+  if (!destination) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return NULL;
+  }
+  
+  _currentBuffer = buffer;
+  return destination;
+}
+
+const GLvoid* UploadManager::stage(const GLvoid* data, size_t size) {
+  GLubyte* destination = this->map(size);
+  if (!destination)
+    return data;
+  
+  memcpy(destination, data, size);
+  if (!this->unmap())
+    return data;
+  
+  // Offset zero into the bound buffer
+  return NULL;
+}
+
+void UploadManager::terminate() {
+  this->finish();
+  
+  for (int i = 0; i <= kNumOfUploadBuffers; i++) {
+    UploadBuffer* buffer = (i < kNumOfUploadBuffers) ? &_arrayOfBuffers[i] : &_streamBuffer;
+    if (buffer->fence)
+      glDeleteSync(buffer->fence);
+    if (buffer->ident) {
+      if (buffer->data) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->ident);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      }
+      glDeleteBuffers(1, &buffer->ident);
+    }
+    buffer->ident = 0;
+    buffer->data = NULL;
+    buffer->capacity = 0;
+    buffer->fence = NULL;
+  }
+  
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  _isEnabled = false;
+  _isPersistent = false;
+}
+
+bool UploadManager::unmap() {
+  // Persistent buffers stay mapped, and coherent writes need no flush
+  if (!_currentBuffer || _currentBuffer->data)
+    return true;
+  
+  if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE)
+    return true;
+  
+  // The store was corrupted while mapped, for instance by a mode switch
+  log.warning(kModRender, "%s", kString11010);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  _currentBuffer = NULL;
+  return false;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+// Expects the buffer to be bound
+void UploadManager::_reserve(UploadBuffer* buffer, size_t size) {
+  // Immutable storage can't grow, so it's replaced with a new buffer
+  if (buffer->data)
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  glDeleteBuffers(1, &buffer->ident);
+  glGenBuffers(1, &buffer->ident);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->ident);
+  
+  size_t capacity = ((size + kUploadBufferGranularity - 1) /
+                     kUploadBufferGranularity) * kUploadBufferGranularity;
+  GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                     GL_MAP_COHERENT_BIT;
+  glBufferStorage(GL_PIXEL_UNPACK_BUFFER, capacity, NULL, flags);
+  buffer->data = static_cast<GLubyte*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+                                                        0, capacity, flags));
+  buffer->capacity = buffer->data ? capacity : 0;
+}
+
+// Returns false if the buffer might still be in use
+bool UploadManager::_wait(UploadBuffer* buffer) {
+  if (!buffer->fence)
+    return true;
+  
+  GLenum result = glClientWaitSync(buffer->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                   kUploadTimeout);
+  glDeleteSync(buffer->fence);
+  buffer->fence = NULL;
+  
+  return (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED);
+}
+  
+}
@@ -0,0 +1,111 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_UPLOADMANAGER_H_
+#define DAGON_UPLOADMANAGER_H_
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include "Platform.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Number of pixel buffers used in turns, so that filling one never
+// waits for the transfer of the previous upload
+#define kNumOfUploadBuffers 4
+
+// Persistent buffers grow in steps of this size (in bytes)
+#define kUploadBufferGranularity 1048576
+
+// Persistent buffers never grow past this size (in bytes). Bigger uploads
+// go through a streamed buffer whose storage is dropped once issued, so
+// that no memory stays pinned for them.
+#define kUploadBufferLimit 4194304
+
+// Maximum time to wait for a buffer still being read (in nanoseconds)
+#define kUploadTimeout 1000000000
+
+class Config;
+class Log;
+
+typedef struct {
+  GLuint ident;
+  GLubyte* data; // Only kept while persistently mapped
+  size_t capacity;
+  GLsync fence;
+} UploadBuffer;
+
+////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////
+
+class UploadManager {
+  Config& config;
+  Log& log;
+  
+  UploadBuffer _arrayOfBuffers[kNumOfUploadBuffers];
+  UploadBuffer _streamBuffer; // Only for uploads over the limit
+  UploadBuffer* _currentBuffer;
+  int _nextBuffer;
+  bool _isEnabled;
+  bool _isPersistent;
+  
+  void _reserve(UploadBuffer* buffer, size_t size);
+  bool _wait(UploadBuffer* buffer);
+  
+  UploadManager();
+  UploadManager(UploadManager const&);
+  UploadManager& operator=(UploadManager const&);
+  ~UploadManager();
+  
+public:
+  static UploadManager& instance() {
+    static UploadManager uploadManager;
+    return uploadManager;
+  }
+  
+  // Checks
+  bool isEnabled();
+  bool isPersistent();
+  
+  // State changes
+  
+  // Uploads are done in three steps: map() binds the next pixel buffer
+  // and returns where to copy the pixels (NULL if pixel buffers aren't
+  // available, in which case pixels are read from client memory as
+  // usual), unmap() ends the copy, and finish() is called once every
+  // glTexImage call reading from the buffer has been issued. Offsets
+  // into the buffer must be used as pixel pointers in between. If
+  // unmap() fails the copy was lost and pixels must be read from client
+  // memory after all.
+  GLubyte* map(size_t size);
+  bool unmap();
+  void finish();
+  
+  // Convenience for a single block of pixels. Returns the pointer to
+  // hand to the glTexImage call, then call finish() after it.
+  const GLvoid* stage(const GLvoid* data, size_t size);
+  
+  void init();
+  void terminate();
+};
+  
+}
+
+#endif // DAGON_UPLOADMANAGER_H_
@@ -15,8 +15,11 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <cmath>
+
 #include <SDL2/SDL.h>
 
+#include "Audio.h"
 #include "Defines.h"
 #include "Language.h"
 #include "Log.h"
@@ -30,6 +33,10 @@ namespace dagon {
 // Definitions
 ////////////////////////////////////////////////////////////
 
+// Catching up never decodes more frames than this in a single update.
+// Synced videos carry on from there in the following ones.
+#define kVideoMaxFramesPerUpdate 8
+
 // FIXME: No need to include this lookup table here, should go in the manager
 
 struct DGLookUpTable{
@@ -51,6 +58,7 @@ log(Log::instance())
 {
   this->setType(kObjectVideo);
   
+  _clock = NULL;
   _handle = NULL;
   _hasNewFrame = false;
   _hasResource = false;
@@ -80,6 +88,7 @@ log(Log::instance())
 {
   this->setType(kObjectVideo);
   
+  _clock = NULL;
   _hasResource = false;
   _isLoaded = false;
   _state = VideoInitial;
@@ -175,6 +184,10 @@ void Video::setAutoplay(bool autoplay) {
   _doesAutoplay = autoplay;
 }
 
+void Video::setClock(Audio* audio) {
+  _clock = audio;
+}
+
 void Video::setLoopable(bool loopable) {
   _isLoopable = loopable;
 }
@@ -388,11 +401,36 @@ void Video::update() {
     if (_state == VideoPlaying) {
       double currentTime = SDL_GetTicks();
       double duration = currentTime - _lastTime;
+      
+      // Frames are decoded until we catch up with what's being heard, or
+      // held until it catches up with us. Otherwise we time ourselves.
+      if (_clock && _clock->isPlaying()) {
+        double cursor = _clock->cursor() * 1000.0;
+        double behind = cursor - _theoraInfo->videobuf_time * 1000.0;
+        
+        // Only a gap of more than half the clip is a loop. If the clock
+        // went back we start over with it, and if we did we wait for it.
+        double half = _clock->duration() * 500.0;
+        if (half > 0.0 && behind < -half) {
+          fseek(_handle, (long)_theoraInfo->bos * 8, SEEK_SET);
+          ogg_stream_reset(&_theoraInfo->to);
+          behind = cursor + _frameDuration;
+        }
+        else if (half > 0.0 && behind > half) {
+          behind = 0.0;
+        }
+        
+        duration = behind;
+        _lastTime = currentTime;
+      }
+      
       if (duration >= _frameDuration) {
         yuv_buffer yuv;
         
-        // TODO: Skip frames if required here?
+        // Frames we skip are decoded but never converted
         int frames = (int)floor(duration / _frameDuration);
+        if (frames > kVideoMaxFramesPerUpdate)
+          frames = kVideoMaxFramesPerUpdate;
         for (int i = 0; i < frames; i++)
           _prepareFrame();
         
@@ -70,6 +70,7 @@ p[i] = tmp >> 8; \
 else \
 p[i] = (tmp >> 24) ^ 0xff;
 
+class Audio;
 class Log;
 
 ////////////////////////////////////////////////////////////
@@ -79,6 +80,7 @@ class Log;
 class Video : public Object {
   Log& log;
   
+  Audio* _clock; // Synced videos follow it rather than the system clock
   DGFrame _auxFrame;
   DGFrame _currentFrame;
   DGTheoraInfo* _theoraInfo;
@@ -132,6 +134,7 @@ public:
   // Sets
   
   void setAutoplay(bool autoplay);
+  void setClock(Audio* audio);
   void setLoopable(bool loopable);
   void setResource(const char* fromFileName);
   void setSynced(bool synced);
@@ -264,10 +264,12 @@ extern int      stbi_is_hdr_from_file(FILE *f);
 #endif // STBI_NO_STDIO
 
 
-// get a VERY brief reason for failure
-// NOT THREADSAFE
+// get a VERY brief reason for failure, for the calling thread
 extern const char *stbi_failure_reason  (void); 
 
+// builds the shared tables, call once before loading from several threads
+extern void     stbi_init            (void);
+
 // free the loaded image -- this is just free()
 extern void     stbi_image_free      (void *retval_from_stbi_load);
 
@@ -318,9 +320,16 @@ typedef void (*stbi_YCbCr_to_RGB_run)(stbi_uc *output, stbi_uc const  *y, stbi_u
 //     y: Y input channel
 //     cb: Cb input channel; scale/biased to be 0..255
 //     cr: Cr input channel; scale/biased to be 0..255
+typedef int (*stbi_png_unfilter_run)(stbi_uc *cur, stbi_uc const *prior, stbi_uc const *raw, int filter, int count, int n);
+// undo a PNG filter on a row that isn't the first one of the image
+//     'count' pixels of 'n' bytes each (1 to 4), not expanded
+//     filter: 1 sub, 2 up, 3 average, 4 paeth, as in the PNG spec
+//     return 0 to leave the row to the portable code
 
+// installing NULL restores the portable code
 extern void stbi_install_idct(stbi_idct_8x8 func);
 extern void stbi_install_YCbCr_to_RGB(stbi_YCbCr_to_RGB_run func);
+extern void stbi_install_png_unfilter(stbi_png_unfilter_run func);
 #endif // STBI_SIMD
 
 
@@ -494,8 +503,14 @@ static stbi_uc *stbi_gif_load(stbi *s, int *x, int *y, int *comp, int req_comp);
 static int      stbi_gif_info(stbi *s, int *x, int *y, int *comp);
 
 
-// this is not threadsafe
-static const char *failure_reason;
+// each thread keeps its own failure reason
+#if defined(_MSC_VER)
+#define stbi__thread_local __declspec(thread)
+#else
+#define stbi__thread_local __thread
+#endif
+
+static stbi__thread_local const char *failure_reason;
 
 const char *stbi_failure_reason(void)
 {
@@ -1317,7 +1332,7 @@ static stbi_idct_8x8 stbi_idct_installed = idct_block;
 
 void stbi_install_idct(stbi_idct_8x8 func)
 {
-   stbi_idct_installed = func;
+   stbi_idct_installed = func ? func : idct_block;
 }
 #endif
 
@@ -1359,9 +1374,6 @@ static int parse_entropy_coded_data(jpeg *z)
    reset(z);
    if (z->scan_n == 1) {
       int i,j;
-      #ifdef STBI_SIMD
-      __declspec(align(16))
-      #endif
       short data[64];
       int n = z->order[0];
       // non-interleaved data, we just need to process one block at a time,
@@ -1775,7 +1787,7 @@ static stbi_YCbCr_to_RGB_run stbi_YCbCr_installed = YCbCr_to_RGB_row;
 
 void stbi_install_YCbCr_to_RGB(stbi_YCbCr_to_RGB_run func)
 {
-   stbi_YCbCr_installed = func;
+   stbi_YCbCr_installed = func ? func : YCbCr_to_RGB_row;
 }
 #endif
 
@@ -1880,7 +1892,7 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
             uint8 *y = coutput[0];
             if (z->s->img_n == 3) {
                #ifdef STBI_SIMD
-               stbi_YCbCr_installed(out, y, coutput[1], coutput[2], z->s.img_x, n);
+               stbi_YCbCr_installed(out, y, coutput[1], coutput[2], z->s->img_x, n);
                #else
                YCbCr_to_RGB_row(out, y, coutput[1], coutput[2], z->s->img_x, n);
                #endif
@@ -2246,7 +2258,7 @@ static int parse_zlib_header(zbuf *a)
    return 1;
 }
 
-// @TODO: should statically initialize these for optimal thread safety
+// built by stbi_init() before any thread loads, or lazily otherwise
 static uint8 default_length[288], default_distance[32];
 static void init_defaults(void)
 {
@@ -2259,6 +2271,11 @@ static void init_defaults(void)
    for (i=0; i <=  31; ++i)     default_distance[i] = 5;
 }
 
+void stbi_init(void)
+{
+   init_defaults();
+}
+
 int stbi_png_partial; // a quick hack to only allow decoding some of a PNG... I should implement real streaming support instead
 static int parse_zlib(zbuf *a, int parse_header)
 {
@@ -2429,6 +2446,15 @@ static uint8 first_row_filter[5] =
    F_none, F_sub, F_none, F_avg_first, F_paeth_first
 };
 
+#ifdef STBI_SIMD
+static stbi_png_unfilter_run stbi_png_unfilter_installed = NULL;
+
+void stbi_install_png_unfilter(stbi_png_unfilter_run func)
+{
+   stbi_png_unfilter_installed = func;
+}
+#endif
+
 static int paeth(int a, int b, int c)
 {
    int p = a + b - c;
@@ -2465,6 +2491,13 @@ static int create_png_image_raw(png *a, uint8 *raw, uint32 raw_len, int out_n, u
       if (filter > 4) return e("invalid filter","Corrupt PNG");
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
+      #ifdef STBI_SIMD
+      if (j > 0 && img_n == out_n && filter != F_none && stbi_png_unfilter_installed &&
+          stbi_png_unfilter_installed(cur, prior, raw, filter, x, img_n)) {
+         raw += img_n * x;
+         continue;
+      }
+      #endif
       // handle first pixel explicitly
       for (k=0; k < img_n; ++k) {
          switch (filter) {
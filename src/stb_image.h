@@ -192,10 +192,12 @@ extern "C" {
 #endif // STBI_NO_STDIO
     
     
-    // get a VERY brief reason for failure
-    // NOT THREADSAFE
+    // get a VERY brief reason for failure, for the calling thread
     extern const char *stbi_failure_reason  (void); 
     
+    // builds the shared tables, call once before loading from several threads
+    extern void     stbi_init            (void);
+    
     // free the loaded image -- this is just free()
     extern void     stbi_image_free      (void *retval_from_stbi_load);
     
@@ -245,9 +247,16 @@ extern "C" {
     //     y: Y input channel
     //     cb: Cb input channel; scale/biased to be 0..255
     //     cr: Cr input channel; scale/biased to be 0..255
+    typedef int (*stbi_png_unfilter_run)(stbi_uc *cur, stbi_uc const *prior, stbi_uc const *raw, int filter, int count, int n);
+    // undo a PNG filter on a row that isn't the first one of the image
+    //     'count' pixels of 'n' bytes each (1 to 4), not expanded
+    //     filter: 1 sub, 2 up, 3 average, 4 paeth, as in the PNG spec
+    //     return 0 to leave the row to the portable code
     
+    // installing NULL restores the portable code
     extern void stbi_install_idct(stbi_idct_8x8 func);
     extern void stbi_install_YCbCr_to_RGB(stbi_YCbCr_to_RGB_run func);
+    extern void stbi_install_png_unfilter(stbi_png_unfilter_run func);
 #endif // STBI_SIMD
     
     
@@ -0,0 +1,228 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// bench_decode measures how fast stb_image decodes the given
+// images, first with the portable code and then with the SIMD
+// kernels picked for this CPU. Files are read into memory
+// beforehand so that only decoding is timed, and results are
+// reported in MB/s of decoded pixels for each format.
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "DecodeKernels.h"
+#include "stb_image.h"
+
+using namespace dagon;
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+enum Formats {
+  kFormatJPEG,
+  kFormatPNG,
+  kFormatOther,
+  kNumOfFormats
+};
+
+static const char* FormatNames[kNumOfFormats] = { "JPEG", "PNG", "Other" };
+
+typedef struct {
+  std::vector<unsigned char> data;
+  std::string name;
+  int format;
+} Input;
+
+typedef struct {
+  double bytes;
+  double seconds;
+} Result;
+
+////////////////////////////////////////////////////////////
+// Implementation - Benchmark
+////////////////////////////////////////////////////////////
+
+static int DetectFormat(const std::vector<unsigned char>& data) {
+  static const unsigned char png[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  
+  if (data.size() >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff)
+    return kFormatJPEG;
+  
+  if (data.size() >= sizeof(png) && memcmp(&data[0], png, sizeof(png)) == 0)
+    return kFormatPNG;
+  
+  return kFormatOther;
+}
+
+static bool ReadFile(const char* fileName, std::vector<unsigned char>* data) {
+  FILE* fh = fopen(fileName, "rb");
+  if (!fh)
+    return false;
+  
+  fseek(fh, 0, SEEK_END);
+  long size = ftell(fh);
+  fseek(fh, 0, SEEK_SET);
+  
+  bool success = false;
+  if (size > 0) {
+    data->resize(size);
+    success = fread(&(*data)[0], 1, size, fh) == static_cast<size_t>(size);
+  }
+  
+  fclose(fh);
+  return success;
+}
+
+// Decodes every input the given number of times and adds up the
+// results of each format
+static bool Run(const std::vector<Input>& arrayOfInputs, int numOfRuns,
+                Result* arrayOfResults) {
+  for (int i = 0; i < kNumOfFormats; i++) {
+    arrayOfResults[i].bytes = 0.0;
+    arrayOfResults[i].seconds = 0.0;
+  }
+  
+  for (size_t i = 0; i < arrayOfInputs.size(); i++) {
+    const Input& input = arrayOfInputs[i];
+    Result& result = arrayOfResults[input.format];
+    
+    for (int run = 0; run < numOfRuns; run++) {
+      int x, y, comp;
+      clock_t start = clock();
+      unsigned char* pixels = stbi_load_from_memory(&input.data[0],
+                                                    static_cast<int>(input.data.size()),
+                                                    &x, &y, &comp, 0);
+      clock_t end = clock();
+      
+      if (!pixels) {
+        fprintf(stderr, "Error while loading image: (%s) %s\n", input.name.c_str(),
+                stbi_failure_reason());
+        return false;
+      }
+      
+      stbi_image_free(pixels);
+      result.bytes += static_cast<double>(x) * y * comp;
+      result.seconds += static_cast<double>(end - start) / CLOCKS_PER_SEC;
+    }
+  }
+  
+  return true;
+}
+
+static void Report(const char* kernels, const Result* arrayOfResults,
+                   const Result* arrayOfBaselines) {
+  for (int i = 0; i < kNumOfFormats; i++) {
+    const Result& result = arrayOfResults[i];
+    if (result.bytes == 0.0)
+      continue;
+    
+    double speed = result.bytes / (1024.0 * 1024.0) / (result.seconds > 0.0 ? result.seconds : 1e-9);
+    printf("%-6s %-9s %9.1f MB/s", FormatNames[i], kernels, speed);
+    
+    if (arrayOfBaselines && arrayOfBaselines[i].seconds > 0.0 && result.seconds > 0.0)
+      printf("  (%.2fx)", arrayOfBaselines[i].seconds / result.seconds);
+    
+    printf("\n");
+  }
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Main
+////////////////////////////////////////////////////////////
+
+static void Usage() {
+  fprintf(stderr, "Usage: bench_decode [options] image1 [... imageN]\n\n"
+          "Options:\n"
+          "  -n <runs>   Times each image is decoded (default 10)\n"
+          "  -portable   Skip the SIMD kernels\n");
+}
+
+int main(int argc, char* argv[]) {
+  int numOfRuns = 10;
+  bool usePortableOnly = false;
+  
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc) numOfRuns = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "-portable") == 0) usePortableOnly = true;
+    else {
+      Usage();
+      return 1;
+    }
+  }
+  
+  if (arg == argc || numOfRuns < 1) {
+    Usage();
+    return 1;
+  }
+  
+  std::vector<Input> arrayOfInputs;
+  for (; arg < argc; arg++) {
+    Input input;
+    if (!ReadFile(argv[arg], &input.data)) {
+      fprintf(stderr, "Could not read file: %s\n", argv[arg]);
+      return 1;
+    }
+    
+    // Leave out what stb_image can't decode, such as progressive JPEGs
+    int x, y, comp;
+    unsigned char* pixels = stbi_load_from_memory(&input.data[0],
+                                                  static_cast<int>(input.data.size()),
+                                                  &x, &y, &comp, 0);
+    if (!pixels) {
+      fprintf(stderr, "Skipping image: (%s) %s\n", argv[arg], stbi_failure_reason());
+      continue;
+    }
+    
+    stbi_image_free(pixels);
+    input.name = argv[arg];
+    input.format = DetectFormat(input.data);
+    arrayOfInputs.push_back(input);
+  }
+  
+  if (arrayOfInputs.empty())
+    return 1;
+  
+  Result arrayOfBaselines[kNumOfFormats];
+  InstallDecodeKernels(0);
+  if (!Run(arrayOfInputs, numOfRuns, arrayOfBaselines))
+    return 1;
+  
+  Report("portable", arrayOfBaselines, NULL);
+  
+  if (!usePortableOnly) {
+    const char* kernels = InstallDecodeKernels(DetectCPUFeatures());
+    if (strcmp(kernels, "portable") != 0) {
+      Result arrayOfResults[kNumOfFormats];
+      if (!Run(arrayOfInputs, numOfRuns, arrayOfResults))
+        return 1;
+      
+      Report(kernels, arrayOfResults, arrayOfBaselines);
+    }
+    else printf("No SIMD kernels for this CPU\n");
+  }
+  
+  return 0;
+}
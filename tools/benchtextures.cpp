@@ -0,0 +1,468 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// bench_textures measures how long the engine takes to load
+// textures, from the file on disk to video memory. Every
+// input is first loaded directly, timing the decode done by
+// loader threads and the upload done by the main thread, and
+// then all of them are queued together in the texture manager
+// to time the whole pipeline. Synthetic images are generated
+// unless told otherwise. Results are printed as JSON.
+//
+// The window is never shown, so on machines without a GPU it
+// runs on Mesa with SDL_VIDEODRIVER=offscreen (which uses EGL)
+// or with a virtual X server.
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+#include "Config.h"
+#include "Platform.h"
+#include "Texture.h"
+#include "TextureManager.h"
+#include "UploadManager.h"
+
+#ifdef DAGON_WINDOWS
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace dagon;
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Waiting longer than this for the texture manager means a load failed
+#define kManagerTimeout 60000
+
+typedef struct {
+  std::string fileName;
+  std::string kind;
+  bool isSynthetic;
+  
+  // Filled in by the benchmark
+  int width;
+  int height;
+  int depth;
+  size_t videoBytes;
+  double decodeSeconds;
+  double uploadSeconds;
+} Input;
+
+typedef struct {
+  int width;
+  int height;
+  int depth;
+} SyntheticImage;
+
+static const SyntheticImage SyntheticImages[] = {
+  { 512, 512, 24 },
+  { 1024, 1024, 24 },
+  { 2048, 2048, 24 },
+  { 2048, 2048, 32 }
+};
+
+#define kNumOfSyntheticImages (sizeof(SyntheticImages) / sizeof(SyntheticImage))
+
+////////////////////////////////////////////////////////////
+// Implementation - Helpers
+////////////////////////////////////////////////////////////
+
+static double Now() {
+  return static_cast<double>(SDL_GetPerformanceCounter()) /
+         static_cast<double>(SDL_GetPerformanceFrequency());
+}
+
+static std::string Kind(const std::string& fileName) {
+  size_t dot = fileName.rfind('.');
+  if (dot == std::string::npos)
+    return "other";
+  
+  std::string extension = fileName.substr(dot + 1);
+  for (size_t i = 0; i < extension.size(); i++)
+    extension[i] = static_cast<char>(tolower(extension[i]));
+  
+  if (extension == "jpeg")
+    return "jpg";
+  
+  return extension;
+}
+
+// Kilobytes, or -1 if we can't tell
+static long PeakResidentSize() {
+#ifdef DAGON_WINDOWS
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return static_cast<long>(counters.PeakWorkingSetSize / 1024);
+  return -1;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return -1;
+#ifdef DAGON_MAC
+  return usage.ru_maxrss / 1024; // Bytes on Mac OS X
+#else
+  return usage.ru_maxrss;
+#endif
+#endif
+}
+
+static void PrintString(FILE* fh, const std::string& text) {
+  fputc('"', fh);
+  for (size_t i = 0; i < text.size(); i++) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    if (c == '"' || c == '\\') fprintf(fh, "\\%c", c);
+    else if (c < 0x20) fprintf(fh, "\\u%04x", c);
+    else fputc(c, fh);
+  }
+  fputc('"', fh);
+}
+
+static std::string TemporaryDirectory() {
+#ifdef DAGON_WINDOWS
+  const char* directory = getenv("TEMP");
+  return directory ? directory : ".";
+#else
+  const char* directory = getenv("TMPDIR");
+  return directory ? directory : "/tmp";
+#endif
+}
+
+// Uncompressed TGA, which every build of the engine can decode. Pixels
+// are noise over a gradient, so that nothing is unusually cheap.
+static bool WriteSyntheticImage(const std::string& fileName, const SyntheticImage& image) {
+  FILE* fh = fopen(fileName.c_str(), "wb");
+  if (!fh)
+    return false;
+  
+  unsigned char header[18] = { 0 };
+  header[2] = 2; // Uncompressed true color
+  header[12] = static_cast<unsigned char>(image.width & 0xff);
+  header[13] = static_cast<unsigned char>(image.width >> 8);
+  header[14] = static_cast<unsigned char>(image.height & 0xff);
+  header[15] = static_cast<unsigned char>(image.height >> 8);
+  header[16] = static_cast<unsigned char>(image.depth);
+  header[17] = (image.depth == 32) ? 0x28 : 0x20; // Top-left origin
+  bool success = (fwrite(header, sizeof(header), 1, fh) == 1);
+  
+  int channels = image.depth / 8;
+  std::vector<unsigned char> row(image.width * channels);
+  unsigned int seed = 1;
+  for (int y = 0; success && y < image.height; y++) {
+    for (int x = 0; x < image.width; x++) {
+      for (int c = 0; c < channels; c++) {
+        seed = seed * 1103515245 + 12345;
+        row[x * channels + c] = static_cast<unsigned char>(((x + y * c) >> 3) + ((seed >> 16) & 0x1f));
+      }
+    }
+    success = (fwrite(&row[0], row.size(), 1, fh) == 1);
+  }
+  
+  if (fclose(fh) != 0)
+    success = false;
+  return success;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Benchmark
+////////////////////////////////////////////////////////////
+
+static Texture* MakeTexture(const std::string& fileName) {
+  Texture* texture = new Texture;
+  texture->setResource(fileName);
+  
+  // Bundles are loaded whole, the way nodes use them
+  if (Kind(fileName) == "tex" && (GLEW_VERSION_1_3 || GLEW_ARB_texture_cube_map))
+    texture->setCubeMap(true);
+  
+  return texture;
+}
+
+// Loads the input directly, the same two steps that loader threads and
+// the main thread take
+static bool RunDirect(Input* input, int numOfRuns) {
+  input->decodeSeconds = 0.0;
+  input->uploadSeconds = 0.0;
+  
+  Texture* texture = MakeTexture(input->fileName);
+  for (int run = 0; run < numOfRuns; run++) {
+    double start = Now();
+    texture->loadBitmap();
+    double decoded = Now();
+    
+    if (!texture->isBitmapLoaded()) {
+      fprintf(stderr, "Could not decode: %s\n", input->fileName.c_str());
+      delete texture;
+      return false;
+    }
+    
+    texture->uploadBitmap();
+    glFinish();
+    double uploaded = Now();
+    
+    if (!texture->isLoaded()) {
+      fprintf(stderr, "Could not upload: %s\n", input->fileName.c_str());
+      delete texture;
+      return false;
+    }
+    
+    input->decodeSeconds += decoded - start;
+    input->uploadSeconds += uploaded - decoded;
+    input->width = texture->width();
+    input->height = texture->height();
+    input->depth = texture->depth();
+    input->videoBytes = texture->size();
+    texture->unload();
+  }
+  
+  input->decodeSeconds /= numOfRuns;
+  input->uploadSeconds /= numOfRuns;
+  delete texture;
+  return true;
+}
+
+// Queues every input at once and lets the loader threads and the upload
+// budget of each frame do the rest
+static bool RunManager(const std::vector<Input>& arrayOfInputs, double* seconds) {
+  TextureManager& textureManager = TextureManager::instance();
+  
+  std::vector<Texture*> arrayOfTextures;
+  for (size_t i = 0; i < arrayOfInputs.size(); i++)
+    arrayOfTextures.push_back(MakeTexture(arrayOfInputs[i].fileName));
+  
+  double start = Now();
+  for (size_t i = 0; i < arrayOfTextures.size(); i++)
+    textureManager.queueTexture(arrayOfTextures[i]);
+  
+  bool isDone = false;
+  while (!isDone && (Now() - start) * 1000.0 < kManagerTimeout) {
+    textureManager.update();
+    textureManager.refine();
+    
+    isDone = true;
+    for (size_t i = 0; i < arrayOfTextures.size(); i++) {
+      if (!arrayOfTextures[i]->isLoaded() || arrayOfTextures[i]->isProxy())
+        isDone = false;
+    }
+  }
+  glFinish();
+  *seconds = Now() - start;
+  
+  for (size_t i = 0; i < arrayOfTextures.size(); i++) {
+    TextureManager::releaseTexture(arrayOfTextures[i]);
+  }
+  
+  if (!isDone)
+    fprintf(stderr, "Timed out waiting for the texture manager\n");
+  return isDone;
+}
+
+static void Report(FILE* fh, const std::vector<Input>& arrayOfInputs, int numOfRuns,
+                   double managerSeconds) {
+  Config& config = Config::instance();
+  
+  fprintf(fh, "{\n  \"renderer\": ");
+  PrintString(fh, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+  fprintf(fh, ",\n  \"version\": ");
+  PrintString(fh, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+  fprintf(fh, ",\n  \"compression\": %s,\n  \"mipmaps\": %s,\n  \"pixel_buffers\": %s,\n"
+          "  \"loaders\": %d,\n  \"runs\": %d,\n  \"inputs\": [\n",
+          config.texCompression ? "true" : "false", config.texMipmaps ? "true" : "false",
+          UploadManager::instance().isEnabled() ? "true" : "false", config.numOfTexLoaders,
+          numOfRuns);
+  
+  double totalBytes = 0.0;
+  for (size_t i = 0; i < arrayOfInputs.size(); i++) {
+    const Input& input = arrayOfInputs[i];
+    double bytes = static_cast<double>(input.width) * input.height * (input.depth / 8);
+    double seconds = input.decodeSeconds + input.uploadSeconds;
+    totalBytes += bytes;
+    
+    fprintf(fh, "    {\n      \"name\": ");
+    PrintString(fh, input.fileName);
+    fprintf(fh, ",\n      \"kind\": ");
+    PrintString(fh, input.kind);
+    fprintf(fh, ",\n      \"synthetic\": %s,\n      \"width\": %d,\n      \"height\": %d,\n"
+            "      \"depth\": %d,\n      \"video_bytes\": %lu,\n      \"decode_ms\": %.3f,\n"
+            "      \"upload_ms\": %.3f,\n      \"throughput_mbs\": %.1f\n    }%s\n",
+            input.isSynthetic ? "true" : "false", input.width, input.height, input.depth,
+            static_cast<unsigned long>(input.videoBytes), input.decodeSeconds * 1000.0,
+            input.uploadSeconds * 1000.0,
+            seconds > 0.0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0,
+            (i + 1 < arrayOfInputs.size()) ? "," : "");
+  }
+  
+  fprintf(fh, "  ],\n  \"manager\": {\n    \"textures\": %d,\n    \"total_ms\": %.3f,\n"
+          "    \"throughput_mbs\": %.1f\n  },\n  \"peak_rss_kb\": %ld\n}\n",
+          static_cast<int>(arrayOfInputs.size()), managerSeconds * 1000.0,
+          managerSeconds > 0.0 ? totalBytes / (1024.0 * 1024.0) / managerSeconds : 0.0,
+          PeakResidentSize());
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Main
+////////////////////////////////////////////////////////////
+
+static void Usage() {
+  fprintf(stderr, "Usage: bench_textures [options] [image1 ... imageN]\n\n"
+          "Images may be PNG, JPEG, TEX bundles or anything else the engine loads.\n\n"
+          "Options:\n"
+          "  -n <runs>       Times each image is loaded directly (default 5)\n"
+          "  -loaders <n>    Loader threads of the texture manager (default %d)\n"
+          "  -compress       Let the driver compress textures\n"
+          "  -nomipmaps      Don't generate mipmaps for plain images\n"
+          "  -nopbo          Upload without pixel buffers\n"
+          "  -nosynthetic    Only load the given images\n"
+          "  -offscreen      Use the offscreen video driver of SDL\n"
+          "  -o <file>       Write the results there instead of stdout\n"
+          "  -v              Echo the log of the engine to stderr\n",
+          static_cast<int>(kDefNumOfTexLoaders));
+}
+
+int main(int argc, char* argv[]) {
+  Config& config = Config::instance();
+  config.log = false;
+  config.debugMode = false;
+  config.texCompressionCache = false; // Or every run after the first is a hit
+  config.numOfPrefetchedNodes = 0;
+  
+  int numOfRuns = 5;
+  bool useSynthetic = true;
+  const char* output = NULL;
+  
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc) numOfRuns = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "-loaders") == 0 && arg + 1 < argc) config.numOfTexLoaders = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "-compress") == 0) config.texCompression = true;
+    else if (strcmp(argv[arg], "-nomipmaps") == 0) config.texMipmaps = false;
+    else if (strcmp(argv[arg], "-nopbo") == 0) config.pixelBuffers = false;
+    else if (strcmp(argv[arg], "-nosynthetic") == 0) useSynthetic = false;
+    else if (strcmp(argv[arg], "-offscreen") == 0) SDL_setenv("SDL_VIDEODRIVER", "offscreen", 1);
+    else if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc) output = argv[++arg];
+    else if (strcmp(argv[arg], "-v") == 0) config.debugMode = true;
+    else {
+      Usage();
+      return 1;
+    }
+  }
+  
+  if (numOfRuns < 1 || (arg == argc && !useSynthetic)) {
+    Usage();
+    return 1;
+  }
+  
+  std::vector<Input> arrayOfInputs;
+  if (useSynthetic) {
+    std::string directory = TemporaryDirectory();
+    for (size_t i = 0; i < kNumOfSyntheticImages; i++) {
+      const SyntheticImage& image = SyntheticImages[i];
+      char fileName[64];
+      snprintf(fileName, sizeof(fileName), "/dagon-bench-%dx%d-%d.tga",
+               image.width, image.height, image.depth);
+      
+      Input input;
+      input.fileName = directory + fileName;
+      input.kind = "synthetic";
+      input.isSynthetic = true;
+      if (!WriteSyntheticImage(input.fileName, image)) {
+        fprintf(stderr, "Could not write file: %s\n", input.fileName.c_str());
+        return 1;
+      }
+      arrayOfInputs.push_back(input);
+    }
+  }
+  
+  for (; arg < argc; arg++) {
+    Input input;
+    input.fileName = argv[arg];
+    input.kind = Kind(input.fileName);
+    input.isSynthetic = false;
+    arrayOfInputs.push_back(input);
+  }
+  
+  // The window is never shown, we only need its context
+  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+    fprintf(stderr, "Could not initialize SDL: %s\n", SDL_GetError());
+    return 1;
+  }
+  
+  SDL_Window* window = SDL_CreateWindow("bench_textures", SDL_WINDOWPOS_UNDEFINED,
+                                        SDL_WINDOWPOS_UNDEFINED, 64, 64,
+                                        SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+  SDL_GLContext context = window ? SDL_GL_CreateContext(window) : NULL;
+  if (!context) {
+    fprintf(stderr, "Could not create OpenGL context: %s\n", SDL_GetError());
+    return 1;
+  }
+  
+  // GLEW may not find an X display when running on EGL, but it still
+  // loads the functions we need
+  GLenum result = glewInit();
+  if (result != GLEW_OK && !GLEW_VERSION_1_1) {
+    fprintf(stderr, "Could not initialize GLEW: %s\n", glewGetErrorString(result));
+    return 1;
+  }
+  
+  UploadManager::instance().init();
+  TextureManager::instance().init();
+  
+  bool success = true;
+  for (size_t i = 0; success && i < arrayOfInputs.size(); i++)
+    success = RunDirect(&arrayOfInputs[i], numOfRuns);
+  
+  double managerSeconds = 0.0;
+  if (success)
+    success = RunManager(arrayOfInputs, &managerSeconds);
+  
+  if (success) {
+    FILE* fh = output ? fopen(output, "w") : stdout;
+    if (fh) {
+      Report(fh, arrayOfInputs, numOfRuns, managerSeconds);
+      if (output)
+        fclose(fh);
+    } else {
+      fprintf(stderr, "Could not write file: %s\n", output);
+      success = false;
+    }
+  }
+  
+  for (size_t i = 0; i < arrayOfInputs.size(); i++) {
+    if (arrayOfInputs[i].isSynthetic)
+      remove(arrayOfInputs[i].fileName.c_str());
+  }
+  
+  TextureManager::instance().terminate();
+  UploadManager::instance().terminate();
+  SDL_GL_DeleteContext(context);
+  SDL_DestroyWindow(window);
+  SDL_Quit();
+  
+  return success ? 0 : 1;
+}
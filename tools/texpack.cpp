@@ -0,0 +1,481 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// dagon-texpack converts PNG or JPG cube faces into a version
+// 2 TEX bundle with full mip chains, optionally compressed for
+// the GPU (DXT1, or DXT5 when faces have alpha) and packed with
+// LZ4. Faces are given in the usual order: north, east, south,
+// west, up and down.
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "Bundle.h"
+#include "Compression.h"
+#include "stb_image.h"
+
+using namespace dagon;
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+#define kMaxFaces 6
+
+typedef struct {
+  std::vector<unsigned char> data;
+  int width;
+  int height;
+} Image;
+
+typedef struct {
+  bool hasMipmaps;
+  bool isCompressed;
+  bool isPacked;
+} Options;
+
+////////////////////////////////////////////////////////////
+// Implementation - Mipmaps
+////////////////////////////////////////////////////////////
+
+// Box filter, clamping the last row and column of odd sizes
+static void Downsample(const Image& source, Image* destination, int comp) {
+  destination->width = source.width > 1 ? source.width / 2 : 1;
+  destination->height = source.height > 1 ? source.height / 2 : 1;
+  destination->data.resize(destination->width * destination->height * comp);
+  
+  for (int y = 0; y < destination->height; y++) {
+    int y0 = y * 2;
+    int y1 = (y0 + 1 < source.height) ? y0 + 1 : y0;
+    for (int x = 0; x < destination->width; x++) {
+      int x0 = x * 2;
+      int x1 = (x0 + 1 < source.width) ? x0 + 1 : x0;
+      for (int c = 0; c < comp; c++) {
+        int sum = source.data[(y0 * source.width + x0) * comp + c] +
+                  source.data[(y0 * source.width + x1) * comp + c] +
+                  source.data[(y1 * source.width + x0) * comp + c] +
+                  source.data[(y1 * source.width + x1) * comp + c];
+        destination->data[(y * destination->width + x) * comp + c] =
+          static_cast<unsigned char>((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - DXT encoder
+////////////////////////////////////////////////////////////
+
+// A simple bounding box encoder. Quality is close to what drivers do
+// when compressing at runtime, which is what we're replacing.
+
+static unsigned short PackColor(const int* color) {
+  return static_cast<unsigned short>(((color[0] >> 3) << 11) |
+                                     ((color[1] >> 2) << 5) |
+                                     (color[2] >> 3));
+}
+
+static void UnpackColor(unsigned short packed, int* color) {
+  int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+static void EncodeColorBlock(const unsigned char block[16][4],
+                             unsigned char* output) {
+  int minimum[3] = {255, 255, 255}, maximum[3] = {0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < 3; c++) {
+      if (block[i][c] < minimum[c]) minimum[c] = block[i][c];
+      if (block[i][c] > maximum[c]) maximum[c] = block[i][c];
+    }
+  }
+  
+  // Inset the box a little to reduce the error of the extremes
+  for (int c = 0; c < 3; c++) {
+    int inset = (maximum[c] - minimum[c]) >> 4;
+    minimum[c] += inset;
+    maximum[c] -= inset;
+  }
+  
+  unsigned short color0 = PackColor(maximum);
+  unsigned short color1 = PackColor(minimum);
+  unsigned int indices = 0;
+  
+  if (color0 != color1) {
+    if (color0 < color1) {
+      unsigned short swap = color0;
+      color0 = color1;
+      color1 = swap;
+    }
+    
+    int palette[4][3];
+    UnpackColor(color0, palette[0]);
+    UnpackColor(color1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    
+    for (int i = 0; i < 16; i++) {
+      int best = 0, bestError = 0x7FFFFFFF;
+      for (int j = 0; j < 4; j++) {
+        int error = 0;
+        for (int c = 0; c < 3; c++) {
+          int delta = block[i][c] - palette[j][c];
+          error += delta * delta;
+        }
+        if (error < bestError) {
+          bestError = error;
+          best = j;
+        }
+      }
+      indices |= static_cast<unsigned int>(best) << (i * 2);
+    }
+  }
+  
+  output[0] = color0 & 0xFF;
+  output[1] = color0 >> 8;
+  output[2] = color1 & 0xFF;
+  output[3] = color1 >> 8;
+  for (int i = 0; i < 4; i++)
+    output[4 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+static void EncodeAlphaBlock(const unsigned char block[16][4],
+                             unsigned char* output) {
+  int alpha0 = 0, alpha1 = 255;
+  for (int i = 0; i < 16; i++) {
+    if (block[i][3] > alpha0) alpha0 = block[i][3];
+    if (block[i][3] < alpha1) alpha1 = block[i][3];
+  }
+  
+  unsigned long long indices = 0;
+  if (alpha0 != alpha1) {
+    int palette[8];
+    palette[0] = alpha0;
+    palette[1] = alpha1;
+    for (int j = 1; j < 7; j++)
+      palette[j + 1] = ((7 - j) * alpha0 + j * alpha1) / 7;
+    
+    for (int i = 0; i < 16; i++) {
+      int best = 0, bestError = 256;
+      for (int j = 0; j < 8; j++) {
+        int error = abs(block[i][3] - palette[j]);
+        if (error < bestError) {
+          bestError = error;
+          best = j;
+        }
+      }
+      indices |= static_cast<unsigned long long>(best) << (i * 3);
+    }
+  }
+  
+  output[0] = static_cast<unsigned char>(alpha0);
+  output[1] = static_cast<unsigned char>(alpha1);
+  for (int i = 0; i < 6; i++)
+    output[2 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+static void Encode(const Image& image, int comp,
+                   std::vector<unsigned char>* output) {
+  int blocksWide = (image.width + 3) / 4;
+  int blocksHigh = (image.height + 3) / 4;
+  int blockSize = (comp == 4) ? 16 : 8;
+  output->resize(blocksWide * blocksHigh * blockSize);
+  
+  unsigned char* position = &(*output)[0];
+  for (int by = 0; by < blocksHigh; by++) {
+    for (int bx = 0; bx < blocksWide; bx++) {
+      // Gather the block, clamping at the edges of small levels
+      unsigned char block[16][4];
+      for (int i = 0; i < 16; i++) {
+        int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+        if (x >= image.width) x = image.width - 1;
+        if (y >= image.height) y = image.height - 1;
+        
+        const unsigned char* pixel = &image.data[(y * image.width + x) * comp];
+        for (int c = 0; c < 3; c++)
+          block[i][c] = (comp < 3) ? pixel[0] : pixel[c];
+        block[i][3] = (comp == 4) ? pixel[3] : 255;
+      }
+      
+      if (comp == 4) {
+        EncodeAlphaBlock(block, position);
+        position += 8;
+      }
+      EncodeColorBlock(block, position);
+      position += 8;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Output
+////////////////////////////////////////////////////////////
+
+// Fields are stored little-endian whatever the host, so the header and
+// the table are serialized one field at a time
+
+static unsigned char* PutUInt32(unsigned char* position, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    position[i] = static_cast<unsigned char>(value >> (i * 8));
+  return position + 4;
+}
+
+static unsigned char* PutUInt64(unsigned char* position, uint64_t value) {
+  for (int i = 0; i < 8; i++)
+    position[i] = static_cast<unsigned char>(value >> (i * 8));
+  return position + 8;
+}
+
+static bool WriteHeader(FILE* fh, const TEXv2Header& header) {
+  unsigned char buffer[sizeof(TEXv2Header)];
+  memset(buffer, 0, sizeof(buffer));
+  
+  unsigned char* position = buffer;
+  memcpy(position, header.ident, sizeof(header.ident));
+  position += sizeof(header.ident);
+  position = PutUInt32(position, header.version);
+  position = PutUInt32(position, header.width);
+  position = PutUInt32(position, header.height);
+  position = PutUInt32(position, header.numFaces);
+  position = PutUInt32(position, header.numLevels);
+  position = PutUInt32(position, header.internalFormat);
+  position = PutUInt32(position, header.format);
+  position = PutUInt32(position, header.compression);
+  position = PutUInt32(position, header.flags);
+  
+  return fwrite(buffer, sizeof(buffer), 1, fh) == 1;
+}
+
+static bool WriteLevel(FILE* fh, const TEXv2Level& entry) {
+  unsigned char buffer[sizeof(TEXv2Level)];
+  memset(buffer, 0, sizeof(buffer));
+  
+  unsigned char* position = buffer;
+  position = PutUInt64(position, entry.offset);
+  position = PutUInt64(position, entry.size);
+  position = PutUInt64(position, entry.rawSize);
+  position = PutUInt32(position, entry.width);
+  position = PutUInt32(position, entry.height);
+  position = PutUInt32(position, entry.checksum);
+  
+  return fwrite(buffer, sizeof(buffer), 1, fh) == 1;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Main
+////////////////////////////////////////////////////////////
+
+static void Usage() {
+  fprintf(stderr, "Usage: dagon-texpack [options] output.tex face1 [... face6]\n\n"
+          "Options:\n"
+          "  -dxt        Compress for the GPU (DXT1, or DXT5 with alpha)\n"
+          "  -lz4        Pack payloads with LZ4\n"
+          "  -nomipmaps  Store the base level only\n");
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  options.hasMipmaps = true;
+  options.isCompressed = false;
+  options.isPacked = false;
+  
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (strcmp(argv[arg], "-dxt") == 0) options.isCompressed = true;
+    else if (strcmp(argv[arg], "-lz4") == 0) options.isPacked = true;
+    else if (strcmp(argv[arg], "-nomipmaps") == 0) options.hasMipmaps = false;
+    else {
+      Usage();
+      return 1;
+    }
+  }
+  
+  int numOfFaces = argc - arg - 1;
+  if (numOfFaces < 1 || numOfFaces > kMaxFaces) {
+    Usage();
+    return 1;
+  }
+  
+  const char* outputName = argv[arg++];
+  
+  // The first face decides the size and channels of the rest
+  std::vector<Image> arrayOfFaces;
+  int comp = 0;
+  for (int i = 0; i < numOfFaces; i++) {
+    int x, y, n;
+    unsigned char* data = stbi_load(argv[arg + i], &x, &y, &n, comp);
+    if (!data) {
+      fprintf(stderr, "Error while loading image: (%s) %s\n", argv[arg + i],
+              stbi_failure_reason());
+      return 1;
+    }
+    
+    if (!comp)
+      comp = n;
+    
+    if (!arrayOfFaces.empty() &&
+        (x != arrayOfFaces[0].width || y != arrayOfFaces[0].height)) {
+      fprintf(stderr, "Faces must be of the same size: %s\n", argv[arg + i]);
+      stbi_image_free(data);
+      return 1;
+    }
+    
+    Image face;
+    face.width = x;
+    face.height = y;
+    face.data.assign(data, data + x * y * comp);
+    arrayOfFaces.push_back(face);
+    stbi_image_free(data);
+  }
+  
+  TEXv2Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.ident, "KS_TEX2", 8);
+  header.version = 2;
+  header.width = arrayOfFaces[0].width;
+  header.height = arrayOfFaces[0].height;
+  header.numFaces = numOfFaces;
+  header.compression = options.isPacked ? kTEXCodecLZ4 : kTEXCodecNone;
+  
+  int numOfLevels = 1;
+  if (options.hasMipmaps) {
+    int size = (header.width > header.height) ? header.width : header.height;
+    while (size > 1) {
+      size /= 2;
+      numOfLevels++;
+    }
+  }
+  header.numLevels = numOfLevels;
+  
+  if (options.isCompressed) {
+    // Luminance with alpha is stored as RGBA
+    if (comp == STBI_grey_alpha) {
+      for (int i = 0; i < numOfFaces; i++) {
+        std::vector<unsigned char> data(arrayOfFaces[i].data.size() * 2);
+        for (size_t j = 0; j < arrayOfFaces[i].data.size() / 2; j++) {
+          data[j * 4] = data[j * 4 + 1] = data[j * 4 + 2] = arrayOfFaces[i].data[j * 2];
+          data[j * 4 + 3] = arrayOfFaces[i].data[j * 2 + 1];
+        }
+        arrayOfFaces[i].data.swap(data);
+      }
+      comp = STBI_rgb_alpha;
+    }
+    
+    header.internalFormat = (comp == STBI_rgb_alpha) ?
+      GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    header.flags = kTEXFlagCompressed;
+  }
+  
+  // Decided once any conversion is done, since the engine takes the
+  // depth of the faces from it
+  switch (comp) {
+    case STBI_grey: header.format = GL_LUMINANCE; break;
+    case STBI_grey_alpha: header.format = GL_LUMINANCE_ALPHA; break;
+    case STBI_rgb: header.format = GL_RGB; break;
+    case STBI_rgb_alpha: header.format = GL_RGBA; break;
+  }
+  
+  if (!options.isCompressed)
+    header.internalFormat = header.format;
+  
+  FILE* fh = fopen(outputName, "wb");
+  if (!fh) {
+    fprintf(stderr, "Could not create file: %s\n", outputName);
+    return 1;
+  }
+  
+  // Payloads follow the header and the table, which is written last
+  std::vector<TEXv2Level> arrayOfEntries(numOfFaces * numOfLevels);
+  uint64_t offset = sizeof(header) + sizeof(TEXv2Level) * arrayOfEntries.size();
+  fseek(fh, static_cast<long>(offset), SEEK_SET);
+  
+  size_t rawTotal = 0, storedTotal = 0;
+  for (int i = 0; i < numOfFaces; i++) {
+    Image level = arrayOfFaces[i];
+    
+    for (int j = 0; j < numOfLevels; j++) {
+      if (j > 0) {
+        Image next;
+        Downsample(level, &next, comp);
+        level.data.swap(next.data);
+        level.width = next.width;
+        level.height = next.height;
+      }
+      
+      std::vector<unsigned char> payload;
+      if (options.isCompressed)
+        Encode(level, comp, &payload);
+      else
+        payload = level.data;
+      
+      TEXv2Level& entry = arrayOfEntries[i * numOfLevels + j];
+      memset(&entry, 0, sizeof(entry));
+      entry.width = level.width;
+      entry.height = level.height;
+      entry.rawSize = payload.size();
+      
+      if (options.isPacked) {
+        std::vector<unsigned char> packed(LZ4Bound(payload.size()));
+        size_t size = LZ4Compress(&payload[0], payload.size(),
+                                  &packed[0], packed.size());
+        packed.resize(size);
+        payload.swap(packed);
+      }
+      
+      entry.offset = offset;
+      entry.size = payload.size();
+      entry.checksum = Checksum(&payload[0], payload.size());
+      
+      if (fwrite(&payload[0], 1, payload.size(), fh) != payload.size()) {
+        fprintf(stderr, "Error while writing file: %s\n", outputName);
+        fclose(fh);
+        return 1;
+      }
+      
+      offset += payload.size();
+      rawTotal += static_cast<size_t>(entry.rawSize);
+      storedTotal += payload.size();
+    }
+  }
+  
+  fseek(fh, 0, SEEK_SET);
+  bool isWritten = WriteHeader(fh, header);
+  for (size_t i = 0; isWritten && i < arrayOfEntries.size(); i++)
+    isWritten = WriteLevel(fh, arrayOfEntries[i]);
+  fclose(fh);
+  
+  if (!isWritten) {
+    fprintf(stderr, "Error while writing file: %s\n", outputName);
+    return 1;
+  }
+  
+  printf("%s: %d faces, %d levels, %lu bytes (%lu unpacked)\n", outputName,
+         numOfFaces, numOfLevels, static_cast<unsigned long>(storedTotal),
+         static_cast<unsigned long>(rawTotal));
+  
+  return 0;
+}